@@ -8,20 +8,28 @@
 static const infra_lua_api_t* s_api[] = {
     &infra_f_argparser,
     &infra_f_basename,
+    &infra_f_cache,
     &infra_f_compare,
     &infra_f_cwd,
+    &infra_f_deque,
     &infra_f_dirname,
     &infra_f_dump_any,
     &infra_f_dump_hex,
     &infra_f_execute,
     &infra_f_exepath,
+    &infra_f_hashmap,
+    &infra_f_heap,
     &infra_f_man,
     &infra_f_map,
+    &infra_f_map_mmap,
     &infra_f_merge_line,
     &infra_f_pairs,
     &infra_f_range,
     &infra_f_readdir,
     &infra_f_readfile,
+    &infra_f_set,
+    &infra_f_shared_map,
+    &infra_f_sort,
     &infra_f_split_line,
     &infra_f_strcasecmp,
     &infra_f_writefile,
@@ -61,20 +61,28 @@ typedef struct infra_lua_api
  */
 extern const infra_lua_api_t infra_f_argparser;
 extern const infra_lua_api_t infra_f_basename;
+extern const infra_lua_api_t infra_f_cache;
 extern const infra_lua_api_t infra_f_compare;
 extern const infra_lua_api_t infra_f_cwd;
+extern const infra_lua_api_t infra_f_deque;
 extern const infra_lua_api_t infra_f_dirname;
 extern const infra_lua_api_t infra_f_dump_any;
 extern const infra_lua_api_t infra_f_dump_hex;
 extern const infra_lua_api_t infra_f_execute;
 extern const infra_lua_api_t infra_f_exepath;
+extern const infra_lua_api_t infra_f_hashmap;
+extern const infra_lua_api_t infra_f_heap;
 extern const infra_lua_api_t infra_f_man;
 extern const infra_lua_api_t infra_f_map;
+extern const infra_lua_api_t infra_f_map_mmap;
 extern const infra_lua_api_t infra_f_merge_line;
 extern const infra_lua_api_t infra_f_pairs;
 extern const infra_lua_api_t infra_f_range;
 extern const infra_lua_api_t infra_f_readdir;
 extern const infra_lua_api_t infra_f_readfile;
+extern const infra_lua_api_t infra_f_set;
+extern const infra_lua_api_t infra_f_shared_map;
+extern const infra_lua_api_t infra_f_sort;
 extern const infra_lua_api_t infra_f_split_line;
 extern const infra_lua_api_t infra_f_strcasecmp;
 extern const infra_lua_api_t infra_f_writefile;
@@ -125,6 +133,112 @@ API_LOCAL void infra_push_error(lua_State* L, int errcode);
 
 API_LOCAL int infra_raise_error(lua_State* L, int errcode);
 
+/**
+ * @brief Native copy of a Lua value, used to compare keys without calling
+ *   back into Lua.
+ * @see infra_key_init()
+ * @see infra_key_compare()
+ */
+typedef struct infra_key
+{
+    int                 type;       /**< Lua type of the value. */
+    unsigned char       native;     /**< Whether #infra_key::v is valid. */
+    unsigned char       integer;    /**< Whether #LUA_TNUMBER is stored in `v.i` instead of `v.n`. */
+    union
+    {
+        lua_Number      n;          /**< #LUA_TNUMBER */
+        lua_Integer     i;          /**< #LUA_TNUMBER, if #infra_key::integer is set. */
+        int             b;          /**< #LUA_TBOOLEAN */
+        const void*     p;          /**< Address of other types. */
+        struct
+        {
+            const char* str;        /**< String address. */
+            size_t      len;        /**< String length. */
+        } s;                        /**< #LUA_TSTRING */
+    } v;                            /**< Value. */
+} infra_key_t;
+
+/**
+ * @brief Take a native copy of value at \p idx.
+ * @warning If the value is a string, \p key only borrow the address, so the
+ *   value must be kept alive as long as \p key is in use.
+ * @param[in] L     Lua VM.
+ * @param[in] idx   Stack index.
+ * @param[out] key  Native key.
+ */
+API_LOCAL void infra_key_init(lua_State* L, int idx, infra_key_t* key);
+
+/**
+ * @brief Compare two native keys, with the same semantics as `compare()`.
+ * @param[in] k1    Key 1.
+ * @param[in] k2    Key 2.
+ * @param[out] ret  Compare result, -1, 0 or 1.
+ * @return          1 if compare success, 0 if both keys must be compared in
+ *                  Lua (e.g. there are metamethods).
+ */
+API_LOCAL int infra_key_compare(const infra_key_t* k1, const infra_key_t* k2, int* ret);
+
+/**
+ * @brief Compare two #LUA_TNUMBER keys exactly.
+ *
+ * Integers are compared as integers, and an integer and a float are compared
+ * by their mathematical values, so large integers never collapse into the
+ * same float.
+ *
+ * @param[in] k1    Key 1.
+ * @param[in] k2    Key 2.
+ * @return          -1, 0 or 1. NaN is equal to anything.
+ */
+API_LOCAL int infra_key_compare_number(const infra_key_t* k1, const infra_key_t* k2);
+
+/**
+ * @brief Compare two strings as unsigned bytes, with the same semantics as
+ *   `compare()`.
+ * @param[in] dat1      String 1.
+ * @param[in] dat1_sz   Length of string 1.
+ * @param[in] dat2      String 2.
+ * @param[in] dat2_sz   Length of string 2.
+ * @return              -1, 0 or 1.
+ */
+API_LOCAL int infra_compare_string(const char* dat1, size_t dat1_sz,
+    const char* dat2, size_t dat2_sz);
+
+/**
+ * @brief Compare two strings byte by byte, ignoring case of ASCII letters.
+ * @param[in] dat1      String 1.
+ * @param[in] dat1_sz   Length of string 1.
+ * @param[in] dat2      String 2.
+ * @param[in] dat2_sz   Length of string 2.
+ * @return              -1, 0 or 1.
+ */
+API_LOCAL int infra_compare_string_ci(const char* dat1, size_t dat1_sz,
+    const char* dat2, size_t dat2_sz);
+
+/**
+ * @brief Save all key-value pairs of map at \p idx into file \p path, in the
+ *   format that `make_map_mmap()` reads.
+ * @param[in] L     Lua VM.
+ * @param[in] idx   Stack index of map. It is iterated with `__pairs`, so keys
+ *                  must come in the order of \p cmp.
+ * @param[in] path  File path.
+ * @param[in] cmp   Name of comparator, NULL for the default order.
+ * @param[in] count The number of key-value pairs.
+ * @return          Always 0. Raise error if failed.
+ */
+API_LOCAL int infra_map_save(lua_State* L, int idx, const char* path, const char* cmp,
+    size_t count);
+
+/**
+ * @brief Calculate hash code of native key.
+ *
+ * Keys that compare equal by #infra_key_compare() always have the same hash
+ * code.
+ *
+ * @param[in] key   Native key.
+ * @return          Hash code.
+ */
+API_LOCAL size_t infra_key_hash(const infra_key_t* key);
+
 /**
  * @brief Compat for Windows and Unix
  * @{
@@ -1,6 +1,7 @@
 #include "__init__.h"
 #include "utils/list.h"
 #include "utils/map.h"
+#include "utils/slab.h"
 #include <inttypes.h>
 #include <stdio.h>
 #include <assert.h>
@@ -41,6 +42,7 @@ struct infra_argp
     char*                   epilog;
 
     ev_list_t               arg_table;  /**< Save #infra_argp_opt_t. */
+    ev_slab_t               arg_slab;   /**< Allocator for #infra_argp_opt_t. */
 };
 
 typedef struct infra_argp_helper
@@ -122,9 +124,10 @@ static void _infra_argp_clear_arg_table(lua_State* L, infra_argp_t* self)
             arg->v_default = LUA_NOREF;
         }
 
-        free(arg);
+        ev_slab_free(&self->arg_slab, arg);
         arg = NULL;
     }
+    ev_slab_exit(&self->arg_slab);
 }
 
 static int _infra_argp_meta_gc(lua_State* L)
@@ -728,7 +731,7 @@ static int _infra_argp_add_argument(lua_State* L)
     char* copy_opt_name = infra_tmpbuf(L, opt_name_sz); // sp+1
     memcpy(copy_opt_name, opt_name, opt_name_sz);
 
-    infra_argp_opt_t* new_arg = malloc(sizeof(infra_argp_opt_t));
+    infra_argp_opt_t* new_arg = ev_slab_alloc(&self->arg_slab);
     if (new_arg == NULL)
     {
         goto error_oom;
@@ -1081,6 +1084,7 @@ static int _infra_argparser(lua_State* L)
     infra_argp_t* self = lua_newuserdata(L, sizeof(infra_argp_t));
     memset(self, 0, sizeof(*self));
     ev_list_init(&self->arg_table);
+    ev_slab_init(&self->arg_slab, sizeof(infra_argp_opt_t));
 
     static const luaL_Reg s_meta[] = {
         { "__gc",               _infra_argp_meta_gc },
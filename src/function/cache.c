@@ -0,0 +1,745 @@
+#include "__init__.h"
+#include "utils/list.h"
+#include "utils/slab.h"
+
+#define INFRA_CACHE_NAME            "__infra_cache"
+#define INFRA_CACHE_MIN_BUCKETS     16
+
+/**
+ * @brief Eviction policy.
+ */
+typedef enum infra_cache_policy
+{
+    INFRA_CACHE_LRU,    /**< Evict the least recently used entry. */
+    INFRA_CACHE_LFU,    /**< Evict the least frequently used entry. */
+} infra_cache_policy_t;
+
+struct infra_cache_freq;
+
+typedef struct infra_cache_entry
+{
+    ev_list_node_t              node;       /**< Node in recency list. */
+    struct infra_cache_entry*   next;       /**< Next entry in hash bucket. */
+    struct infra_cache_freq*    freq;       /**< Frequency bucket, for #INFRA_CACHE_LFU. */
+    infra_key_t                 key;        /**< Native copy of key. */
+    size_t                      hash;       /**< Hash code of key. */
+    size_t                      bytes;      /**< Accounted size of entry. */
+    int                         id;         /**< Entry id in data table. */
+} infra_cache_entry_t;
+
+/**
+ * @brief Entries that are used the same times, for #INFRA_CACHE_LFU.
+ */
+typedef struct infra_cache_freq
+{
+    ev_list_node_t      node;       /**< Node in #infra_cache::freqs. */
+    ev_list_t           entries;    /**< Entries, most recently used first. */
+    size_t              freq;       /**< Use count. */
+} infra_cache_freq_t;
+
+typedef struct infra_cache
+{
+    int                     policy;     /**< #infra_cache_policy_t. */
+    size_t                  capacity;   /**< Max number of entries, 0 if no limit. */
+    size_t                  max_bytes;  /**< Max accounted bytes, 0 if no limit. */
+
+    infra_cache_entry_t**   buckets;    /**< Hash index. */
+    size_t                  bucket_cap; /**< The number of buckets, always 2^n. */
+    size_t                  size;       /**< The number of entries. */
+    size_t                  bytes;      /**< Accounted bytes of all entries. */
+    ev_slab_t               slab;       /**< Allocator for #infra_cache_entry_t. */
+
+    ev_list_t               lru;        /**< Entries, most recently used first, for #INFRA_CACHE_LRU. */
+    ev_list_t               freqs;      /**< Frequency buckets in ascending order, for #INFRA_CACHE_LFU. */
+
+    size_t                  hits;       /**< The number of hits. */
+    size_t                  misses;     /**< The number of misses. */
+    size_t                  evictions;  /**< The number of evicted entries. */
+
+    int*                    free_ids;   /**< Recycled entry ids. */
+    size_t                  free_sz;    /**< The number of recycled ids. */
+    size_t                  free_cap;   /**< Capacity of #infra_cache::free_ids. */
+    int                     next_id;    /**< The largest allocated id. */
+
+    /**
+     * @brief Reference to data table.
+     * Key of entry `id` is stored at `2*id-1`, and value at `2*id`.
+     */
+    int                     ref_data;
+    int                     ref_evict;  /**< Reference to eviction callback. */
+} infra_cache_t;
+
+static int _infra_cache_alloc_id(infra_cache_t* self)
+{
+    if (self->free_sz > 0)
+    {
+        return self->free_ids[--self->free_sz];
+    }
+    return ++self->next_id;
+}
+
+static void _infra_cache_free_id(infra_cache_t* self, int id)
+{
+    if (self->free_sz == self->free_cap)
+    {
+        size_t new_cap = self->free_cap == 0 ? 16 : self->free_cap * 2;
+        int* new_ids = realloc(self->free_ids, sizeof(int) * new_cap);
+        if (new_ids == NULL)
+        {/* Just leave a hole in data table. */
+            return;
+        }
+        self->free_ids = new_ids;
+        self->free_cap = new_cap;
+    }
+
+    self->free_ids[self->free_sz++] = id;
+}
+
+static int _infra_cache_key_equal(const infra_key_t* k1, const infra_key_t* k2)
+{
+    int ret;
+    if (infra_key_compare(k1, k2, &ret))
+    {
+        return ret == 0;
+    }
+
+    /* Values without native representation are compared by identity. */
+    return k1->v.p == k2->v.p;
+}
+
+/**
+ * @brief Find the link that points to entry of \p key.
+ * @return  The link. It points to NULL if not found.
+ */
+static infra_cache_entry_t** _infra_cache_lookup(infra_cache_t* self, const infra_key_t* key,
+    size_t hash)
+{
+    infra_cache_entry_t** link = &self->buckets[hash & (self->bucket_cap - 1)];
+
+    for (; *link != NULL; link = &(*link)->next)
+    {
+        if ((*link)->hash == hash && _infra_cache_key_equal(&(*link)->key, key))
+        {
+            break;
+        }
+    }
+
+    return link;
+}
+
+/**
+ * @brief Ensure there is room for one more entry in hash index.
+ * @return  0 if success, -1 if out of memory.
+ */
+static int _infra_cache_reserve(infra_cache_t* self)
+{
+    if (self->size < self->bucket_cap)
+    {
+        return 0;
+    }
+
+    size_t new_cap = self->bucket_cap * 2;
+    infra_cache_entry_t** buckets = calloc(new_cap, sizeof(infra_cache_entry_t*));
+    if (buckets == NULL)
+    {
+        return -1;
+    }
+
+    size_t i;
+    for (i = 0; i < self->bucket_cap; i++)
+    {
+        infra_cache_entry_t* entry = self->buckets[i];
+        while (entry != NULL)
+        {
+            infra_cache_entry_t* next = entry->next;
+            infra_cache_entry_t** link = &buckets[entry->hash & (new_cap - 1)];
+            entry->next = *link;
+            *link = entry;
+            entry = next;
+        }
+    }
+
+    free(self->buckets);
+    self->buckets = buckets;
+    self->bucket_cap = new_cap;
+
+    return 0;
+}
+
+/**
+ * @brief Record one more use of \p entry.
+ */
+static void _infra_cache_touch(infra_cache_t* self, infra_cache_entry_t* entry)
+{
+    if (self->policy == INFRA_CACHE_LRU)
+    {
+        ev_list_erase(&self->lru, &entry->node);
+        ev_list_push_front(&self->lru, &entry->node);
+        return;
+    }
+
+    infra_cache_freq_t* cur = entry->freq;
+    ev_list_node_t* next = ev_list_next(&cur->node);
+    infra_cache_freq_t* dst = next != NULL ? container_of(next, infra_cache_freq_t, node) : NULL;
+
+    if (dst == NULL || dst->freq != cur->freq + 1)
+    {
+        if (ev_list_size(&cur->entries) == 1)
+        {/* Reuse the bucket since this is the only entry. */
+            cur->freq++;
+            return;
+        }
+
+        dst = malloc(sizeof(infra_cache_freq_t));
+        if (dst == NULL)
+        {/* Just lose one count. */
+            return;
+        }
+        ev_list_init(&dst->entries);
+        dst->freq = cur->freq + 1;
+        ev_list_insert_after(&self->freqs, &cur->node, &dst->node);
+    }
+
+    ev_list_erase(&cur->entries, &entry->node);
+    ev_list_push_front(&dst->entries, &entry->node);
+    entry->freq = dst;
+
+    if (ev_list_size(&cur->entries) == 0)
+    {
+        ev_list_erase(&self->freqs, &cur->node);
+        free(cur);
+    }
+}
+
+/**
+ * @brief Link new \p entry into recency structure.
+ * @return  0 if success, -1 if out of memory.
+ */
+static int _infra_cache_link(infra_cache_t* self, infra_cache_entry_t* entry)
+{
+    if (self->policy == INFRA_CACHE_LRU)
+    {
+        ev_list_push_front(&self->lru, &entry->node);
+        return 0;
+    }
+
+    ev_list_node_t* first = ev_list_begin(&self->freqs);
+    infra_cache_freq_t* freq = first != NULL ? container_of(first, infra_cache_freq_t, node) : NULL;
+    if (freq == NULL || freq->freq != 1)
+    {
+        freq = malloc(sizeof(infra_cache_freq_t));
+        if (freq == NULL)
+        {
+            return -1;
+        }
+        ev_list_init(&freq->entries);
+        freq->freq = 1;
+        ev_list_push_front(&self->freqs, &freq->node);
+    }
+
+    ev_list_push_front(&freq->entries, &entry->node);
+    entry->freq = freq;
+    return 0;
+}
+
+static void _infra_cache_unlink(infra_cache_t* self, infra_cache_entry_t* entry)
+{
+    if (self->policy == INFRA_CACHE_LRU)
+    {
+        ev_list_erase(&self->lru, &entry->node);
+        return;
+    }
+
+    infra_cache_freq_t* freq = entry->freq;
+    ev_list_erase(&freq->entries, &entry->node);
+    if (ev_list_size(&freq->entries) == 0)
+    {
+        ev_list_erase(&self->freqs, &freq->node);
+        free(freq);
+    }
+}
+
+/**
+ * @brief Get the entry to evict next.
+ */
+static infra_cache_entry_t* _infra_cache_victim(infra_cache_t* self)
+{
+    ev_list_node_t* node;
+
+    if (self->policy == INFRA_CACHE_LRU)
+    {
+        node = ev_list_end(&self->lru);
+    }
+    else
+    {
+        node = ev_list_begin(&self->freqs);
+        node = node != NULL ? ev_list_end(&container_of(node, infra_cache_freq_t, node)->entries) : NULL;
+    }
+
+    return node != NULL ? container_of(node, infra_cache_entry_t, node) : NULL;
+}
+
+/**
+ * @brief Remove \p entry whose link in hash index is \p link.
+ * @param[in] push  Whether to push key and value of the entry.
+ */
+static void _infra_cache_erase(lua_State* L, infra_cache_t* self, infra_cache_entry_t** link,
+    int push)
+{
+    infra_cache_entry_t* entry = *link;
+    *link = entry->next;
+
+    _infra_cache_unlink(self, entry);
+    self->size--;
+    self->bytes -= entry->bytes;
+
+    if (push)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+        lua_rawgeti(L, -1, 2 * (lua_Integer)entry->id - 1);
+        lua_rawgeti(L, -2, 2 * (lua_Integer)entry->id);
+        lua_remove(L, -3);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, 2 * (lua_Integer)entry->id - 1);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, 2 * (lua_Integer)entry->id);
+    lua_pop(L, 1);
+
+    _infra_cache_free_id(self, entry->id);
+    ev_slab_free(&self->slab, entry);
+}
+
+/**
+ * @brief Evict entries until there is room for an entry of \p bytes.
+ */
+static void _infra_cache_evict(lua_State* L, infra_cache_t* self, size_t bytes)
+{
+    while ((self->capacity != 0 && self->size >= self->capacity)
+        || (self->max_bytes != 0 && self->bytes + bytes > self->max_bytes))
+    {
+        infra_cache_entry_t* entry = _infra_cache_victim(self);
+        if (entry == NULL)
+        {
+            break;
+        }
+
+        self->evictions++;
+        if (self->ref_evict == LUA_NOREF)
+        {
+            _infra_cache_erase(L, self, _infra_cache_lookup(self, &entry->key, entry->hash), 0);
+            continue;
+        }
+
+        /* The entry is gone before the callback, so it can do anything. */
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_evict);
+        _infra_cache_erase(L, self, _infra_cache_lookup(self, &entry->key, entry->hash), 1);
+        lua_call(L, 2, 0);
+    }
+}
+
+/**
+ * @brief Accounted size of value at \p idx.
+ */
+static size_t _infra_cache_value_bytes(lua_State* L, int idx)
+{
+    size_t len = 0;
+    if (lua_type(L, idx) == LUA_TSTRING)
+    {
+        lua_tolstring(L, idx, &len);
+    }
+    return len;
+}
+
+static infra_cache_t* _infra_cache_check(lua_State* L, int idx)
+{
+    return luaL_checkudata(L, idx, INFRA_CACHE_NAME);
+}
+
+static int _infra_cache_gc(lua_State* L)
+{
+    infra_cache_t* self = lua_touserdata(L, 1);
+
+    ev_list_node_t* node;
+    while ((node = ev_list_pop_front(&self->freqs)) != NULL)
+    {
+        free(container_of(node, infra_cache_freq_t, node));
+    }
+    ev_list_init(&self->lru);
+
+    /* All entries live in slab, and all Lua values live in data table. */
+    ev_slab_exit(&self->slab);
+    free(self->buckets);
+    self->buckets = NULL;
+    self->bucket_cap = 0;
+    self->size = 0;
+
+    free(self->free_ids);
+    self->free_ids = NULL;
+    self->free_sz = 0;
+    self->free_cap = 0;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_evict);
+    self->ref_evict = LUA_NOREF;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_data);
+    self->ref_data = LUA_NOREF;
+
+    return 0;
+}
+
+static int _infra_cache_size(lua_State* L)
+{
+    infra_cache_t* self = _infra_cache_check(L, 1);
+    lua_pushinteger(L, (lua_Integer)self->size);
+    return 1;
+}
+
+/**
+ * @brief Find entry of key at \p idx.
+ * @param[in] touch Whether to count as a use of the entry.
+ */
+static int _infra_cache_find(lua_State* L, int touch)
+{
+    infra_cache_t* self = _infra_cache_check(L, 1);
+    luaL_checkany(L, 2);
+
+    infra_key_t key;
+    infra_key_init(L, 2, &key);
+    size_t hash = infra_key_hash(&key);
+
+    infra_cache_entry_t* entry = *_infra_cache_lookup(self, &key, hash);
+    if (entry == NULL)
+    {
+        self->misses += touch;
+        lua_pushboolean(L, 0);
+        lua_pushnil(L);
+        return 2;
+    }
+
+    if (touch)
+    {
+        self->hits++;
+        _infra_cache_touch(self, entry);
+    }
+
+    lua_pushboolean(L, 1);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, 2 * (lua_Integer)entry->id);
+    lua_remove(L, -2);
+    return 2;
+}
+
+static int _infra_cache_get(lua_State* L)
+{
+    return _infra_cache_find(L, 1);
+}
+
+static int _infra_cache_peek(lua_State* L)
+{
+    return _infra_cache_find(L, 0);
+}
+
+static int _infra_cache_set(lua_State* L)
+{
+    infra_cache_t* self = _infra_cache_check(L, 1);
+    luaL_checkany(L, 2);
+    lua_settop(L, 4);
+
+    if (lua_type(L, 2) == LUA_TNIL)
+    {
+        return luaL_error(L, "cache key cannot be nil.");
+    }
+
+    size_t bytes;
+    if (lua_type(L, 4) != LUA_TNIL)
+    {
+        lua_Integer val = luaL_checkinteger(L, 4);
+        luaL_argcheck(L, val >= 0, 4, "must not be negative");
+        bytes = (size_t)val;
+    }
+    else
+    {
+        bytes = sizeof(infra_cache_entry_t) + _infra_cache_value_bytes(L, 2)
+            + _infra_cache_value_bytes(L, 3);
+    }
+
+    infra_key_t key;
+    infra_key_init(L, 2, &key);
+    size_t hash = infra_key_hash(&key);
+
+    /* Replace means drop the old one and start over. */
+    infra_cache_entry_t** link = _infra_cache_lookup(self, &key, hash);
+    if (*link != NULL)
+    {
+        _infra_cache_erase(L, self, link, 0);
+    }
+
+    if (self->max_bytes != 0 && bytes > self->max_bytes)
+    {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    _infra_cache_evict(L, self, bytes);
+
+    /* The callback might have set the same key. */
+    link = _infra_cache_lookup(self, &key, hash);
+    if (*link != NULL)
+    {
+        _infra_cache_erase(L, self, link, 0);
+    }
+
+    if (_infra_cache_reserve(self) != 0)
+    {
+        return luaL_error(L, INFRA_LUA_ERRMSG_OOM);
+    }
+    infra_cache_entry_t* entry = ev_slab_alloc(&self->slab);
+    INFRA_CHECK_OOM(L, entry);
+    if (_infra_cache_link(self, entry) != 0)
+    {
+        ev_slab_free(&self->slab, entry);
+        return luaL_error(L, INFRA_LUA_ERRMSG_OOM);
+    }
+
+    entry->key = key;
+    entry->hash = hash;
+    entry->bytes = bytes;
+    entry->id = _infra_cache_alloc_id(self);
+
+    link = _infra_cache_lookup(self, &key, hash);
+    entry->next = NULL;
+    *link = entry;
+    self->size++;
+    self->bytes += bytes;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, 2 * (lua_Integer)entry->id - 1);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, 2 * (lua_Integer)entry->id);
+    lua_pop(L, 1);
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int _infra_cache_remove(lua_State* L)
+{
+    infra_cache_t* self = _infra_cache_check(L, 1);
+    luaL_checkany(L, 2);
+
+    infra_key_t key;
+    infra_key_init(L, 2, &key);
+
+    infra_cache_entry_t** link = _infra_cache_lookup(self, &key, infra_key_hash(&key));
+    if (*link == NULL)
+    {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    _infra_cache_erase(L, self, link, 0);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int _infra_cache_clear(lua_State* L)
+{
+    infra_cache_t* self = _infra_cache_check(L, 1);
+
+    infra_cache_entry_t* entry;
+    while ((entry = _infra_cache_victim(self)) != NULL)
+    {
+        _infra_cache_erase(L, self, _infra_cache_lookup(self, &entry->key, entry->hash), 0);
+    }
+
+    return 0;
+}
+
+static int _infra_cache_stats(lua_State* L)
+{
+    infra_cache_t* self = _infra_cache_check(L, 1);
+
+    lua_newtable(L);
+    lua_pushinteger(L, (lua_Integer)self->hits);
+    lua_setfield(L, -2, "hits");
+    lua_pushinteger(L, (lua_Integer)self->misses);
+    lua_setfield(L, -2, "misses");
+    lua_pushinteger(L, (lua_Integer)self->evictions);
+    lua_setfield(L, -2, "evictions");
+    lua_pushinteger(L, (lua_Integer)self->size);
+    lua_setfield(L, -2, "size");
+    lua_pushinteger(L, (lua_Integer)self->bytes);
+    lua_setfield(L, -2, "bytes");
+
+    return 1;
+}
+
+/**
+ * @brief Get a non-negative integer option, 0 if absent.
+ */
+static size_t _infra_cache_opt_size(lua_State* L, int idx, const char* name)
+{
+    size_t ret = 0;
+
+    lua_getfield(L, idx, name);
+    if (lua_type(L, -1) != LUA_TNIL)
+    {
+        int isint = 0;
+        lua_Integer val = 0;
+        if (lua_type(L, -1) == LUA_TNUMBER)
+        {
+#if LUA_VERSION_NUM >= 503
+            val = lua_tointegerx(L, -1, &isint);
+#else
+            lua_Number n = lua_tonumber(L, -1);
+            val = (lua_Integer)n;
+            isint = (lua_Number)val == n;
+#endif
+        }
+        if (!isint || val < 0)
+        {
+            return luaL_argerror(L, idx,
+                lua_pushfstring(L, "`%s` must be a non-negative integer", name));
+        }
+        ret = (size_t)val;
+    }
+    lua_pop(L, 1);
+
+    return ret;
+}
+
+static void _infra_cache_setup(lua_State* L, infra_cache_t* self, int idx)
+{
+    self->capacity = _infra_cache_opt_size(L, idx, "capacity");
+    self->max_bytes = _infra_cache_opt_size(L, idx, "max_bytes");
+
+    lua_getfield(L, idx, "policy");
+    const char* policy = lua_tostring(L, -1);
+    if (policy == NULL || strcmp(policy, "lru") == 0)
+    {
+        self->policy = INFRA_CACHE_LRU;
+    }
+    else if (strcmp(policy, "lfu") == 0)
+    {
+        self->policy = INFRA_CACHE_LFU;
+    }
+    else
+    {
+        luaL_error(L, "unknown value for `policy`.");
+        return;
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, idx, "on_evict");
+    if (lua_type(L, -1) == LUA_TFUNCTION)
+    {
+        self->ref_evict = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else if (lua_type(L, -1) == LUA_TNIL)
+    {
+        lua_pop(L, 1);
+    }
+    else
+    {
+        luaL_error(L, "unknown value for `on_evict`.");
+    }
+}
+
+static int _infra_new_cache(lua_State* L)
+{
+    lua_settop(L, 1);
+
+    infra_cache_t* self = lua_newuserdata(L, sizeof(infra_cache_t));
+    memset(self, 0, sizeof(*self));
+    self->ref_data = LUA_NOREF;
+    self->ref_evict = LUA_NOREF;
+    ev_slab_init(&self->slab, sizeof(infra_cache_entry_t));
+
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _infra_cache_gc },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_method[] = {
+        { "size",       _infra_cache_size },
+        { "get",        _infra_cache_get },
+        { "peek",       _infra_cache_peek },
+        { "set",        _infra_cache_set },
+        { "remove",     _infra_cache_remove },
+        { "clear",      _infra_cache_clear },
+        { "stats",      _infra_cache_stats },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, INFRA_CACHE_NAME) != 0)
+    {
+        luaL_setfuncs(L, s_meta, 0);
+
+        /* metatable.__index = s_method */
+        luaL_newlib(L, s_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+
+    self->buckets = calloc(INFRA_CACHE_MIN_BUCKETS, sizeof(infra_cache_entry_t*));
+    INFRA_CHECK_OOM(L, self->buckets);
+    self->bucket_cap = INFRA_CACHE_MIN_BUCKETS;
+
+    lua_newtable(L);
+    self->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (lua_type(L, 1) == LUA_TTABLE)
+    {
+        _infra_cache_setup(L, self, 1);
+    }
+
+    return 1;
+}
+
+const infra_lua_api_t infra_f_cache = {
+"make_cache", _infra_new_cache, 0,
+"Create a new empty cache.",
+
+"[SYNOPSIS]\n"
+"cache make_cache([opt])\n"
+"\n"
+"[DESCRIPTION]\n"
+"Create a new empty cache. A cache is a hash table that evicts entries when\n"
+"it is full. Keys can be anything except nil, and values can be anything.\n"
+"\n"
+"`opt` is a table with following fields, all optional:\n"
+"  + `capacity`: Max number of entries. 0 or nil means no limit.\n"
+"  + `max_bytes`: Max bytes of entries. 0 or nil means no limit.\n"
+"  + `policy`: `lru` (the default) evicts the least recently used entry. `lfu`\n"
+"    evicts the least frequently used entry, and the least recently used one\n"
+"    among them.\n"
+"  + `on_evict`: A function called as `on_evict(key, value)` after an entry is\n"
+"    evicted. It is not called for `remove()`, `clear()` or replaced values.\n"
+"\n"
+"The bytes of an entry is the length of key and value if they are strings,\n"
+"plus a fixed overhead. Use `bytes` of `set()` for values of other types.\n"
+"All operations are O(1).\n"
+"\n"
+"A cache have following metamethod:\n"
+"  integer cache:size()\n"
+"    Return the number of entries.\n"
+"  boolean,any cache:get(key)\n"
+"    Find the matching value for the key, and count as a use of it. If found,\n"
+"    the first return value is true, the second is the associated value. If\n"
+"    not found, return false and nil.\n"
+"  boolean,any cache:peek(key)\n"
+"    Same as `get()`, but does not count as a use or a hit/miss.\n"
+"  boolean cache:set(key, value[, bytes])\n"
+"    Insert key and value, replace any existing value. Evict entries if there\n"
+"    is no room. `bytes` overrides the bytes of this entry. If the entry is\n"
+"    larger than `max_bytes`, it is not cached and false is returned.\n"
+"  boolean cache:remove(key)\n"
+"    Remove entry. If the key is not exist, return false.\n"
+"  cache:clear()\n"
+"    Remove all entries.\n"
+"  table cache:stats()\n"
+"    Return a table with fields `hits`, `misses`, `evictions`, `size` and\n"
+"    `bytes`.\n"
+};
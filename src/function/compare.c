@@ -1,10 +1,71 @@
 #include "__init__.h"
+#include <ctype.h>
+#include <math.h>
 
-static int _compare_metamethod(lua_State* L, const char* method, int idx1, int idx2, int* ret)
+#define INFRA_COMPARE_MAX_DEPTH 200
+
+/**
+ * @brief Slots of resolved metamethods on stack.
+ */
+typedef enum infra_compare_meta_slot
+{
+    INFRA_COMPARE_META_EQ = 1,
+    INFRA_COMPARE_META_LT,
+    INFRA_COMPARE_META_LE,
+    INFRA_COMPARE_META_CMP,
+} infra_compare_meta_slot_t;
+
+static const char* s_compare_meta_names[] = { "__eq", "__lt", "__le", "__cmp" };
+
+/**
+ * @brief Push metamethods of metatable at \p mt.
+ *
+ * `__eq`, `__lt`, `__le` and `__cmp` are pushed in slot order, nil for
+ * missing ones. They are looked up on every comparison, so changes to a
+ * metatable are always seen.
+ *
+ * @return Stack index of first slot.
+ */
+static int _compare_meta_resolve(lua_State* L, int mt)
+{
+    int i;
+    int meta = lua_gettop(L) + 1;
+
+    luaL_checkstack(L, (int)ARRAY_SIZE(s_compare_meta_names), NULL);
+    for (i = 0; i < (int)ARRAY_SIZE(s_compare_meta_names); i++)
+    {
+        lua_pushstring(L, s_compare_meta_names[i]);
+        lua_rawget(L, mt);
+    }
+
+    return meta;
+}
+
+/**
+ * @brief Push metamethod in \p slot of resolved metamethods at \p meta.
+ * @return 1 if pushed, 0 if not exist.
+ */
+static int _compare_meta_push(lua_State* L, int meta, int slot)
+{
+    if (meta == 0)
+    {
+        return 0;
+    }
+
+    lua_pushvalue(L, meta + slot - INFRA_COMPARE_META_EQ);
+    if (lua_type(L, -1) == LUA_TNIL)
+    {
+        lua_pop(L, 1);
+        return 0;
+    }
+    return 1;
+}
+
+static int _compare_metamethod(lua_State* L, int meta, int slot, int idx1, int idx2, int* ret)
 {
     int sp = lua_gettop(L);
 
-    if (luaL_getmetafield(L, idx1, method) == 0)
+    if (!_compare_meta_push(L, meta, slot))
     {
         return 0;
     }
@@ -20,14 +81,50 @@ static int _compare_metamethod(lua_State* L, const char* method, int idx1, int i
 }
 
 /**
- * @brief Compare with metamethod.
+ * @brief Compare with three-way metamethod `__cmp` of \p idx1.
  */
-static int _internal_compare_with_meta(lua_State* L, int idx1, int idx2, int* ret)
+static int _compare_metamethod_cmp(lua_State* L, int meta, int idx1, int idx2, int* ret)
+{
+    int sp = lua_gettop(L);
+
+    if (!_compare_meta_push(L, meta, INFRA_COMPARE_META_CMP))
+    {
+        return 0;
+    }
+
+    lua_pushvalue(L, idx1);
+    lua_pushvalue(L, idx2);
+    lua_call(L, 2, 1);
+
+    lua_Number n = lua_tonumber(L, -1);
+    *ret = n < 0 ? -1 : (n > 0 ? 1 : 0);
+
+    lua_settop(L, sp);
+    return 1;
+}
+
+/**
+ * @brief Compare with metamethods.
+ * @param[in] meta1 Stack index of resolved metamethods of \p idx1.
+ * @param[in] meta2 Stack index of resolved metamethods of \p idx2.
+ */
+static int _internal_compare_with_meta_resolved(lua_State* L, int meta1, int meta2, int idx1, int idx2, int* ret)
 {
     int tmp;
 
+    /* A three-way metamethod answers in one call. */
+    if (_compare_metamethod_cmp(L, meta1, idx1, idx2, ret))
+    {
+        return 1;
+    }
+    if (_compare_metamethod_cmp(L, meta2, idx2, idx1, &tmp))
+    {
+        *ret = -tmp;
+        return 1;
+    }
+
     int ret_1_ne_2 = 0;
-    if (_compare_metamethod(L, "__eq", idx1, idx2, &tmp))
+    if (_compare_metamethod(L, meta1, INFRA_COMPARE_META_EQ, idx1, idx2, &tmp))
     {
         if (tmp)
         {
@@ -36,7 +133,7 @@ static int _internal_compare_with_meta(lua_State* L, int idx1, int idx2, int* re
         }
         ret_1_ne_2 = 1;
     }
-    if (_compare_metamethod(L, "__eq", idx2, idx1, &tmp))
+    if (_compare_metamethod(L, meta2, INFRA_COMPARE_META_EQ, idx2, idx1, &tmp))
     {
         if (tmp)
         {
@@ -47,7 +144,7 @@ static int _internal_compare_with_meta(lua_State* L, int idx1, int idx2, int* re
     }
 
     int ret_1_ge_2 = 0;
-    if (_compare_metamethod(L, "__lt", idx1, idx2, &tmp))
+    if (_compare_metamethod(L, meta1, INFRA_COMPARE_META_LT, idx1, idx2, &tmp))
     {
         if (tmp)
         {
@@ -67,7 +164,7 @@ static int _internal_compare_with_meta(lua_State* L, int idx1, int idx2, int* re
     }
 
     int ret_1_le_2 = 0;
-    if (_compare_metamethod(L, "__le", idx1, idx2, &tmp))
+    if (_compare_metamethod(L, meta1, INFRA_COMPARE_META_LE, idx1, idx2, &tmp))
     {
         if (!tmp)
         {
@@ -93,7 +190,7 @@ static int _internal_compare_with_meta(lua_State* L, int idx1, int idx2, int* re
         }
     }
 
-    if (_compare_metamethod(L, "__lt", idx2, idx1, &tmp))
+    if (_compare_metamethod(L, meta2, INFRA_COMPARE_META_LT, idx2, idx1, &tmp))
     {
         if (tmp)
         {/* idx1 > idx2 */
@@ -110,7 +207,7 @@ static int _internal_compare_with_meta(lua_State* L, int idx1, int idx2, int* re
         }
     }
 
-    if (_compare_metamethod(L, "__le", idx2, idx1, &tmp))
+    if (_compare_metamethod(L, meta2, INFRA_COMPARE_META_LE, idx2, idx1, &tmp))
     {
         if (!tmp)
         {
@@ -138,10 +235,131 @@ static int _internal_compare_with_meta(lua_State* L, int idx1, int idx2, int* re
     return 0;
 }
 
+/**
+ * @brief Compare with metamethod.
+ */
+static int _internal_compare_with_meta(lua_State* L, int idx1, int idx2, int* ret)
+{
+    int sp = lua_gettop(L);
+    idx1 = lua_absindex(L, idx1);
+    idx2 = lua_absindex(L, idx2);
+
+    int meta1 = 0, meta2 = 0;
+    int mt1 = lua_getmetatable(L, idx1) ? lua_gettop(L) : 0;
+    int mt2 = lua_getmetatable(L, idx2) ? lua_gettop(L) : 0;
+
+    /* Values of the same type often share one metatable, e.g. light userdata. */
+    if (mt1 != 0)
+    {
+        meta1 = _compare_meta_resolve(L, mt1);
+    }
+    if (mt2 != 0)
+    {
+        meta2 = (mt1 != 0 && lua_rawequal(L, mt1, mt2)) ? meta1 : _compare_meta_resolve(L, mt2);
+    }
+
+    int ok = _internal_compare_with_meta_resolved(L, meta1, meta2, idx1, idx2, ret);
+
+    lua_settop(L, sp);
+    return ok;
+}
+
+static int _compare_number(lua_Number n1, lua_Number n2)
+{
+    if (n1 < n2)
+    {
+        return -1;
+    }
+    else if (n1 > n2)
+    {
+        return 1;
+    }
+    
+    return 0;
+}
+
+#if LUA_VERSION_NUM >= 503
+
+/**
+ * @brief Compare integer \p i with float \p f exactly.
+ */
+static int _compare_integer_float(lua_Integer i, lua_Number f)
+{
+    /* 2^63, exact in floating point. */
+    const lua_Number limit = -(lua_Number)LUA_MININTEGER;
+
+    if (f != f)
+    {
+        return 0;
+    }
+    if (f >= limit)
+    {
+        return -1;
+    }
+    if (f < -limit)
+    {
+        return 1;
+    }
+
+    /* Now floor(f) fits in integer. */
+    lua_Number fl = floor(f);
+    lua_Integer fi = (lua_Integer)fl;
+    if (i != fi)
+    {
+        return i < fi ? -1 : 1;
+    }
+    return fl == f ? 0 : -1;
+}
+
+#endif
+
+int infra_key_compare_number(const infra_key_t* k1, const infra_key_t* k2)
+{
+#if LUA_VERSION_NUM >= 503
+    if (k1->integer && k2->integer)
+    {
+        return k1->v.i < k2->v.i ? -1 : (k1->v.i > k2->v.i ? 1 : 0);
+    }
+    if (k1->integer)
+    {
+        return _compare_integer_float(k1->v.i, k2->v.n);
+    }
+    if (k2->integer)
+    {
+        return -_compare_integer_float(k2->v.i, k1->v.n);
+    }
+#endif
+    return _compare_number(k1->v.n, k2->v.n);
+}
+
 static int _internal_compare_as_number(lua_State* L, int idx1, int idx2)
 {
+#if LUA_VERSION_NUM >= 503
+    int int1 = lua_isinteger(L, idx1);
+    int int2 = lua_isinteger(L, idx2);
+    if (int1 && int2)
+    {
+        lua_Integer i1 = lua_tointeger(L, idx1);
+        lua_Integer i2 = lua_tointeger(L, idx2);
+        return i1 < i2 ? -1 : (i1 > i2 ? 1 : 0);
+    }
+    if (int1)
+    {
+        return _compare_integer_float(lua_tointeger(L, idx1), lua_tonumber(L, idx2));
+    }
+    if (int2)
+    {
+        return -_compare_integer_float(lua_tointeger(L, idx2), lua_tonumber(L, idx1));
+    }
+#endif
+
     lua_Number n1 = lua_tonumber(L, idx1);
     lua_Number n2 = lua_tonumber(L, idx2);
+    return _compare_number(n1, n2);
+}
+
+static int _compare_boolean(int n1, int n2)
+{
     if (n1 < n2)
     {
         return -1;
@@ -158,36 +376,40 @@ static int _internal_compare_as_boolean(lua_State* L, int idx1, int idx2)
 {
     int n1 = lua_toboolean(L, idx1);
     int n2 = lua_toboolean(L, idx2);
-    if (n1 < n2)
+    return _compare_boolean(n1, n2);
+}
+
+int infra_compare_string(const char* dat1, size_t dat1_sz,
+    const char* dat2, size_t dat2_sz)
+{
+    size_t len = dat1_sz < dat2_sz ? dat1_sz : dat2_sz;
+    int ret = memcmp(dat1, dat2, len);
+    if (ret != 0)
+    {
+        return ret < 0 ? -1 : 1;
+    }
+    if (dat1_sz < dat2_sz)
     {
         return -1;
     }
-    else if (n1 > n2)
+    if (dat1_sz > dat2_sz)
     {
         return 1;
     }
-    
     return 0;
 }
 
-static int _internal_compare_as_string(lua_State* L, int idx1, int idx2)
+int infra_compare_string_ci(const char* dat1, size_t dat1_sz,
+    const char* dat2, size_t dat2_sz)
 {
-    size_t dat1_sz = 0;
-    const char* dat1 = lua_tolstring(L, idx1, &dat1_sz);
-
-    size_t dat2_sz = 0;
-    const char* dat2 = lua_tolstring(L, idx2, &dat2_sz);
-
     size_t pos = 0;
     for (; pos < dat1_sz && pos < dat2_sz; pos++)
     {
-        if (dat1[pos] < dat2[pos])
-        {
-            return -1;
-        }
-        else if (dat1[pos] > dat2[pos])
+        int c1 = tolower((unsigned char)dat1[pos]);
+        int c2 = tolower((unsigned char)dat2[pos]);
+        if (c1 != c2)
         {
-            return 1;
+            return c1 < c2 ? -1 : 1;
         }
     }
     if (dat1_sz < dat2_sz)
@@ -201,21 +423,37 @@ static int _internal_compare_as_string(lua_State* L, int idx1, int idx2)
     return 0;
 }
 
-static int _internal_compare_as_pointer(lua_State* L, int idx1, int idx2)
+static int _internal_compare_as_string(lua_State* L, int idx1, int idx2)
 {
-    const unsigned char* p1 = lua_topointer(L, idx1);
-    const unsigned char* p2 = lua_topointer(L, idx2);
-    if (p1 < p2)
+    size_t dat1_sz = 0;
+    const char* dat1 = lua_tolstring(L, idx1, &dat1_sz);
+
+    size_t dat2_sz = 0;
+    const char* dat2 = lua_tolstring(L, idx2, &dat2_sz);
+
+    return infra_compare_string(dat1, dat1_sz, dat2, dat2_sz);
+}
+
+static int _compare_pointer(const void* p1, const void* p2)
+{
+    if ((uintptr_t)p1 < (uintptr_t)p2)
     {
         return -1;
     }
-    else if (p1 > p2)
+    else if ((uintptr_t)p1 > (uintptr_t)p2)
     {
         return 1;
     }
     return 0;
 }
 
+static int _internal_compare_as_pointer(lua_State* L, int idx1, int idx2)
+{
+    const void* p1 = lua_topointer(L, idx1);
+    const void* p2 = lua_topointer(L, idx2);
+    return _compare_pointer(p1, p2);
+}
+
 static int _internal_compare_same_type(lua_State* L, int idx1, int idx2, int v_type, int* ret)
 {
     switch (v_type)
@@ -291,9 +529,426 @@ static int _internal_compare(lua_State* L, int idx1, int idx2)
     return luaL_error(L, "Cannot do compare.");
 }
 
+void infra_key_init(lua_State* L, int idx, infra_key_t* key)
+{
+    key->type = lua_type(L, idx);
+    key->native = 1;
+    key->integer = 0;
+
+    switch (key->type)
+    {
+    case LUA_TNIL:
+        break;
+
+    case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, idx))
+        {
+            key->integer = 1;
+            key->v.i = lua_tointeger(L, idx);
+            break;
+        }
+#endif
+        key->v.n = lua_tonumber(L, idx);
+        break;
+
+    case LUA_TBOOLEAN:
+        key->v.b = lua_toboolean(L, idx);
+        break;
+
+    case LUA_TSTRING:
+        key->v.s.str = lua_tolstring(L, idx, &key->v.s.len);
+        break;
+
+    case LUA_TUSERDATA:
+    case LUA_TTABLE:
+    case LUA_TTHREAD:
+    case LUA_TFUNCTION:
+        key->v.p = lua_topointer(L, idx);
+        break;
+
+    default:
+        /* Keep the address so the key still have an identity. */
+        key->v.p = lua_topointer(L, idx);
+        key->native = 0;
+        break;
+    }
+}
+
+int infra_key_compare(const infra_key_t* k1, const infra_key_t* k2, int* ret)
+{
+    /* Different types are ordered by type, no need to look at the value. */
+    if (k1->type != k2->type)
+    {
+        *ret = k1->type < k2->type ? -1 : 1;
+        return 1;
+    }
+
+    if (!k1->native || !k2->native)
+    {
+        return 0;
+    }
+
+    switch (k1->type)
+    {
+    case LUA_TNIL:
+        *ret = 0;
+        return 1;
+
+    case LUA_TNUMBER:
+        *ret = infra_key_compare_number(k1, k2);
+        return 1;
+
+    case LUA_TBOOLEAN:
+        *ret = _compare_boolean(k1->v.b, k2->v.b);
+        return 1;
+
+    case LUA_TSTRING:
+        if (k1->v.s.str == k2->v.s.str)
+        {/* Short strings are interned, so same address means same string. */
+            *ret = 0;
+            return 1;
+        }
+        *ret = infra_compare_string(k1->v.s.str, k1->v.s.len, k2->v.s.str, k2->v.s.len);
+        return 1;
+
+    default:
+        *ret = _compare_pointer(k1->v.p, k2->v.p);
+        return 1;
+    }
+}
+
+static uint64_t _hash_mix(uint64_t x)
+{
+    /* Finalizer of splitmix64. */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t _hash_string(const char* str, size_t len)
+{
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325ULL ^ len;
+    size_t i;
+    for (i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)str[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+size_t infra_key_hash(const infra_key_t* key)
+{
+    uint64_t h;
+    lua_Number n;
+
+    switch (key->type)
+    {
+    case LUA_TNIL:
+        h = 0;
+        break;
+
+    case LUA_TBOOLEAN:
+        h = key->v.b;
+        break;
+
+    case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+        if (key->integer)
+        {
+            /* An integer equals to the float of the same value, so they must hash the same. */
+            n = (lua_Number)key->v.i;
+            if (n >= -(lua_Number)LUA_MININTEGER || (lua_Integer)n != key->v.i)
+            {
+                h = (uint64_t)key->v.i;
+                break;
+            }
+        }
+        else
+#endif
+        n = key->v.n;
+        if (n == 0)
+        {/* -0.0 and 0.0 are equal. */
+            n = 0;
+        }
+        if (n != n)
+        {/* All NaN are equal. */
+            h = 0x7ff8000000000000ULL;
+            break;
+        }
+        h = 0;
+        memcpy(&h, &n, sizeof(n) < sizeof(h) ? sizeof(n) : sizeof(h));
+        break;
+
+    case LUA_TSTRING:
+        h = _hash_string(key->v.s.str, key->v.s.len);
+        break;
+
+    default:
+        h = (uintptr_t)key->v.p;
+        break;
+    }
+
+    return (size_t)_hash_mix(h ^ ((uint64_t)key->type << 56));
+}
+
+/**
+ * @brief A key of table in deep compare.
+ */
+typedef struct infra_compare_deep_key
+{
+    infra_key_t     key;    /**< Native key. */
+    lua_Integer     pos;    /**< Position of the key in key array. */
+} infra_compare_deep_key_t;
+
+static size_t _compare_deep_count(lua_State* L, int idx)
+{
+    size_t cnt = 0;
+
+    lua_pushnil(L);
+    while (lua_next(L, idx) != 0)
+    {
+        lua_pop(L, 1);
+        cnt++;
+    }
+
+    return cnt;
+}
+
+static int _internal_compare_deep(lua_State* L, int idx1, int idx2, int seen, int depth);
+
+/**
+ * @brief Compare key \p k1 of table at \p tbl1 with key \p k2 of table at
+ *   \p tbl2, and then their values if the keys are equal.
+ *
+ * Keys that are tables are compared with #_internal_compare_deep() too, so
+ * the result never depends on addresses of tables.
+ *
+ * @param[in] arr1  Stack index of the key array that \p k1 refers to.
+ * @param[in] arr2  Stack index of the key array that \p k2 refers to.
+ */
+static int _compare_deep_entry(lua_State* L, int tbl1, int arr1, const infra_compare_deep_key_t* k1,
+    int tbl2, int arr2, const infra_compare_deep_key_t* k2, int seen, int depth)
+{
+    int ret, sp = lua_gettop(L);
+
+    if (k1->key.type == LUA_TTABLE && k2->key.type == LUA_TTABLE)
+    {
+        lua_rawgeti(L, arr1, k1->pos);
+        lua_rawgeti(L, arr2, k2->pos);
+        ret = _internal_compare_deep(L, sp + 1, sp + 2, seen, depth);
+        lua_settop(L, sp);
+    }
+    else if (!infra_key_compare(&k1->key, &k2->key, &ret))
+    {/* Keys without native representation are ordered by identity. */
+        ret = _compare_pointer(k1->key.v.p, k2->key.v.p);
+    }
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    lua_rawgeti(L, arr1, k1->pos);
+    lua_rawget(L, tbl1);
+    lua_rawgeti(L, arr2, k2->pos);
+    lua_rawget(L, tbl2);
+    ret = _internal_compare_deep(L, sp + 1, sp + 2, seen, depth);
+    lua_settop(L, sp);
+
+    return ret;
+}
+
+/**
+ * @brief Merge sort \p cnt keys of table at \p tbl with #_compare_deep_entry().
+ * @param[in] arr   Stack index of the key array that \p keys refer to.
+ */
+static void _compare_deep_sort(lua_State* L, int tbl, int arr, infra_compare_deep_key_t* keys,
+    size_t cnt, int seen, int depth)
+{
+    size_t width, lo;
+    if (cnt < 2)
+    {
+        return;
+    }
+
+    infra_compare_deep_key_t* tmp = lua_newuserdata(L, sizeof(infra_compare_deep_key_t) * cnt);
+    for (width = 1; width < cnt; width *= 2)
+    {
+        for (lo = 0; lo + width < cnt; lo += 2 * width)
+        {
+            size_t mid = lo + width;
+            size_t hi = cnt - lo > 2 * width ? lo + 2 * width : cnt;
+            size_t i = lo, j = mid, k = lo;
+
+            while (i < mid && j < hi)
+            {
+                if (_compare_deep_entry(L, tbl, arr, &keys[j], tbl, arr, &keys[i], seen, depth) < 0)
+                {
+                    tmp[k++] = keys[j++];
+                }
+                else
+                {
+                    tmp[k++] = keys[i++];
+                }
+            }
+            while (i < mid)
+            {
+                tmp[k++] = keys[i++];
+            }
+            while (j < hi)
+            {
+                tmp[k++] = keys[j++];
+            }
+            memcpy(keys + lo, tmp + lo, sizeof(infra_compare_deep_key_t) * (hi - lo));
+        }
+    }
+    lua_pop(L, 1);
+}
+
+/**
+ * @brief Push an array of keys of table at \p idx, and a userdata of \p cnt
+ *   sorted #infra_compare_deep_key_t that refer to the array.
+ *
+ * Keys are sorted by type, then by value, so two tables with the same
+ * content get their keys in the same order.
+ */
+static infra_compare_deep_key_t* _compare_deep_keys(lua_State* L, int idx, size_t cnt, int seen, int depth)
+{
+    size_t i = 0;
+    int arr = lua_gettop(L) + 1;
+
+    lua_createtable(L, cnt > INT32_MAX ? INT32_MAX : (int)cnt, 0);
+    infra_compare_deep_key_t* keys = lua_newuserdata(L, sizeof(infra_compare_deep_key_t) * (cnt != 0 ? cnt : 1));
+
+    lua_pushnil(L);
+    while (lua_next(L, idx) != 0)
+    {
+        lua_pop(L, 1);
+
+        keys[i].pos = (lua_Integer)i + 1;
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -4, keys[i].pos);
+
+        /* String keys stay alive in key array. */
+        infra_key_init(L, -1, &keys[i].key);
+        i++;
+    }
+
+    _compare_deep_sort(L, idx, arr, keys, cnt, seen, depth);
+    return keys;
+}
+
+/**
+ * @brief Compare tables by content.
+ *
+ * Tables with less fields are less. Tables with the same number of fields
+ * compare their keys in sorted order, and then the values of the same key.
+ *
+ * @param[in] seen  Stack index of a table that records pairs of tables in
+ *   progress or already known to be equal, as `seen[t1][t2] = true`. A pair
+ *   found to be different is removed, as sorting keys goes on after that.
+ */
+static int _internal_compare_deep(lua_State* L, int idx1, int idx2, int seen, int depth)
+{
+    if (lua_type(L, idx1) != LUA_TTABLE || lua_type(L, idx2) != LUA_TTABLE || lua_rawequal(L, idx1, idx2))
+    {
+        return _internal_compare(L, idx1, idx2);
+    }
+
+    if (depth >= INFRA_COMPARE_MAX_DEPTH)
+    {
+        return luaL_error(L, "table is nested too deep.");
+    }
+    luaL_checkstack(L, 8, NULL);
+
+    int ret = 0;
+    int sp = lua_gettop(L);
+    idx1 = lua_absindex(L, idx1);
+    idx2 = lua_absindex(L, idx2);
+
+    /* A pair that seen before is either equal or in progress. */
+    lua_pushvalue(L, idx1);
+    lua_rawget(L, seen);
+    if (lua_type(L, -1) != LUA_TTABLE)
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, idx1);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, seen);
+    }
+    lua_pushvalue(L, idx2);
+    lua_rawget(L, -2);
+    if (lua_type(L, -1) != LUA_TNIL)
+    {
+        goto finish;
+    }
+    lua_pushvalue(L, idx2);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -4);
+    lua_settop(L, sp);
+
+    size_t i, cnt = _compare_deep_count(L, idx1);
+    size_t cnt2 = _compare_deep_count(L, idx2);
+    if (cnt != cnt2)
+    {
+        ret = cnt < cnt2 ? -1 : 1;
+        goto finish;
+    }
+
+    infra_compare_deep_key_t* keys1 = _compare_deep_keys(L, idx1, cnt, seen, depth + 1); /* sp+1, sp+2 */
+    infra_compare_deep_key_t* keys2 = _compare_deep_keys(L, idx2, cnt, seen, depth + 1); /* sp+3, sp+4 */
+
+    for (i = 0; i < cnt; i++)
+    {
+        ret = _compare_deep_entry(L, idx1, sp + 1, &keys1[i], idx2, sp + 3, &keys2[i], seen, depth + 1);
+        if (ret != 0)
+        {
+            break;
+        }
+    }
+
+finish:
+    lua_settop(L, sp);
+    if (ret != 0)
+    {
+        lua_pushvalue(L, idx1);
+        lua_rawget(L, seen);
+        lua_pushvalue(L, idx2);
+        lua_pushnil(L);
+        lua_rawset(L, -3);
+        lua_settop(L, sp);
+    }
+    return ret;
+}
+
 static int _compare(lua_State* L)
 {
-    int ret = _internal_compare(L, 1, 2);
+    int ret, deep = 0;
+
+    if (lua_type(L, 3) == LUA_TTABLE)
+    {
+        lua_getfield(L, 3, "deep");
+        deep = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+
+    if (deep)
+    {
+        lua_settop(L, 2);
+        lua_newtable(L);
+        ret = _internal_compare_deep(L, 1, 2, 3, 0);
+    }
+    else
+    {
+        ret = _internal_compare(L, 1, 2);
+    }
+
     lua_pushinteger(L, ret);
     return 1;
 }
@@ -303,7 +958,7 @@ const infra_lua_api_t infra_f_compare = {
 "Compare two values.",
 
 "[SYNOPSIS]\n"
-"number compare(object v1, object v2)\n"
+"number compare(object v1, object v2[, table opt])\n"
 "\n"
 "[DESCRIPTION]\n"
 "Compare two Lua value, and returns an integer indicating the result of the\n"
@@ -311,4 +966,22 @@ const infra_lua_api_t infra_f_compare = {
 "    0: v1 and v2 are equal;\n"
 "    1: v1 is greater than v2;\n"
 "    -1: v1 is less than v2.\n"
+"\n"
+"Numbers are compared by their exact values, so distinct 64-bit integers never\n"
+"compare equal even if they round to the same float.\n"
+"\n"
+"By default tables are compared by address. If `opt.deep` is true, tables are\n"
+"compared by content instead: a table with less fields is less, otherwise keys\n"
+"are compared in sorted order, and then values of the same key are compared\n"
+"recursively. Keys are sorted by type and then by value. Keys that are tables\n"
+"are sorted by content, ties broken by their values, so the result never\n"
+"depends on table addresses. Other keys such as functions and userdata are\n"
+"sorted by identity. Metatables are ignored, and tables that reference each\n"
+"other in a cycle are handled, so `compare(t1, t2, { deep = true }) == 0`\n"
+"tells whether two tables have the same structure.\n"
+"\n"
+"Values of the same type that have no native order (e.g. light userdata) are\n"
+"compared with metamethods. If `__cmp` exists, it is called once as\n"
+"`__cmp(v1, v2)` and must return a number like `compare()`. Otherwise\n"
+"`__eq`, `__lt` and `__le` are used.\n"
 };
@@ -0,0 +1,439 @@
+#include "__init__.h"
+
+#define INFRA_DEQUE_NAME            "__infra_deque"
+#define INFRA_DEQUE_MIN_CAPACITY    16
+
+typedef struct infra_deque
+{
+    size_t  head;       /**< Slot of the first element. */
+    size_t  size;       /**< The number of elements. */
+    size_t  cap;        /**< The number of slots, always 2^n. */
+
+    /**
+     * @brief Reference to data table.
+     * Element in slot `i` is stored at `i+1`, so the table always stays an
+     * array of #infra_deque::cap elements.
+     */
+    int     ref_data;
+} infra_deque_t;
+
+/**
+ * @brief Get data table index of the \p pos-th element (start from 0).
+ */
+static lua_Integer _infra_deque_slot(const infra_deque_t* self, size_t pos)
+{
+    return (lua_Integer)((self->head + pos) & (self->cap - 1)) + 1;
+}
+
+/**
+ * @brief Convert index at \p idx (start from 1, negative counts from the end)
+ *   into position.
+ * @return  1 if \p pos is in range, 0 if not.
+ */
+static int _infra_deque_pos(lua_State* L, const infra_deque_t* self, int idx, size_t* pos)
+{
+    lua_Integer n = luaL_checkinteger(L, idx);
+    if (n < 0)
+    {
+        n += (lua_Integer)self->size + 1;
+    }
+
+    if (n < 1 || n > (lua_Integer)self->size)
+    {
+        return 0;
+    }
+
+    *pos = (size_t)(n - 1);
+    return 1;
+}
+
+/**
+ * @brief Ensure there is room for one more element.
+ *
+ * The data table is on top of stack.
+ */
+static void _infra_deque_reserve(lua_State* L, infra_deque_t* self)
+{
+    if (self->size < self->cap)
+    {
+        return;
+    }
+
+    /* Move wrapped elements right after the old slots, so they are contiguous again. */
+    size_t i;
+    size_t wrapped = self->head + self->size - self->cap;
+    for (i = 0; i < wrapped; i++)
+    {
+        lua_rawgeti(L, -1, (lua_Integer)i + 1);
+        lua_rawseti(L, -2, (lua_Integer)(self->cap + i) + 1);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+
+    self->cap *= 2;
+}
+
+static infra_deque_t* _infra_deque_check(lua_State* L, int idx)
+{
+    return luaL_checkudata(L, idx, INFRA_DEQUE_NAME);
+}
+
+static int _infra_deque_gc(lua_State* L)
+{
+    infra_deque_t* self = lua_touserdata(L, 1);
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_data);
+    self->ref_data = LUA_NOREF;
+
+    return 0;
+}
+
+static int _infra_deque_size(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    lua_pushinteger(L, (lua_Integer)self->size);
+    return 1;
+}
+
+static int _infra_deque_push_back(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    lua_settop(L, 2);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    _infra_deque_reserve(L, self);
+
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, _infra_deque_slot(self, self->size));
+    self->size++;
+
+    return 0;
+}
+
+static int _infra_deque_push_front(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    lua_settop(L, 2);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    _infra_deque_reserve(L, self);
+
+    self->head = (self->head + self->cap - 1) & (self->cap - 1);
+    self->size++;
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, _infra_deque_slot(self, 0));
+
+    return 0;
+}
+
+/**
+ * @brief Remove element at \p pos and push it. \p pos must be the first or
+ *   the last element.
+ */
+static int _infra_deque_pop(lua_State* L, infra_deque_t* self, size_t pos)
+{
+    if (self->size == 0)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_Integer slot = _infra_deque_slot(self, pos);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, slot);
+    lua_pushnil(L);
+    lua_rawseti(L, -3, slot);
+
+    if (pos == 0)
+    {
+        self->head = (self->head + 1) & (self->cap - 1);
+    }
+    self->size--;
+
+    return 1;
+}
+
+static int _infra_deque_pop_front(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    return _infra_deque_pop(L, self, 0);
+}
+
+static int _infra_deque_pop_back(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    return _infra_deque_pop(L, self, self->size - 1);
+}
+
+/**
+ * @brief Push element at \p pos, or nil if deque is empty.
+ */
+static int _infra_deque_push_at(lua_State* L, infra_deque_t* self, size_t pos)
+{
+    if (self->size == 0)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, _infra_deque_slot(self, pos));
+    return 1;
+}
+
+static int _infra_deque_front(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    return _infra_deque_push_at(L, self, 0);
+}
+
+static int _infra_deque_back(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    return _infra_deque_push_at(L, self, self->size - 1);
+}
+
+static int _infra_deque_get(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+
+    size_t pos;
+    if (!_infra_deque_pos(L, self, 2, &pos))
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    return _infra_deque_push_at(L, self, pos);
+}
+
+static int _infra_deque_set(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    lua_settop(L, 3);
+
+    size_t pos;
+    if (!_infra_deque_pos(L, self, 2, &pos))
+    {
+        return luaL_error(L, "index out of range.");
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, _infra_deque_slot(self, pos));
+
+    return 0;
+}
+
+static int _infra_deque_clear(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+
+    lua_createtable(L, INFRA_DEQUE_MIN_CAPACITY, 0);
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_data);
+    self->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
+    self->head = 0;
+    self->size = 0;
+    self->cap = INFRA_DEQUE_MIN_CAPACITY;
+
+    return 0;
+}
+
+/**
+ * @brief `__index` metamethod. Integers are indices of elements, anything
+ *   else is looked up in method table at upvalue 1.
+ */
+static int _infra_deque_index(lua_State* L)
+{
+    if (lua_type(L, 2) == LUA_TNUMBER)
+    {
+        return _infra_deque_get(L);
+    }
+
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    return 1;
+}
+
+/**
+ * @brief Iterator function. Element indices start from 1.
+ */
+static int _infra_deque_next(lua_State* L)
+{
+    infra_deque_t* self = _infra_deque_check(L, 1);
+    lua_Integer n = lua_type(L, 2) == LUA_TNIL ? 1 : luaL_checkinteger(L, 2) + 1;
+
+    if (n < 1 || n > (lua_Integer)self->size)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushinteger(L, n);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, _infra_deque_slot(self, (size_t)n - 1));
+    lua_remove(L, -2);
+    return 2;
+}
+
+static int _infra_deque_pairs(lua_State* L)
+{
+    _infra_deque_check(L, 1);
+
+    lua_pushcfunction(L, _infra_deque_next);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+/**
+ * @brief Push all values of table \p src, or all values of object \p src with
+ *   `__pairs` metamethod.
+ */
+static int _infra_deque_copy(lua_State* L, int src)
+{
+    int sp = lua_gettop(L);
+    lua_Integer i;
+
+    if (lua_type(L, src) == LUA_TTABLE)
+    {
+        lua_Integer len = luaL_len(L, src);
+        for (i = 1; i <= len; i++)
+        {
+            lua_pushcfunction(L, _infra_deque_push_back);
+            lua_pushvalue(L, sp);
+            lua_rawgeti(L, src, i);
+            lua_call(L, 2, 0);
+        }
+        return 0;
+    }
+
+    if (luaL_getmetafield(L, src, "__pairs") == 0)
+    {
+        return 0;
+    }
+    lua_pushvalue(L, src);
+    lua_call(L, 1, 3); /* f:sp+1, s:sp+2, k:sp+3 */
+
+    while (1)
+    {
+        lua_pushvalue(L, sp + 1);
+        lua_pushvalue(L, sp + 2);
+        lua_pushvalue(L, sp + 3);
+        lua_call(L, 2, 2); /* k:sp+4, v:sp+5 */
+
+        if (lua_type(L, sp + 4) == LUA_TNIL)
+        {
+            break;
+        }
+
+        lua_pushcfunction(L, _infra_deque_push_back);
+        lua_pushvalue(L, sp);
+        lua_pushvalue(L, sp + 5);
+        lua_call(L, 2, 0);
+
+        lua_pop(L, 1);
+        lua_replace(L, sp + 3);
+    }
+
+    lua_settop(L, sp);
+    return 0;
+}
+
+static int _infra_new_deque(lua_State* L)
+{
+    lua_settop(L, 1);
+
+    infra_deque_t* self = lua_newuserdata(L, sizeof(infra_deque_t));
+    memset(self, 0, sizeof(*self));
+    self->ref_data = LUA_NOREF;
+    self->cap = INFRA_DEQUE_MIN_CAPACITY;
+
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _infra_deque_gc },
+        { "__len",      _infra_deque_size },
+        { "__newindex", _infra_deque_set },
+        { "__pairs",    _infra_deque_pairs },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_method[] = {
+        { "size",       _infra_deque_size },
+        { "push_back",  _infra_deque_push_back },
+        { "push_front", _infra_deque_push_front },
+        { "pop_back",   _infra_deque_pop_back },
+        { "pop_front",  _infra_deque_pop_front },
+        { "front",      _infra_deque_front },
+        { "back",       _infra_deque_back },
+        { "get",        _infra_deque_get },
+        { "set",        _infra_deque_set },
+        { "clear",      _infra_deque_clear },
+        { "pairs",      _infra_deque_pairs },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, INFRA_DEQUE_NAME) != 0)
+    {
+        luaL_setfuncs(L, s_meta, 0);
+
+        /* metatable.__index = function with s_method as upvalue */
+        luaL_newlib(L, s_method);
+        lua_pushcclosure(L, _infra_deque_index, 1);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+
+    lua_createtable(L, INFRA_DEQUE_MIN_CAPACITY, 0);
+    self->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (lua_type(L, 1) != LUA_TNIL)
+    {
+        _infra_deque_copy(L, 1);
+    }
+
+    return 1;
+}
+
+const infra_lua_api_t infra_f_deque = {
+"make_deque", _infra_new_deque, 0,
+"Create a new empty deque.",
+
+"[SYNOPSIS]\n"
+"deque make_deque([src])\n"
+"\n"
+"[DESCRIPTION]\n"
+"Create a new empty deque. A deque is a growable ring buffer that push and pop\n"
+"at both ends in O(1).\n"
+"\n"
+"If `src` is a table, its array part is copied into the new deque. If `src`\n"
+"is an object that have metamethod `__pairs`, all values are copied in\n"
+"iteration order.\n"
+"\n"
+"Elements are indexed from 1 at the front, and a negative index counts from\n"
+"the back. `deque[i]` reads element, or nil if out of range, and\n"
+"`deque[i] = v` replaces element. `#deque` returns the number of elements,\n"
+"and `pairs(deque)` iterates over index and element from front to back, so a\n"
+"deque works with `merge_line()` and other functions that take arrays.\n"
+"\n"
+"A deque have following metamethod:\n"
+"  integer deque:size()\n"
+"    Return the number of elements.\n"
+"  deque:push_back(value)\n"
+"    Add element at the back.\n"
+"  deque:push_front(value)\n"
+"    Add element at the front.\n"
+"  any deque:pop_back()\n"
+"    Remove and return element at the back, or nil if deque is empty.\n"
+"  any deque:pop_front()\n"
+"    Remove and return element at the front, or nil if deque is empty.\n"
+"  any deque:front()\n"
+"    Return element at the front, or nil if deque is empty.\n"
+"  any deque:back()\n"
+"    Return element at the back, or nil if deque is empty.\n"
+"  any deque:get(index)\n"
+"    Return element at `index`, or nil if out of range.\n"
+"  deque:set(index, value)\n"
+"    Replace element at `index`. Raise error if out of range.\n"
+"  deque:clear()\n"
+"    Remove all elements.\n"
+"  deque:pairs()\n"
+"    Use in `for i,v in deque:pairs() do ... end`.\n"
+};
@@ -0,0 +1,527 @@
+#include "__init__.h"
+
+#define INFRA_HASHMAP_NAME          "__infra_hashmap"
+#define INFRA_HASHMAP_MIN_CAPACITY  8
+
+typedef struct infra_hashmap_slot
+{
+    infra_key_t     key;    /**< Native copy of key. */
+    size_t          hash;   /**< Hash code of key. */
+    int             id;     /**< Entry id, 0 if empty, -1 if deleted. */
+} infra_hashmap_slot_t;
+
+typedef struct infra_hashmap
+{
+    infra_hashmap_slot_t*   slots;      /**< Open addressing table. */
+    size_t                  capacity;   /**< Table size, always 2^n. */
+    size_t                  size;       /**< The number of live entries. */
+    size_t                  used;       /**< The number of non-empty slots. */
+
+    int*                    free_ids;   /**< Recycled entry ids. */
+    size_t                  free_sz;    /**< The number of recycled ids. */
+    size_t                  free_cap;   /**< Capacity of #infra_hashmap::free_ids. */
+    int                     next_id;    /**< The largest allocated id. */
+
+    /**
+     * @brief Reference to data table.
+     * Key of entry `id` is stored at `2*id-1`, and value at `2*id`.
+     */
+    int                     ref_data;
+} infra_hashmap_t;
+
+static void _infra_hashmap_key_init(lua_State* L, int idx, infra_key_t* key, size_t* hash)
+{
+    infra_key_init(L, idx, key);
+    *hash = infra_key_hash(key);
+}
+
+static int _infra_hashmap_key_equal(const infra_key_t* k1, const infra_key_t* k2)
+{
+    int ret;
+    if (infra_key_compare(k1, k2, &ret))
+    {
+        return ret == 0;
+    }
+
+    /* Values without native representation are compared by identity. */
+    return k1->v.p == k2->v.p;
+}
+
+/**
+ * @brief Find slot for \p key.
+ * @param[in] self  Hashmap.
+ * @param[in] key   Key.
+ * @param[in] hash  Hash code of key.
+ * @param[out] pos  The slot position. If not found, it is the position that
+ *   the key should insert into.
+ * @return          1 if found, 0 if not.
+ */
+static int _infra_hashmap_lookup(const infra_hashmap_t* self,
+    const infra_key_t* key, size_t hash, size_t* pos)
+{
+    const size_t mask = self->capacity - 1;
+    size_t first_free = (size_t)-1;
+    size_t i = hash & mask;
+
+    for (;; i = (i + 1) & mask)
+    {
+        infra_hashmap_slot_t* slot = &self->slots[i];
+        if (slot->id == 0)
+        {
+            *pos = first_free != (size_t)-1 ? first_free : i;
+            return 0;
+        }
+
+        if (slot->id < 0)
+        {
+            if (first_free == (size_t)-1)
+            {
+                first_free = i;
+            }
+            continue;
+        }
+
+        if (slot->hash == hash && _infra_hashmap_key_equal(&slot->key, key))
+        {
+            *pos = i;
+            return 1;
+        }
+    }
+}
+
+static int _infra_hashmap_find_slot(const infra_hashmap_t* self,
+    const infra_key_t* key, size_t hash, size_t* pos)
+{
+    if (self->size == 0)
+    {
+        return 0;
+    }
+    return _infra_hashmap_lookup(self, key, hash, pos);
+}
+
+static int _infra_hashmap_rehash(infra_hashmap_t* self, size_t capacity)
+{
+    infra_hashmap_slot_t* slots = calloc(capacity, sizeof(infra_hashmap_slot_t));
+    if (slots == NULL)
+    {
+        return -1;
+    }
+
+    const size_t mask = capacity - 1;
+    size_t i;
+    for (i = 0; i < self->capacity; i++)
+    {
+        infra_hashmap_slot_t* slot = &self->slots[i];
+        if (slot->id <= 0)
+        {
+            continue;
+        }
+
+        size_t pos = slot->hash & mask;
+        while (slots[pos].id != 0)
+        {
+            pos = (pos + 1) & mask;
+        }
+        slots[pos] = *slot;
+    }
+
+    free(self->slots);
+    self->slots = slots;
+    self->capacity = capacity;
+    self->used = self->size;
+
+    return 0;
+}
+
+/**
+ * @brief Ensure there is room for one more entry.
+ * @return  0 if success, -1 if out of memory.
+ */
+static int _infra_hashmap_reserve(infra_hashmap_t* self)
+{
+    /* Keep load factor (including deleted slots) below 3/4. */
+    if ((self->used + 1) * 4 <= self->capacity * 3)
+    {
+        return 0;
+    }
+
+    size_t capacity = INFRA_HASHMAP_MIN_CAPACITY;
+    while ((self->size + 1) * 2 > capacity)
+    {
+        capacity *= 2;
+    }
+
+    return _infra_hashmap_rehash(self, capacity);
+}
+
+static int _infra_hashmap_alloc_id(infra_hashmap_t* self)
+{
+    if (self->free_sz > 0)
+    {
+        return self->free_ids[--self->free_sz];
+    }
+    return ++self->next_id;
+}
+
+static void _infra_hashmap_free_id(infra_hashmap_t* self, int id)
+{
+    if (self->free_sz == self->free_cap)
+    {
+        size_t new_cap = self->free_cap == 0 ? 16 : self->free_cap * 2;
+        int* new_ids = realloc(self->free_ids, sizeof(int) * new_cap);
+        if (new_ids == NULL)
+        {/* Just leave a hole in data table. */
+            return;
+        }
+        self->free_ids = new_ids;
+        self->free_cap = new_cap;
+    }
+
+    self->free_ids[self->free_sz++] = id;
+}
+
+/**
+ * @brief Push key and value of entry \p id on top of stack.
+ */
+static void _infra_hashmap_push_entry(lua_State* L, infra_hashmap_t* self, int id)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, 2 * (lua_Integer)id - 1);
+    lua_rawgeti(L, -2, 2 * (lua_Integer)id);
+    lua_remove(L, -3);
+}
+
+static int _infra_hashmap_gc(lua_State* L)
+{
+    infra_hashmap_t* self = lua_touserdata(L, 1);
+
+    free(self->slots);
+    self->slots = NULL;
+    self->capacity = 0;
+    self->size = 0;
+    self->used = 0;
+
+    free(self->free_ids);
+    self->free_ids = NULL;
+    self->free_sz = 0;
+    self->free_cap = 0;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_data);
+    self->ref_data = LUA_NOREF;
+
+    return 0;
+}
+
+static int _infra_hashmap_size(lua_State* L)
+{
+    infra_hashmap_t* self = luaL_checkudata(L, 1, INFRA_HASHMAP_NAME);
+
+    lua_pushinteger(L, self->size);
+    return 1;
+}
+
+/**
+ * @brief Insert key at \p 2 and value at \p 3.
+ * @return  1 if inserted, 0 if key exists.
+ */
+static int _infra_hashmap_set(lua_State* L, infra_hashmap_t* self, int replace)
+{
+    size_t pos, hash;
+    infra_key_t key;
+    _infra_hashmap_key_init(L, 2, &key, &hash);
+
+    int id;
+    if (_infra_hashmap_find_slot(self, &key, hash, &pos))
+    {
+        if (!replace)
+        {
+            return 0;
+        }
+
+        id = self->slots[pos].id;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+        lua_pushvalue(L, 3);
+        lua_rawseti(L, -2, 2 * (lua_Integer)id);
+        lua_pop(L, 1);
+
+        return 0;
+    }
+
+    if (_infra_hashmap_reserve(self) != 0)
+    {
+        return luaL_error(L, INFRA_LUA_ERRMSG_OOM);
+    }
+    _infra_hashmap_lookup(self, &key, hash, &pos);
+
+    infra_hashmap_slot_t* slot = &self->slots[pos];
+    if (slot->id == 0)
+    {
+        self->used++;
+    }
+    self->size++;
+
+    id = _infra_hashmap_alloc_id(self);
+    slot->key = key;
+    slot->hash = hash;
+    slot->id = id;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, 2 * (lua_Integer)id - 1);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, 2 * (lua_Integer)id);
+    lua_pop(L, 1);
+
+    return 1;
+}
+
+static int _infra_hashmap_insert(lua_State* L)
+{
+    infra_hashmap_t* self = luaL_checkudata(L, 1, INFRA_HASHMAP_NAME);
+    lua_settop(L, 3);
+
+    int ret = _infra_hashmap_set(L, self, 0);
+    lua_pushboolean(L, ret);
+    return 1;
+}
+
+static int _infra_hashmap_replace(lua_State* L)
+{
+    infra_hashmap_t* self = luaL_checkudata(L, 1, INFRA_HASHMAP_NAME);
+    lua_settop(L, 3);
+
+    _infra_hashmap_set(L, self, 1);
+    return 0;
+}
+
+static int _infra_hashmap_erase(lua_State* L)
+{
+    infra_hashmap_t* self = luaL_checkudata(L, 1, INFRA_HASHMAP_NAME);
+
+    size_t pos, hash;
+    infra_key_t key;
+    _infra_hashmap_key_init(L, 2, &key, &hash);
+
+    if (!_infra_hashmap_find_slot(self, &key, hash, &pos))
+    {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    infra_hashmap_slot_t* slot = &self->slots[pos];
+    int id = slot->id;
+    slot->id = -1;
+    self->size--;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, 2 * (lua_Integer)id - 1);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, 2 * (lua_Integer)id);
+    lua_pop(L, 1);
+
+    _infra_hashmap_free_id(self, id);
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int _infra_hashmap_find(lua_State* L)
+{
+    infra_hashmap_t* self = luaL_checkudata(L, 1, INFRA_HASHMAP_NAME);
+
+    size_t pos, hash;
+    infra_key_t key;
+    _infra_hashmap_key_init(L, 2, &key, &hash);
+
+    if (!_infra_hashmap_find_slot(self, &key, hash, &pos))
+    {
+        lua_pushboolean(L, 0);
+        lua_pushnil(L);
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, 2 * (lua_Integer)self->slots[pos].id);
+    lua_remove(L, -2);
+
+    return 2;
+}
+
+/**
+ * @brief Iterator. The slot position to continue is saved as upvalue, so it
+ *   is safe to erase entries during iteration.
+ */
+static int _infra_hashmap_pairs_next(lua_State* L)
+{
+    infra_hashmap_t* self = luaL_checkudata(L, 1, INFRA_HASHMAP_NAME);
+    size_t pos = (size_t)lua_tointeger(L, lua_upvalueindex(1));
+
+    for (; pos < self->capacity; pos++)
+    {
+        if (self->slots[pos].id > 0)
+        {
+            break;
+        }
+    }
+
+    if (pos >= self->capacity)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushinteger(L, pos + 1);
+    lua_replace(L, lua_upvalueindex(1));
+
+    _infra_hashmap_push_entry(L, self, self->slots[pos].id);
+    return 2;
+}
+
+static int _infra_hashmap_meta_pairs(lua_State* L)
+{
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, _infra_hashmap_pairs_next, 1);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+static int _infra_hashmap_pairs(lua_State* L)
+{
+    luaL_checkudata(L, 1, INFRA_HASHMAP_NAME);
+    return _infra_hashmap_meta_pairs(L);
+}
+
+static int _infra_hashmap_copy(lua_State* L, int dst, int src)
+{
+    int sp = lua_gettop(L);
+    infra_hashmap_t* self = lua_touserdata(L, dst);
+
+    if (lua_type(L, src) == LUA_TTABLE)
+    {
+        lua_pushnil(L);
+        while (lua_next(L, src) != 0)
+        {
+            /* _infra_hashmap_set() requires key at 2 and value at 3. */
+            lua_settop(L, sp + 2);
+            lua_pushvalue(L, sp + 1);
+            lua_pushvalue(L, sp + 2);
+            lua_replace(L, 3);
+            lua_replace(L, 2);
+            _infra_hashmap_set(L, self, 0);
+            lua_settop(L, sp + 1);
+        }
+        return 0;
+    }
+
+    if (luaL_getmetafield(L, src, "__pairs") == 0)
+    {
+        return 0;
+    }
+    lua_pushvalue(L, src);
+    lua_call(L, 1, 3); /* f:sp+1, s:sp+2, k:sp+3 */
+
+    while (1)
+    {
+        lua_pushvalue(L, sp + 1);
+        lua_pushvalue(L, sp + 2);
+        lua_pushvalue(L, sp + 3);
+        lua_call(L, 2, 2); /* k:sp+4, v:sp+5 */
+
+        if (lua_type(L, sp + 4) == LUA_TNIL)
+        {
+            break;
+        }
+
+        lua_pushvalue(L, sp + 4);
+        lua_replace(L, 2);
+        lua_pushvalue(L, sp + 5);
+        lua_replace(L, 3);
+        _infra_hashmap_set(L, self, 0);
+
+        lua_pop(L, 1);
+        lua_replace(L, sp + 3);
+    }
+
+    lua_settop(L, sp);
+    return 0;
+}
+
+static int _infra_new_hashmap(lua_State* L)
+{
+    /* Reserve stack 2 and 3 for key and value. */
+    lua_settop(L, 3);
+
+    infra_hashmap_t* self = lua_newuserdata(L, sizeof(infra_hashmap_t));
+    memset(self, 0, sizeof(*self));
+    self->ref_data = LUA_NOREF;
+
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _infra_hashmap_gc },
+        { "__pairs",    _infra_hashmap_meta_pairs },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_method[] = {
+        { "size",       _infra_hashmap_size },
+        { "insert",     _infra_hashmap_insert },
+        { "replace",    _infra_hashmap_replace },
+        { "erase",      _infra_hashmap_erase },
+        { "find",       _infra_hashmap_find },
+        { "pairs",      _infra_hashmap_pairs },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, INFRA_HASHMAP_NAME) != 0)
+    {
+        luaL_setfuncs(L, s_meta, 0);
+
+        /* metatable.__index = s_method */
+        luaL_newlib(L, s_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+
+    lua_newtable(L);
+    self->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (lua_type(L, 1) != LUA_TNIL)
+    {
+        _infra_hashmap_copy(L, 4, 1);
+    }
+
+    return 1;
+}
+
+const infra_lua_api_t infra_f_hashmap = {
+"make_hashmap", _infra_new_hashmap, 0,
+"Create a new empty hashmap.",
+
+"[SYNOPSIS]\n"
+"hashmap make_hashmap([src])\n"
+"\n"
+"[DESCRIPTION]\n"
+"Create a new empty hashmap. A hashmap is an open addressing hash table that\n"
+"able to contains anything as it's key and value. Unlike `make_map()`, the\n"
+"iteration order is unspecified.\n"
+"\n"
+"If `src` is a table, or any object that have metamethod `__pairs`, all\n"
+"key-value pairs are copied into the new hashmap.\n"
+"\n"
+"A hashmap have following metamethod:\n"
+"  integer hashmap:size()\n"
+"    Return the number of elements.\n"
+"  boolean hashmap:insert(key, value)\n"
+"    Insert key and value into hashmap. If a key is exist, return false.\n"
+"  hashmap:replace(key, value)\n"
+"    Insert key and value into hashmap, replace any existing key and value.\n"
+"  boolean hashmap:erase(key)\n"
+"    Erase key-value pair from hashmap. If the key is not exist, return false.\n"
+"  boolean,any hashmap:find(key)\n"
+"    Find the matching value for the key. If found, the first return value is\n"
+"    true, the second is the associated value. If not found, return false and\n"
+"    nil.\n"
+"  hashmap:pairs()\n"
+"    Use in `for k,v in hashmap:pairs() do ... end`. It is safe to erase\n"
+"    elements during iteration.\n"
+};
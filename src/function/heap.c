@@ -0,0 +1,650 @@
+#include "__init__.h"
+
+#define INFRA_HEAP_NAME     "__infra_heap"
+
+/**
+ * @brief Bits of generation in handle.
+ *
+ * A handle is `gen * 2^32 + id`. The generation is limited so that handles
+ * are still exact if Lua numbers are doubles.
+ */
+#define INFRA_HEAP_GEN_MASK 0xfffff
+
+/**
+ * @brief How priorities are compared.
+ */
+typedef enum infra_heap_cmp_type
+{
+    INFRA_HEAP_CMP_DEFAULT,     /**< Same as `compare()`. */
+    INFRA_HEAP_CMP_LUA,         /**< User defined Lua function. */
+    INFRA_HEAP_CMP_NUMBER,      /**< Number priorities only. */
+} infra_heap_cmp_type_t;
+
+typedef struct infra_heap_entry
+{
+    infra_key_t     key;        /**< Native copy of priority. */
+    int             id;         /**< Entry id in data table. */
+} infra_heap_entry_t;
+
+typedef struct infra_heap_slot
+{
+    size_t          pos;        /**< Position in heap, or SIZE_MAX if id is free. */
+    unsigned        gen;        /**< Generation, increase every time id is freed. */
+} infra_heap_slot_t;
+
+typedef struct infra_heap
+{
+    infra_heap_entry_t* heap;       /**< Binary heap, the top is always at 0. */
+    size_t              size;       /**< The number of entries. */
+    size_t              cap;        /**< Capacity of #infra_heap::heap. */
+    size_t              version;    /**< Increase every time heap is modified. */
+
+    infra_heap_slot_t*  slots;      /**< Indexed by entry id. */
+    size_t              slot_cap;   /**< Capacity of #infra_heap::slots. */
+    int*                free_ids;   /**< Recycled entry ids. */
+    size_t              free_sz;    /**< The number of recycled ids. */
+    size_t              free_cap;   /**< Capacity of #infra_heap::free_ids. */
+    int                 next_id;    /**< The largest allocated id. */
+
+    /**
+     * @brief Reference to data table.
+     * Priority of entry `id` is stored at `2*id-1`, and value at `2*id`.
+     */
+    int                 ref_data;
+
+    int                 cmp_type;   /**< #infra_heap_cmp_type_t. */
+    int                 ref_cmp;    /**< Reference to Lua comparator. */
+    int                 reverse;    /**< Whether the largest priority is on top. */
+    lua_State*          L;
+} infra_heap_t;
+
+typedef struct infra_heap_cmp_opt
+{
+    const char*     name;       /**< Name of comparator. */
+    int             cmp_type;   /**< #infra_heap_cmp_type_t. */
+    int             reverse;    /**< Whether the largest priority is on top. */
+} infra_heap_cmp_opt_t;
+
+static const infra_heap_cmp_opt_t s_heap_cmp_opts[] = {
+    { "reverse",        INFRA_HEAP_CMP_DEFAULT, 1 },
+    { "number",         INFRA_HEAP_CMP_NUMBER,  0 },
+    { "number_reverse", INFRA_HEAP_CMP_NUMBER,  1 },
+};
+
+/**
+ * @brief Allocate an entry id.
+ * @return  The id, or 0 if out of memory.
+ */
+static int _infra_heap_alloc_id(infra_heap_t* self)
+{
+    if (self->free_sz > 0)
+    {
+        return self->free_ids[--self->free_sz];
+    }
+
+    if ((size_t)self->next_id + 1 >= self->slot_cap)
+    {
+        size_t new_cap = self->slot_cap == 0 ? 16 : self->slot_cap * 2;
+        infra_heap_slot_t* new_slots = realloc(self->slots, sizeof(infra_heap_slot_t) * new_cap);
+        if (new_slots == NULL)
+        {
+            return 0;
+        }
+        memset(new_slots + self->slot_cap, 0, sizeof(infra_heap_slot_t) * (new_cap - self->slot_cap));
+        self->slots = new_slots;
+        self->slot_cap = new_cap;
+    }
+
+    return ++self->next_id;
+}
+
+static void _infra_heap_free_id(infra_heap_t* self, int id)
+{
+    self->slots[id].pos = SIZE_MAX;
+    self->slots[id].gen = (self->slots[id].gen + 1) & INFRA_HEAP_GEN_MASK;
+
+    if (self->free_sz == self->free_cap)
+    {
+        size_t new_cap = self->free_cap == 0 ? 16 : self->free_cap * 2;
+        int* new_ids = realloc(self->free_ids, sizeof(int) * new_cap);
+        if (new_ids == NULL)
+        {/* Just leave a hole in data table. */
+            return;
+        }
+        self->free_ids = new_ids;
+        self->free_cap = new_cap;
+    }
+
+    self->free_ids[self->free_sz++] = id;
+}
+
+static void _infra_heap_push_handle(lua_State* L, infra_heap_t* self, int id)
+{
+    unsigned gen = self->slots[id].gen;
+#if LUA_VERSION_NUM >= 503
+    lua_pushinteger(L, ((lua_Integer)gen << 32) | (lua_Integer)id);
+#else
+    lua_pushnumber(L, (lua_Number)gen * 4294967296.0 + (lua_Number)id);
+#endif
+}
+
+/**
+ * @brief Get entry id of handle at \p idx.
+ * @return  Entry id, or 0 if the handle is not valid anymore.
+ */
+static int _infra_heap_check_handle(lua_State* L, infra_heap_t* self, int idx)
+{
+#if LUA_VERSION_NUM >= 503
+    lua_Integer handle = luaL_checkinteger(L, idx);
+    lua_Integer id = handle & 0xffffffff;
+    lua_Integer gen = handle >> 32;
+#else
+    lua_Number handle = luaL_checknumber(L, idx);
+    lua_Number gen = (lua_Number)(lua_Integer)(handle / 4294967296.0);
+    lua_Number id = handle - gen * 4294967296.0;
+#endif
+
+    if (id <= 0 || id > self->next_id)
+    {
+        return 0;
+    }
+
+    infra_heap_slot_t* slot = &self->slots[(int)id];
+    if (slot->pos == SIZE_MAX || (lua_Integer)slot->gen != (lua_Integer)gen)
+    {
+        return 0;
+    }
+
+    return (int)id;
+}
+
+static void _infra_heap_push_priority(lua_State* L, infra_heap_t* self, int id)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, 2 * (lua_Integer)id - 1);
+    lua_remove(L, -2);
+}
+
+/**
+ * @brief Push priority and value of entry \p id on top of stack.
+ */
+static void _infra_heap_push_entry(lua_State* L, infra_heap_t* self, int id)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, 2 * (lua_Integer)id - 1);
+    lua_rawgeti(L, -2, 2 * (lua_Integer)id);
+    lua_remove(L, -3);
+}
+
+static int _infra_heap_cmp_lua(infra_heap_t* self, const infra_heap_entry_t* e1,
+    const infra_heap_entry_t* e2)
+{
+    lua_State* L = self->L;
+    size_t version = self->version;
+
+    if (self->cmp_type == INFRA_HEAP_CMP_LUA)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_cmp);
+    }
+    else
+    {
+        lua_pushcfunction(L, infra_f_compare.addr);
+    }
+    _infra_heap_push_priority(L, self, e1->id);
+    _infra_heap_push_priority(L, self, e2->id);
+    lua_call(L, 2, 1);
+
+    /* Metamethods might use this heap from another coroutine. */
+    self->L = L;
+    if (self->version != version)
+    {
+        return luaL_error(L, "heap is modified during comparison.");
+    }
+
+    lua_Number ret = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
+    return ret < 0 ? -1 : (ret > 0 ? 1 : 0);
+}
+
+/**
+ * @brief Check whether \p e1 should be closer to the top than \p e2.
+ */
+static int _infra_heap_before(infra_heap_t* self, const infra_heap_entry_t* e1,
+    const infra_heap_entry_t* e2)
+{
+    int ret;
+
+    switch (self->cmp_type)
+    {
+    case INFRA_HEAP_CMP_NUMBER:
+        ret = infra_key_compare_number(&e1->key, &e2->key);
+        break;
+
+    case INFRA_HEAP_CMP_DEFAULT:
+        if (!infra_key_compare(&e1->key, &e2->key, &ret))
+        {
+            ret = _infra_heap_cmp_lua(self, e1, e2);
+        }
+        break;
+
+    default:
+        ret = _infra_heap_cmp_lua(self, e1, e2);
+        break;
+    }
+
+    return self->reverse ? ret > 0 : ret < 0;
+}
+
+static void _infra_heap_place(infra_heap_t* self, size_t pos, const infra_heap_entry_t* entry)
+{
+    self->heap[pos] = *entry;
+    self->slots[entry->id].pos = pos;
+}
+
+/**
+ * @brief Move entry at \p pos toward the top until heap order is restored.
+ * @return  The new position.
+ */
+static size_t _infra_heap_sift_up(infra_heap_t* self, size_t pos)
+{
+    infra_heap_entry_t entry = self->heap[pos];
+
+    while (pos > 0)
+    {
+        size_t parent = (pos - 1) / 2;
+        if (!_infra_heap_before(self, &entry, &self->heap[parent]))
+        {
+            break;
+        }
+        _infra_heap_place(self, pos, &self->heap[parent]);
+        _infra_heap_place(self, parent, &entry);
+        pos = parent;
+    }
+
+    return pos;
+}
+
+/**
+ * @brief Move entry at \p pos toward the bottom until heap order is restored.
+ */
+static void _infra_heap_sift_down(infra_heap_t* self, size_t pos)
+{
+    infra_heap_entry_t entry = self->heap[pos];
+
+    while (1)
+    {
+        size_t child = pos * 2 + 1;
+        if (child >= self->size)
+        {
+            break;
+        }
+        if (child + 1 < self->size
+            && _infra_heap_before(self, &self->heap[child + 1], &self->heap[child]))
+        {
+            child++;
+        }
+        if (!_infra_heap_before(self, &self->heap[child], &entry))
+        {
+            break;
+        }
+        _infra_heap_place(self, pos, &self->heap[child]);
+        _infra_heap_place(self, child, &entry);
+        pos = child;
+    }
+}
+
+/**
+ * @brief Restore heap order after priority of entry at \p pos changed.
+ */
+static void _infra_heap_fix(infra_heap_t* self, size_t pos)
+{
+    if (_infra_heap_sift_up(self, pos) == pos)
+    {
+        _infra_heap_sift_down(self, pos);
+    }
+}
+
+/**
+ * @brief Take a native copy of priority at \p idx.
+ */
+static void _infra_heap_key_init(lua_State* L, infra_heap_t* self, int idx, infra_key_t* key)
+{
+    if (self->cmp_type == INFRA_HEAP_CMP_NUMBER && lua_type(L, idx) != LUA_TNUMBER)
+    {
+        luaL_error(L, "heap priority must be number, got %s.", luaL_typename(L, idx));
+        return;
+    }
+    if (lua_type(L, idx) == LUA_TNIL)
+    {
+        luaL_error(L, "heap priority cannot be nil.");
+        return;
+    }
+
+    infra_key_init(L, idx, key);
+}
+
+/**
+ * @brief Remove entry at \p pos from heap, and release its id.
+ */
+static void _infra_heap_erase_pos(lua_State* L, infra_heap_t* self, size_t pos)
+{
+    int id = self->heap[pos].id;
+
+    self->size--;
+    self->version++;
+    if (pos != self->size)
+    {
+        _infra_heap_place(self, pos, &self->heap[self->size]);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, 2 * (lua_Integer)id - 1);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, 2 * (lua_Integer)id);
+    lua_pop(L, 1);
+
+    _infra_heap_free_id(self, id);
+
+    /* The entry is gone for good before any comparator might raise error. */
+    if (pos != self->size)
+    {
+        _infra_heap_fix(self, pos);
+    }
+}
+
+static infra_heap_t* _infra_heap_check(lua_State* L, int idx)
+{
+    infra_heap_t* self = luaL_checkudata(L, idx, INFRA_HEAP_NAME);
+    self->L = L;
+    return self;
+}
+
+static int _infra_heap_gc(lua_State* L)
+{
+    infra_heap_t* self = lua_touserdata(L, 1);
+
+    free(self->heap);
+    self->heap = NULL;
+    self->size = 0;
+    self->cap = 0;
+
+    free(self->slots);
+    self->slots = NULL;
+    self->slot_cap = 0;
+
+    free(self->free_ids);
+    self->free_ids = NULL;
+    self->free_sz = 0;
+    self->free_cap = 0;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_cmp);
+    self->ref_cmp = LUA_NOREF;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_data);
+    self->ref_data = LUA_NOREF;
+
+    return 0;
+}
+
+static int _infra_heap_size(lua_State* L)
+{
+    infra_heap_t* self = _infra_heap_check(L, 1);
+    lua_pushinteger(L, (lua_Integer)self->size);
+    return 1;
+}
+
+static int _infra_heap_push(lua_State* L)
+{
+    infra_heap_t* self = _infra_heap_check(L, 1);
+    lua_settop(L, 3);
+
+    infra_heap_entry_t entry;
+    _infra_heap_key_init(L, self, 2, &entry.key);
+
+    if (self->size == self->cap)
+    {
+        size_t new_cap = self->cap == 0 ? 16 : self->cap * 2;
+        infra_heap_entry_t* new_heap = realloc(self->heap, sizeof(infra_heap_entry_t) * new_cap);
+        INFRA_CHECK_OOM(L, new_heap);
+        self->heap = new_heap;
+        self->cap = new_cap;
+    }
+
+    entry.id = _infra_heap_alloc_id(self);
+    if (entry.id == 0)
+    {
+        return luaL_error(L, INFRA_LUA_ERRMSG_OOM);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, 2 * (lua_Integer)entry.id - 1);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, 2 * (lua_Integer)entry.id);
+    lua_pop(L, 1);
+
+    self->version++;
+    _infra_heap_place(self, self->size++, &entry);
+    _infra_heap_sift_up(self, self->size - 1);
+
+    _infra_heap_push_handle(L, self, entry.id);
+    return 1;
+}
+
+static int _infra_heap_peek(lua_State* L)
+{
+    infra_heap_t* self = _infra_heap_check(L, 1);
+    if (self->size == 0)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    _infra_heap_push_entry(L, self, self->heap[0].id);
+    return 2;
+}
+
+static int _infra_heap_pop(lua_State* L)
+{
+    infra_heap_t* self = _infra_heap_check(L, 1);
+    if (self->size == 0)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    _infra_heap_push_entry(L, self, self->heap[0].id);
+    _infra_heap_erase_pos(L, self, 0);
+    return 2;
+}
+
+static int _infra_heap_update(lua_State* L)
+{
+    infra_heap_t* self = _infra_heap_check(L, 1);
+    luaL_checkany(L, 3);
+    lua_settop(L, 3);
+
+    int id = _infra_heap_check_handle(L, self, 2);
+    if (id == 0)
+    {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    size_t pos = self->slots[id].pos;
+    _infra_heap_key_init(L, self, 3, &self->heap[pos].key);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, 2 * (lua_Integer)id - 1);
+    lua_pop(L, 1);
+
+    self->version++;
+    _infra_heap_fix(self, pos);
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int _infra_heap_remove(lua_State* L)
+{
+    infra_heap_t* self = _infra_heap_check(L, 1);
+
+    int id = _infra_heap_check_handle(L, self, 2);
+    if (id == 0)
+    {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    _infra_heap_erase_pos(L, self, self->slots[id].pos);
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int _infra_heap_get(lua_State* L)
+{
+    infra_heap_t* self = _infra_heap_check(L, 1);
+
+    int id = _infra_heap_check_handle(L, self, 2);
+    if (id == 0)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    _infra_heap_push_entry(L, self, id);
+    return 2;
+}
+
+/**
+ * @brief Setup comparator of \p self from option at \p idx.
+ */
+static void _infra_heap_setup_cmp(lua_State* L, infra_heap_t* self, int idx)
+{
+    size_t i;
+
+    switch (lua_type(L, idx))
+    {
+    case LUA_TNIL:
+        break;
+
+    case LUA_TFUNCTION:
+        lua_pushvalue(L, idx);
+        self->ref_cmp = luaL_ref(L, LUA_REGISTRYINDEX);
+        self->cmp_type = INFRA_HEAP_CMP_LUA;
+        break;
+
+    case LUA_TSTRING:
+        for (i = 0; i < ARRAY_SIZE(s_heap_cmp_opts); i++)
+        {
+            if (strcmp(s_heap_cmp_opts[i].name, lua_tostring(L, idx)) == 0)
+            {
+                self->cmp_type = s_heap_cmp_opts[i].cmp_type;
+                self->reverse = s_heap_cmp_opts[i].reverse;
+                break;
+            }
+        }
+        if (i == ARRAY_SIZE(s_heap_cmp_opts))
+        {
+            luaL_error(L, "unknown comparator `%s`.", lua_tostring(L, idx));
+        }
+        break;
+
+    default:
+        luaL_error(L, "unknown value for `cmp`.");
+        break;
+    }
+}
+
+static int _infra_new_heap(lua_State* L)
+{
+    int sp = lua_gettop(L);
+
+    infra_heap_t* self = lua_newuserdata(L, sizeof(infra_heap_t));
+    memset(self, 0, sizeof(*self));
+    self->ref_data = LUA_NOREF;
+    self->ref_cmp = LUA_NOREF;
+    self->cmp_type = INFRA_HEAP_CMP_DEFAULT;
+    self->L = L;
+
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _infra_heap_gc },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_method[] = {
+        { "size",       _infra_heap_size },
+        { "push",       _infra_heap_push },
+        { "peek",       _infra_heap_peek },
+        { "pop",        _infra_heap_pop },
+        { "update",     _infra_heap_update },
+        { "remove",     _infra_heap_remove },
+        { "get",        _infra_heap_get },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, INFRA_HEAP_NAME) != 0)
+    {
+        luaL_setfuncs(L, s_meta, 0);
+
+        /* metatable.__index = s_method */
+        luaL_newlib(L, s_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+
+    lua_newtable(L);
+    self->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (sp >= 1 && lua_type(L, 1) == LUA_TTABLE)
+    {
+        lua_getfield(L, 1, "cmp");
+        _infra_heap_setup_cmp(L, self, -1);
+        lua_pop(L, 1);
+    }
+
+    return 1;
+}
+
+const infra_lua_api_t infra_f_heap = {
+"make_heap", _infra_new_heap, 0,
+"Create a new empty heap.",
+
+"[SYNOPSIS]\n"
+"heap make_heap([opt])\n"
+"\n"
+"[DESCRIPTION]\n"
+"Create a new empty heap. A heap is a binary heap that keeps the entry with\n"
+"the smallest priority on top. Priorities can be anything except nil, and\n"
+"values can be anything.\n"
+"\n"
+"By default priorities are ordered as `compare()`. `opt.cmp` changes the\n"
+"order, it can be a Lua function that returns a number like `compare()`, or\n"
+"one of:\n"
+"  + `reverse`: Keep the largest priority on top.\n"
+"  + `number`: Priorities must be numbers, and they are compared natively.\n"
+"  + `number_reverse`: Same as `number`, but keep the largest on top.\n"
+"\n"
+"A heap have following metamethod:\n"
+"  integer heap:size()\n"
+"    Return the number of entries.\n"
+"  integer heap:push(priority, value)\n"
+"    Add an entry in O(log n), and return its handle.\n"
+"  any,any heap:peek()\n"
+"    Return priority and value on top, or nil if heap is empty.\n"
+"  any,any heap:pop()\n"
+"    Remove the entry on top in O(log n), and return its priority and value,\n"
+"    or nil if heap is empty.\n"
+"  boolean heap:update(handle, priority)\n"
+"    Change priority of entry in O(log n). Return false if the entry is not\n"
+"    in heap anymore.\n"
+"  boolean heap:remove(handle)\n"
+"    Remove entry in O(log n). Return false if the entry is not in heap\n"
+"    anymore.\n"
+"  any,any heap:get(handle)\n"
+"    Return priority and value of entry, or nil if the entry is not in heap\n"
+"    anymore.\n"
+"A handle becomes invalid once its entry is popped or removed.\n"
+};
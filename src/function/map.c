@@ -1,333 +1,2551 @@
 #include "__init__.h"
 #include "utils/map.h"
+#include "utils/btree.h"
+#include "utils/slab.h"
 #include <assert.h>
 
 #define INFRA_MAP_NAME  "__infra_map"
+#define INFRA_MAP_SNAPSHOT_NAME "__infra_map_snapshot"
+
+/**
+ * @brief Number of entries copied into every incomplete snapshot on each
+ *   modification of the live map.
+ */
+#define INFRA_MAP_SNAPSHOT_FILL 2
+
+/**
+ * @brief Position of key and value of entry \p id in data table.
+ * @{
+ */
+#define INFRA_MAP_KEY(id)   (2 * (lua_Integer)(id) - 1)
+#define INFRA_MAP_VAL(id)   (2 * (lua_Integer)(id))
+/**
+ * @}
+ */
+
+typedef struct infra_map_entry
+{
+    infra_key_t     key;    /**< Native copy of key. */
+
+    /**
+     * @brief Entry id in data table.
+     * For a temporary lookup key, it is the negative stack index of the key.
+     */
+    int             id;
+} infra_map_entry_t;
 
 typedef struct infra_map_node
 {
-    ev_map_node_t   node;
-    int             refk;
-    int             refv;
+    ev_map_node_t       node;
+    infra_map_entry_t   entry;
 } infra_map_node_t;
 
+/**
+ * @brief Node of map created with `rank` option.
+ */
+typedef struct infra_map_rank_node
+{
+    infra_map_node_t    base;
+    size_t              count;  /**< The number of nodes in this subtree. */
+} infra_map_rank_node_t;
+
+/**
+ * @brief How keys are compared.
+ */
+typedef enum infra_map_cmp_type
+{
+    INFRA_MAP_CMP_DEFAULT,      /**< Same as `compare()`. */
+    INFRA_MAP_CMP_LUA,          /**< User defined Lua function. */
+    INFRA_MAP_CMP_INTEGER,      /**< Integer keys only. */
+    INFRA_MAP_CMP_NUMBER,       /**< Number keys only. */
+    INFRA_MAP_CMP_STRING,       /**< String keys only. */
+    INFRA_MAP_CMP_STRING_CI,    /**< String keys only, ignoring case. */
+} infra_map_cmp_type_t;
+
+/**
+ * @brief Storage of entries.
+ */
+typedef enum infra_map_engine
+{
+    INFRA_MAP_ENGINE_RBTREE,    /**< Red-black tree, one node per entry. */
+    INFRA_MAP_ENGINE_BTREE,     /**< B+tree, entries stored in place. */
+} infra_map_engine_t;
+
+struct infra_map;
+
+/**
+ * @brief Compare two entries in ascending order.
+ */
+typedef int (*infra_map_cmp_fn)(const infra_map_entry_t* e1, const infra_map_entry_t* e2,
+    struct infra_map* self);
+
 typedef struct infra_map
 {
-    ev_map_t        root;
+    int             engine;     /**< #infra_map_engine_t. */
+    ev_map_t        root;       /**< Entries, for #INFRA_MAP_ENGINE_RBTREE. */
+    ev_btree_t      btree;      /**< Entries, for #INFRA_MAP_ENGINE_BTREE. */
     lua_State*      L;
+    size_t          version;    /**< Increase every time a node is added or removed. */
+    ev_slab_t       slab;       /**< Allocator for #infra_map_node_t. */
+
+    /**
+     * @brief Reference to data table.
+     * Keys and values are stored in this private table, at the position of
+     * #INFRA_MAP_KEY() and #INFRA_MAP_VAL().
+     */
+    int             ref_data;
+    int*            free_ids;   /**< Recycled entry ids. */
+    size_t          free_sz;    /**< The number of recycled ids. */
+    size_t          free_cap;   /**< Capacity of #infra_map::free_ids. */
+    int             next_id;    /**< The largest allocated id. */
+
+    int             cmp_type;   /**< #infra_map_cmp_type_t. */
+    int             ref_cmp;    /**< Reference to Lua comparator. */
+    infra_map_cmp_fn cmp;       /**< Comparator in ascending order. */
+    int             reverse;    /**< Whether keys are in descending order. */
+    const char*     cmp_name;   /**< Name of native comparator, NULL for default. */
+
+    /**
+     * @brief Snapshot.
+     *
+     * A snapshot is a map that holds the original entries of keys modified
+     * after it is taken, and reads anything else from the live map. Each
+     * modification of the live map also copies #INFRA_MAP_SNAPSHOT_FILL
+     * entries into the snapshot, so the snapshot soon holds all of its
+     * entries and no longer reads from the live map.
+     * @{
+     */
+    struct infra_map* base;     /**< The live map. NULL if this is not a snapshot, or the snapshot is complete. */
+    struct infra_map* snap_next;/**< For a live map, the first incomplete snapshot. For a snapshot, the next one. */
+    struct infra_map* snap_prev;/**< The previous incomplete snapshot. */
+    int             ref_base;   /**< Reference to #infra_map::base. */
+    int             ref_fill;   /**< Reference to the next key to copy from the live map. */
+    int             snap_done;  /**< Whether the snapshot holds all of its entries. */
+    size_t          snap_size;  /**< Size of the live map when the snapshot is taken. */
+    /**
+     * @}
+     */
 } infra_map_t;
 
-static int _infra_map_cmp(const ev_map_node_t* key1, const ev_map_node_t* key2, void* arg)
+/**
+ * @brief Value recorded in snapshot for a key that did not exist.
+ */
+static const char s_map_absent = 0;
+
+/**
+ * @brief Position of an entry, for both engines.
+ */
+typedef struct infra_map_pos
+{
+    infra_map_entry_t*  entry;  /**< The entry, NULL if not point to any. */
+    ev_map_node_t*      node;   /**< Node in red-black tree. */
+    ev_btree_iter_t     iter;   /**< Position in B+tree. */
+} infra_map_pos_t;
+
+/**
+ * @brief Iterator state, saved as upvalue of the iterator function.
+ */
+typedef struct infra_map_range
+{
+    infra_map_pos_t pos;        /**< Last returned position. */
+    size_t          version;    /**< Map version when #infra_map_range::pos is returned. */
+    int             reverse;    /**< Iterate from high to low. */
+} infra_map_range_t;
+
+typedef struct infra_map_iter
+{
+    infra_map_t*    map;        /**< The map #infra_map_iter::pos belongs to. */
+    infra_map_pos_t pos;        /**< The position last returned. */
+    size_t          version;    /**< Map version when #infra_map_iter::pos is returned. */
+} infra_map_iter_t;
+
+static int _infra_map_alloc_id(infra_map_t* self)
+{
+    if (self->free_sz > 0)
+    {
+        return self->free_ids[--self->free_sz];
+    }
+    return ++self->next_id;
+}
+
+static void _infra_map_free_id(infra_map_t* self, int id)
+{
+    if (self->free_sz == self->free_cap)
+    {
+        size_t new_cap = self->free_cap == 0 ? 16 : self->free_cap * 2;
+        int* new_ids = realloc(self->free_ids, sizeof(int) * new_cap);
+        if (new_ids == NULL)
+        {/* Just leave a hole in data table. */
+            return;
+        }
+        self->free_ids = new_ids;
+        self->free_cap = new_cap;
+    }
+
+    self->free_ids[self->free_sz++] = id;
+}
+
+/**
+ * @brief Save key at \p kidx and value at \p vidx as entry \p id.
+ */
+static void _infra_map_set_entry(lua_State* L, infra_map_t* self, int id, int kidx, int vidx)
+{
+    kidx = lua_absindex(L, kidx);
+    vidx = lua_absindex(L, vidx);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushvalue(L, kidx);
+    lua_rawseti(L, -2, INFRA_MAP_KEY(id));
+    lua_pushvalue(L, vidx);
+    lua_rawseti(L, -2, INFRA_MAP_VAL(id));
+    lua_pop(L, 1);
+}
+
+static void _infra_map_clear_entry(lua_State* L, infra_map_t* self, int id)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, INFRA_MAP_KEY(id));
+    lua_pushnil(L);
+    lua_rawseti(L, -2, INFRA_MAP_VAL(id));
+    lua_pop(L, 1);
+}
+
+/**
+ * @brief Push key and value of \p entry on top of stack.
+ */
+static void _infra_map_push_entry(lua_State* L, infra_map_t* self, const infra_map_entry_t* entry)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, INFRA_MAP_KEY(entry->id));
+    lua_rawgeti(L, -2, INFRA_MAP_VAL(entry->id));
+    lua_remove(L, -3);
+}
+
+static void _infra_map_push_value(lua_State* L, infra_map_t* self, const infra_map_entry_t* entry)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, INFRA_MAP_VAL(entry->id));
+    lua_remove(L, -2);
+}
+
+static int _infra_map_tointeger(lua_State* L, int idx, lua_Integer* val)
+{
+    if (lua_type(L, idx) != LUA_TNUMBER)
+    {
+        return 0;
+    }
+
+#if LUA_VERSION_NUM >= 503
+    int isnum = 0;
+    *val = lua_tointegerx(L, idx, &isnum);
+    return isnum;
+#else
+    lua_Number n = lua_tonumber(L, idx);
+    *val = (lua_Integer)n;
+    return (lua_Number)*val == n;
+#endif
+}
+
+static int _infra_map_key_error(lua_State* L, int idx, const char* tname)
+{
+    return luaL_error(L, "map key must be %s, got %s.", tname, luaL_typename(L, idx));
+}
+
+/**
+ * @brief Take a native copy of key at \p idx, checking the type required by
+ *   the comparator of \p self.
+ */
+static void _infra_map_key_init(lua_State* L, infra_map_t* self, int idx, infra_key_t* key)
+{
+    switch (self->cmp_type)
+    {
+    case INFRA_MAP_CMP_INTEGER:
+        key->type = LUA_TNUMBER;
+        key->native = 1;
+        key->integer = 1;
+        if (!_infra_map_tointeger(L, idx, &key->v.i))
+        {
+            _infra_map_key_error(L, idx, "integer");
+        }
+        break;
+
+    case INFRA_MAP_CMP_NUMBER:
+        if (lua_type(L, idx) != LUA_TNUMBER)
+        {
+            _infra_map_key_error(L, idx, "number");
+        }
+        infra_key_init(L, idx, key);
+        break;
+
+    case INFRA_MAP_CMP_STRING:
+    case INFRA_MAP_CMP_STRING_CI:
+        if (lua_type(L, idx) != LUA_TSTRING)
+        {
+            _infra_map_key_error(L, idx, "string");
+        }
+        infra_key_init(L, idx, key);
+        break;
+
+    default:
+        infra_key_init(L, idx, key);
+        break;
+    }
+}
+
+/**
+ * @brief Initialize \p probe as a temporary lookup key for value at \p idx.
+ *
+ * The key is read straight from the stack, so the value at \p idx must stay
+ * in place as long as \p probe is in use.
+ */
+static void _infra_map_init_probe(lua_State* L, infra_map_t* self, infra_map_entry_t* probe, int idx)
+{
+    _infra_map_key_init(L, self, idx, &probe->key);
+    probe->id = -lua_absindex(L, idx);
+}
+
+/**
+ * @brief Push key of \p entry on top of stack.
+ */
+static void _infra_map_push_key(lua_State* L, infra_map_t* self, const infra_map_entry_t* entry)
+{
+    if (entry->id <= 0)
+    {
+        lua_pushvalue(L, -entry->id);
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, INFRA_MAP_KEY(entry->id));
+    lua_remove(L, -2);
+}
+
+static int _infra_map_cmp(const infra_map_entry_t* e1, const infra_map_entry_t* e2, infra_map_t* self)
 {
-    infra_map_t* self = arg;
     lua_State* L = self->L;
 
-    infra_map_node_t* n1 = container_of(key1, infra_map_node_t, node);
-    infra_map_node_t* n2 = container_of(key2, infra_map_node_t, node);
+    int ret;
+    if (infra_key_compare(&e1->key, &e2->key, &ret))
+    {
+        return ret;
+    }
 
     lua_pushcfunction(L, infra_f_compare.addr);
-    lua_rawgeti(L, LUA_REGISTRYINDEX, n1->refk);
-    lua_rawgeti(L, LUA_REGISTRYINDEX, n2->refk);
+    _infra_map_push_key(L, self, e1);
+    _infra_map_push_key(L, self, e2);
+    lua_call(L, 2, 1);
+
+    /* Metamethods might use this map from another coroutine. */
+    self->L = L;
+
+    ret = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    return ret;
+}
+
+static int _infra_map_cmp_lua(const infra_map_entry_t* e1, const infra_map_entry_t* e2, infra_map_t* self)
+{
+    lua_State* L = self->L;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_cmp);
+    _infra_map_push_key(L, self, e1);
+    _infra_map_push_key(L, self, e2);
     lua_call(L, 2, 1);
+    self->L = L;
 
-    int ret = (int)lua_tointeger(L, -1);
+    lua_Number ret = lua_tonumber(L, -1);
     lua_pop(L, 1);
 
-    return ret;
+    return ret < 0 ? -1 : (ret > 0 ? 1 : 0);
+}
+
+static int _infra_map_cmp_integer(const infra_map_entry_t* e1, const infra_map_entry_t* e2, infra_map_t* self)
+{
+    (void)self;
+    lua_Integer v1 = e1->key.v.i;
+    lua_Integer v2 = e2->key.v.i;
+    return v1 < v2 ? -1 : (v1 > v2 ? 1 : 0);
+}
+
+static int _infra_map_cmp_number(const infra_map_entry_t* e1, const infra_map_entry_t* e2, infra_map_t* self)
+{
+    (void)self;
+    return infra_key_compare_number(&e1->key, &e2->key);
+}
+
+static int _infra_map_cmp_string(const infra_map_entry_t* e1, const infra_map_entry_t* e2, infra_map_t* self)
+{
+    (void)self;
+    const infra_key_t* k1 = &e1->key;
+    const infra_key_t* k2 = &e2->key;
+    if (k1->v.s.str == k2->v.s.str)
+    {
+        return 0;
+    }
+    return infra_compare_string(k1->v.s.str, k1->v.s.len, k2->v.s.str, k2->v.s.len);
+}
+
+static int _infra_map_cmp_string_ci(const infra_map_entry_t* e1, const infra_map_entry_t* e2, infra_map_t* self)
+{
+    (void)self;
+    const infra_key_t* k1 = &e1->key;
+    const infra_key_t* k2 = &e2->key;
+    return infra_compare_string_ci(k1->v.s.str, k1->v.s.len, k2->v.s.str, k2->v.s.len);
+}
+
+/**
+ * @brief Compare two entries with the comparator of \p self.
+ */
+static int _infra_map_entry_cmp(infra_map_t* self, const infra_map_entry_t* e1, const infra_map_entry_t* e2)
+{
+    return self->reverse ? self->cmp(e2, e1, self) : self->cmp(e1, e2, self);
+}
+
+static int _infra_map_rbtree_cmp(const ev_map_node_t* key1, const ev_map_node_t* key2, void* arg)
+{
+    return _infra_map_entry_cmp(arg, &container_of(key1, infra_map_node_t, node)->entry,
+        &container_of(key2, infra_map_node_t, node)->entry);
+}
+
+static int _infra_map_btree_cmp(const void* key1, const void* key2, void* arg)
+{
+    return _infra_map_entry_cmp(arg, key1, key2);
+}
+
+/**
+ * @brief Key of entry in B+tree, for #INFRA_MAP_CMP_INTEGER.
+ *
+ * `~v` is `-v - 1`, so it reverses the order without overflow.
+ */
+static int64_t _infra_map_btree_key(const void* item, void* arg)
+{
+    infra_map_t* self = arg;
+    int64_t v = (int64_t)((const infra_map_entry_t*)item)->key.v.i;
+    return self->reverse ? ~v : v;
+}
+
+/**
+ * @brief Compare two nodes with the comparator of \p self.
+ */
+static int _infra_map_node_cmp(infra_map_t* self, const ev_map_node_t* key1, const ev_map_node_t* key2)
+{
+    return _infra_map_rbtree_cmp(key1, key2, self);
+}
+
+static size_t _infra_map_length(const infra_map_t* self)
+{
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        return ev_btree_size(&self->btree);
+    }
+    return ev_map_size(&self->root);
+}
+
+static void _infra_map_pos_node(infra_map_pos_t* pos, ev_map_node_t* node)
+{
+    pos->node = node;
+    pos->entry = node != NULL ? &container_of(node, infra_map_node_t, node)->entry : NULL;
+}
+
+static void _infra_map_pos_iter(infra_map_t* self, infra_map_pos_t* pos)
+{
+    pos->entry = ev_btree_item(&self->btree, &pos->iter);
+}
+
+static void _infra_map_begin(infra_map_t* self, infra_map_pos_t* pos)
+{
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        ev_btree_begin(&self->btree, &pos->iter);
+        _infra_map_pos_iter(self, pos);
+        return;
+    }
+    _infra_map_pos_node(pos, ev_map_begin(&self->root));
+}
+
+static void _infra_map_end(infra_map_t* self, infra_map_pos_t* pos)
+{
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        ev_btree_end(&self->btree, &pos->iter);
+        _infra_map_pos_iter(self, pos);
+        return;
+    }
+    _infra_map_pos_node(pos, ev_map_end(&self->root));
+}
+
+/**
+ * @brief Move \p pos to next entry. \p pos must point to an entry.
+ */
+static void _infra_map_next(infra_map_t* self, infra_map_pos_t* pos)
+{
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        ev_btree_next(&pos->iter);
+        _infra_map_pos_iter(self, pos);
+        return;
+    }
+    _infra_map_pos_node(pos, ev_map_next(pos->node));
+}
+
+/**
+ * @brief Move \p pos to previous entry. \p pos must point to an entry.
+ */
+static void _infra_map_prev(infra_map_t* self, infra_map_pos_t* pos)
+{
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        ev_btree_prev(&pos->iter);
+        _infra_map_pos_iter(self, pos);
+        return;
+    }
+    _infra_map_pos_node(pos, ev_map_prev(pos->node));
+}
+
+/**
+ * @brief How to find an entry by key.
+ */
+typedef enum infra_map_seek
+{
+    INFRA_MAP_SEEK_EQ,          /**< Equal to key. */
+    INFRA_MAP_SEEK_LOWER,       /**< The first one not less than key. */
+    INFRA_MAP_SEEK_UPPER,       /**< The first one greater than key. */
+} infra_map_seek_t;
+
+/**
+ * @brief Find entry by the key at \p idx.
+ * @param[in] mode  #infra_map_seek_t.
+ */
+static void _infra_map_seek(lua_State* L, infra_map_t* self, int idx, int mode, infra_map_pos_t* pos)
+{
+    infra_map_node_t tmp_node;
+    _infra_map_init_probe(L, self, &tmp_node.entry, idx);
+
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        switch (mode)
+        {
+        case INFRA_MAP_SEEK_EQ:
+            ev_btree_find(&self->btree, &tmp_node.entry, &pos->iter);
+            break;
+        case INFRA_MAP_SEEK_LOWER:
+            ev_btree_find_lower(&self->btree, &tmp_node.entry, &pos->iter);
+            break;
+        default:
+            ev_btree_find_upper(&self->btree, &tmp_node.entry, &pos->iter);
+            break;
+        }
+        _infra_map_pos_iter(self, pos);
+        return;
+    }
+
+    switch (mode)
+    {
+    case INFRA_MAP_SEEK_EQ:
+        _infra_map_pos_node(pos, ev_map_find(&self->root, &tmp_node.node));
+        break;
+    case INFRA_MAP_SEEK_LOWER:
+        _infra_map_pos_node(pos, ev_map_find_lower(&self->root, &tmp_node.node));
+        break;
+    default:
+        _infra_map_pos_node(pos, ev_map_find_upper(&self->root, &tmp_node.node));
+        break;
+    }
+}
+
+/**
+ * @brief Erase entry at \p pos.
+ */
+static void _infra_map_erase_pos(lua_State* L, infra_map_t* self, infra_map_pos_t* pos)
+{
+    infra_map_entry_t entry = *pos->entry;
+
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        ev_btree_erase(&self->btree, &entry, NULL);
+    }
+    else
+    {
+        ev_map_erase(&self->root, pos->node);
+        ev_slab_free(&self->slab, container_of(pos->node, infra_map_node_t, node));
+    }
+    self->version++;
+
+    _infra_map_clear_entry(L, self, entry.id);
+    _infra_map_free_id(self, entry.id);
+}
+
+static int _infra_map_gc(lua_State* L)
+{
+    infra_map_t* self = lua_touserdata(L, 1);
+
+    /* Incomplete snapshots keep the live map alive, so they are also garbage now. */
+    infra_map_t* snap = self->snap_next;
+    while (snap != NULL)
+    {
+        infra_map_t* next = snap->snap_next;
+        snap->base = NULL;
+        snap->snap_next = NULL;
+        snap->snap_prev = NULL;
+        snap = next;
+    }
+    self->snap_next = NULL;
+
+    /* All nodes live in slab or B+tree, and all Lua values live in data table. */
+    ev_map_init(&self->root, _infra_map_rbtree_cmp, self);
+    ev_slab_exit(&self->slab);
+    ev_btree_exit(&self->btree);
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_cmp);
+    self->ref_cmp = LUA_NOREF;
+
+    free(self->free_ids);
+    self->free_ids = NULL;
+    self->free_sz = 0;
+    self->free_cap = 0;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_data);
+    self->ref_data = LUA_NOREF;
+
+    return 0;
+}
+
+static int _infra_map_size(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+
+    size_t size = _infra_map_length(self);
+    lua_pushinteger(L, size);
+    return 1;
+}
+
+static int _infra_map_memstat(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+
+    size_t chunks = self->slab.chunk_cnt, nodes = self->slab.live, bytes = self->slab.bytes;
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {/* Every B+tree node is allocated alone. */
+        chunks = self->btree.node_cnt;
+        nodes = self->btree.node_cnt;
+        bytes = self->btree.node_cnt * self->btree.node_size;
+    }
+
+    lua_newtable(L);
+    lua_pushinteger(L, (lua_Integer)chunks);
+    lua_setfield(L, -2, "chunks");
+    lua_pushinteger(L, (lua_Integer)nodes);
+    lua_setfield(L, -2, "nodes");
+    lua_pushinteger(L, (lua_Integer)bytes);
+    lua_setfield(L, -2, "bytes");
+
+    return 1;
+}
+
+/**
+ * @brief B+tree version of #_infra_map_set().
+ */
+static int _infra_map_btree_set(lua_State* L, infra_map_t* self, infra_map_entry_t* entry,
+    int kidx, int vidx, int replace)
+{
+    ev_btree_iter_t iter;
+
+    entry->id = _infra_map_alloc_id(self);
+    _infra_map_set_entry(L, self, entry->id, kidx, vidx);
+
+    int ret = ev_btree_insert(&self->btree, entry, &iter);
+    if (ret == 0)
+    {
+        self->version++;
+        return 1;
+    }
+
+    _infra_map_clear_entry(L, self, entry->id);
+    _infra_map_free_id(self, entry->id);
+    if (ret < 0)
+    {
+        return luaL_error(L, "out of memory.");
+    }
+
+    if (replace)
+    {/* Entries stay in place, but separators copied from the key need update too. */
+        entry->id = ((infra_map_entry_t*)ev_btree_item(&self->btree, &iter))->id;
+        _infra_map_set_entry(L, self, entry->id, kidx, vidx);
+        ev_btree_replace(&self->btree, entry);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Red-black tree version of #_infra_map_set().
+ */
+static int _infra_map_rbtree_set(lua_State* L, infra_map_t* self, infra_map_entry_t* entry,
+    int kidx, int vidx, int replace)
+{
+    infra_map_node_t* node = ev_slab_alloc(&self->slab);
+    if (node == NULL)
+    {
+        return luaL_error(L, "out of memory.");
+    }
+
+    node->entry.key = entry->key;
+    node->entry.id = _infra_map_alloc_id(self);
+    _infra_map_set_entry(L, self, node->entry.id, kidx, vidx);
+
+    ev_map_node_t* orig = ev_map_insert(&self->root, &node->node);
+    if (orig == NULL)
+    {
+        self->version++;
+        return 1;
+    }
+
+    _infra_map_clear_entry(L, self, node->entry.id);
+    _infra_map_free_id(self, node->entry.id);
+    ev_slab_free(&self->slab, node);
+
+    if (replace)
+    {/* The node stays in place, so there is no need to update version. */
+        infra_map_node_t* orig_node = container_of(orig, infra_map_node_t, node);
+        orig_node->entry.key = entry->key;
+        _infra_map_set_entry(L, self, orig_node->entry.id, kidx, vidx);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Save the current entry of key at \p idx of live map \p self into
+ *   \p snap, if it is not saved yet.
+ */
+static void _infra_map_snap_save(lua_State* L, infra_map_t* self, infra_map_t* snap, int idx)
+{
+    infra_map_pos_t pos;
+    _infra_map_seek(L, snap, idx, INFRA_MAP_SEEK_EQ, &pos);
+    if (pos.entry != NULL)
+    {
+        return;
+    }
+
+    _infra_map_seek(L, self, idx, INFRA_MAP_SEEK_EQ, &pos);
+    if (pos.entry != NULL)
+    {
+        _infra_map_push_entry(L, self, pos.entry);
+    }
+    else
+    {
+        lua_pushvalue(L, idx);
+        lua_pushlightuserdata(L, (void*)&s_map_absent);
+    }
+
+    infra_map_entry_t entry;
+    _infra_map_key_init(L, snap, -2, &entry.key);
+    _infra_map_rbtree_set(L, snap, &entry, -2, -1, 0);
+    lua_pop(L, 2);
+}
+
+/**
+ * @brief Unlink \p snap from live map \p self, so it no longer reads from it.
+ */
+static void _infra_map_snap_detach(lua_State* L, infra_map_t* self, infra_map_t* snap)
+{
+    if (snap->snap_prev != NULL)
+    {
+        snap->snap_prev->snap_next = snap->snap_next;
+    }
+    else if (self != NULL && self->snap_next == snap)
+    {
+        self->snap_next = snap->snap_next;
+    }
+    if (snap->snap_next != NULL)
+    {
+        snap->snap_next->snap_prev = snap->snap_prev;
+    }
+    snap->base = NULL;
+    snap->snap_next = NULL;
+    snap->snap_prev = NULL;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, snap->ref_base);
+    snap->ref_base = LUA_NOREF;
+    luaL_unref(L, LUA_REGISTRYINDEX, snap->ref_fill);
+    snap->ref_fill = LUA_NOREF;
+}
+
+/**
+ * @brief Copy the next #INFRA_MAP_SNAPSHOT_FILL entries of live map \p self
+ *   into \p snap. Keys saved before are kept as they are.
+ *
+ * Every call consumes more keys than a modification can add, so \p snap is
+ * complete after at most as many modifications as it has entries.
+ */
+static void _infra_map_snap_fill(lua_State* L, infra_map_t* self, infra_map_t* snap)
+{
+    int i, sp = lua_gettop(L);
+    infra_map_pos_t pos;
+
+    if (snap->ref_fill == LUA_NOREF)
+    {
+        _infra_map_begin(self, &pos);
+    }
+    else
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, snap->ref_fill);
+        _infra_map_seek(L, self, sp + 1, INFRA_MAP_SEEK_LOWER, &pos);
+        lua_pop(L, 1);
+    }
+
+    for (i = 0; i < INFRA_MAP_SNAPSHOT_FILL && pos.entry != NULL; i++)
+    {
+        _infra_map_push_entry(L, self, pos.entry);
+
+        infra_map_entry_t entry;
+        _infra_map_key_init(L, snap, sp + 1, &entry.key);
+        _infra_map_rbtree_set(L, snap, &entry, sp + 1, sp + 2, 0);
+        lua_settop(L, sp);
+
+        _infra_map_next(self, &pos);
+    }
+
+    if (pos.entry == NULL)
+    {
+        _infra_map_snap_detach(L, self, snap);
+        snap->snap_done = 1;
+        return;
+    }
+
+    _infra_map_push_key(L, self, pos.entry);
+    if (snap->ref_fill == LUA_NOREF)
+    {
+        snap->ref_fill = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else
+    {
+        lua_rawseti(L, LUA_REGISTRYINDEX, snap->ref_fill);
+    }
+}
+
+/**
+ * @brief Save the current entry of key at \p idx into every incomplete
+ *   snapshot of \p self, and copy some more entries into them. Must be
+ *   called before modifying the key.
+ */
+static void _infra_map_snap_record(lua_State* L, infra_map_t* self, int idx)
+{
+    infra_map_t* snap = self->snap_next;
+    idx = lua_absindex(L, idx);
+
+    while (snap != NULL)
+    {
+        infra_map_t* next = snap->snap_next;
+        snap->L = L;
+
+        _infra_map_snap_save(L, self, snap, idx);
+        _infra_map_snap_fill(L, self, snap);
+
+        snap = next;
+    }
+}
+
+/**
+ * @brief Insert key at \p kidx and value at \p vidx.
+ * @param[in] replace   Whether to replace existing key and value.
+ * @return              1 if a new node is inserted, 0 if key exists.
+ */
+static int _infra_map_set(lua_State* L, infra_map_t* self, int kidx, int vidx, int replace)
+{
+    _infra_map_snap_record(L, self, kidx);
+
+    infra_map_entry_t entry;
+    _infra_map_key_init(L, self, kidx, &entry.key);
+
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        return _infra_map_btree_set(L, self, &entry, kidx, vidx, replace);
+    }
+    return _infra_map_rbtree_set(L, self, &entry, kidx, vidx, replace);
+}
+
+static int _infra_map_insert(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    self->L = L;
+    lua_settop(L, 3);
+
+    int ret = _infra_map_set(L, self, 2, 3, 0);
+    lua_pushboolean(L, ret);
+
+    return 1;
+}
+
+static int _infra_map_replace(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    self->L = L;
+    lua_settop(L, 3);
+
+    _infra_map_set(L, self, 2, 3, 1);
+
+    return 0;
+}
+
+static int _infra_map_erase(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    self->L = L;
+
+    infra_map_pos_t pos;
+    _infra_map_seek(L, self, 2, INFRA_MAP_SEEK_EQ, &pos);
+    if (pos.entry == NULL)
+    {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    _infra_map_snap_record(L, self, 2);
+    _infra_map_erase_pos(L, self, &pos);
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/**
+ * @brief Check if the cached position of \p iter is the control key at 2.
+ */
+static int _infra_map_iter_cached(lua_State* L, infra_map_t* self, const infra_map_iter_t* iter)
+{
+    if (iter->map != self || iter->version != self->version || iter->pos.entry == NULL)
+    {
+        return 0;
+    }
+
+    _infra_map_push_key(L, self, iter->pos.entry);
+    int ret = lua_rawequal(L, 2, -1);
+    lua_pop(L, 1);
+
+    return ret;
+}
+
+/**
+ * @brief Iterator function.
+ *
+ * The last returned position is cached in upvalue, so in most cases the next
+ * entry is found in O(1). The cache is only used if it belongs to the same
+ * map, the map is not modified since then, and the control key is the key
+ * last returned. Otherwise we search by the control key instead.
+ */
+static int _infra_map_pairs_next(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    infra_map_iter_t* iter = lua_touserdata(L, lua_upvalueindex(1));
+    self->L = L;
+
+    if (lua_type(L, 2) == LUA_TNIL)
+    {
+        _infra_map_begin(self, &iter->pos);
+    }
+    else if (_infra_map_iter_cached(L, self, iter))
+    {
+        _infra_map_next(self, &iter->pos);
+    }
+    else
+    {
+        _infra_map_seek(L, self, 2, INFRA_MAP_SEEK_UPPER, &iter->pos);
+    }
+
+    iter->map = self;
+    iter->version = self->version;
+
+    if (iter->pos.entry == NULL)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    _infra_map_push_entry(L, self, iter->pos.entry);
+    return 2;
+}
+
+static int _infra_map_meta_pairs(lua_State* L)
+{
+    infra_map_iter_t* iter = lua_newuserdata(L, sizeof(infra_map_iter_t));
+    memset(iter, 0, sizeof(*iter));
+
+    lua_pushcclosure(L, _infra_map_pairs_next, 1);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+static int _infra_map_pairs(lua_State* L)
+{
+    luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    return _infra_map_meta_pairs(L);
+}
+
+static int _infra_map_find(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    self->L = L;
+
+    infra_map_pos_t pos;
+    _infra_map_seek(L, self, 2, INFRA_MAP_SEEK_EQ, &pos);
+    if (pos.entry == NULL)
+    {
+        lua_pushboolean(L, 0);
+        lua_pushnil(L);
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+    _infra_map_push_value(L, self, pos.entry);
+
+    return 2;
+}
+
+/**
+ * @brief Find the first entry not less than (or greater than, if \p upper is
+ *   set) the key at \p idx.
+ */
+static void _infra_map_find_bound(lua_State* L, infra_map_t* self, int idx, int upper,
+    infra_map_pos_t* pos)
+{
+    _infra_map_seek(L, self, idx, upper ? INFRA_MAP_SEEK_UPPER : INFRA_MAP_SEEK_LOWER, pos);
+}
+
+/**
+ * @brief Find the last entry less than (or not greater than, if \p upper is
+ *   set) the key at \p idx.
+ */
+static void _infra_map_find_bound_prev(lua_State* L, infra_map_t* self, int idx, int upper,
+    infra_map_pos_t* pos)
+{
+    _infra_map_find_bound(L, self, idx, upper, pos);
+    if (pos->entry != NULL)
+    {
+        _infra_map_prev(self, pos);
+    }
+    else
+    {
+        _infra_map_end(self, pos);
+    }
+}
+
+/**
+ * @brief Compare key of \p entry with the key at \p idx.
+ */
+static int _infra_map_compare_entry(lua_State* L, infra_map_t* self, const infra_map_entry_t* entry, int idx)
+{
+    infra_map_entry_t tmp_entry;
+    _infra_map_init_probe(L, self, &tmp_entry, idx);
+
+    return _infra_map_entry_cmp(self, entry, &tmp_entry);
+}
+
+static size_t _infra_map_rank_count(const ev_map_node_t* node)
+{
+    return node != NULL ? container_of(node, infra_map_rank_node_t, base.node)->count : 0;
+}
+
+static void _infra_map_rank_augment(ev_map_node_t* node)
+{
+    infra_map_rank_node_t* rank_node = container_of(node, infra_map_rank_node_t, base.node);
+    rank_node->count = 1 + _infra_map_rank_count(node->rb_left) + _infra_map_rank_count(node->rb_right);
+}
+
+/**
+ * @brief Count keys less than (or not greater than, if \p upper is set) the
+ *   key at \p idx.
+ */
+static size_t _infra_map_count_less(lua_State* L, infra_map_t* self, int idx, int upper)
+{
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {/* Count entries in leaves before the bound. */
+        infra_map_pos_t pos;
+        _infra_map_find_bound(L, self, idx, upper, &pos);
+        return ev_btree_index(&self->btree, &pos.iter);
+    }
+
+    size_t cnt = 0;
+    ev_map_node_t* it;
+    infra_map_node_t tmp_node;
+    _infra_map_init_probe(L, self, &tmp_node.entry, idx);
+
+    if (self->root.augment != NULL)
+    {
+        for (it = self->root.rb_root; it != NULL;)
+        {
+            int ret = _infra_map_node_cmp(self, it, &tmp_node.node);
+            if (ret < 0 || (upper && ret == 0))
+            {
+                cnt += _infra_map_rank_count(it->rb_left) + 1;
+                it = it->rb_right;
+            }
+            else
+            {
+                it = it->rb_left;
+            }
+        }
+    }
+    else
+    {/* Without subtree size we have to walk through. */
+        ev_map_node_t* stop = upper ? ev_map_find_upper(&self->root, &tmp_node.node)
+            : ev_map_find_lower(&self->root, &tmp_node.node);
+        for (it = ev_map_begin(&self->root); it != stop; it = ev_map_next(it))
+        {
+            cnt++;
+        }
+    }
+
+    return cnt;
+}
+
+/**
+ * @brief Find the node at position \p pos, start from 0.
+ */
+static ev_map_node_t* _infra_map_find_node_at(infra_map_t* self, size_t pos)
+{
+    ev_map_node_t* it;
+    size_t size = ev_map_size(&self->root);
+    if (pos >= size)
+    {
+        return NULL;
+    }
+
+    if (self->root.augment != NULL)
+    {
+        for (it = self->root.rb_root; it != NULL;)
+        {
+            size_t left = _infra_map_rank_count(it->rb_left);
+            if (pos < left)
+            {
+                it = it->rb_left;
+            }
+            else if (pos == left)
+            {
+                break;
+            }
+            else
+            {
+                pos -= left + 1;
+                it = it->rb_right;
+            }
+        }
+        return it;
+    }
+
+    /* Without subtree size, walk from the nearest end. */
+    if (pos < size / 2)
+    {
+        for (it = ev_map_begin(&self->root); pos > 0; pos--)
+        {
+            it = ev_map_next(it);
+        }
+    }
+    else
+    {
+        for (it = ev_map_end(&self->root); pos < size - 1; pos++)
+        {
+            it = ev_map_prev(it);
+        }
+    }
+    return it;
+}
+
+/**
+ * @brief Find the entry at position \p index, start from 0.
+ */
+static void _infra_map_find_at(infra_map_t* self, size_t index, infra_map_pos_t* pos)
+{
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        ev_btree_at(&self->btree, index, &pos->iter);
+        _infra_map_pos_iter(self, pos);
+        return;
+    }
+    _infra_map_pos_node(pos, _infra_map_find_node_at(self, index));
+}
+
+/**
+ * @brief Push key and value at \p pos, or nil if \p pos is not point to
+ *   any entry.
+ */
+static int _infra_map_push_pos(lua_State* L, infra_map_t* self, const infra_map_pos_t* pos)
+{
+    if (pos->entry == NULL)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    _infra_map_push_entry(L, self, pos->entry);
+    return 2;
+}
+
+static int _infra_map_first(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+
+    infra_map_pos_t pos;
+    _infra_map_begin(self, &pos);
+    return _infra_map_push_pos(L, self, &pos);
+}
+
+static int _infra_map_last(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+
+    infra_map_pos_t pos;
+    _infra_map_end(self, &pos);
+    return _infra_map_push_pos(L, self, &pos);
+}
+
+static int _infra_map_at(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    lua_Integer pos = luaL_checkinteger(L, 2);
+    lua_Integer size = (lua_Integer)_infra_map_length(self);
+
+    if (pos < 0)
+    {
+        pos += size + 1;
+    }
+    if (pos < 1 || pos > size)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    infra_map_pos_t it;
+    _infra_map_find_at(self, (size_t)(pos - 1), &it);
+    return _infra_map_push_pos(L, self, &it);
+}
+
+static int _infra_map_rank(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    self->L = L;
+    lua_settop(L, 2);
+
+    size_t cnt = _infra_map_count_less(L, self, 2, 0);
+    lua_pushinteger(L, (lua_Integer)cnt + 1);
+    return 1;
+}
+
+static int _infra_map_count(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    self->L = L;
+    lua_settop(L, 3);
+
+    size_t lo = 0, hi = _infra_map_length(self);
+    if (lua_type(L, 2) != LUA_TNIL)
+    {
+        lo = _infra_map_count_less(L, self, 2, 0);
+    }
+    if (lua_type(L, 3) != LUA_TNIL)
+    {
+        hi = _infra_map_count_less(L, self, 3, 1);
+    }
+
+    lua_pushinteger(L, hi > lo ? (lua_Integer)(hi - lo) : 0);
+    return 1;
+}
+
+static int _infra_map_lower_bound(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    self->L = L;
+    lua_settop(L, 2);
+
+    infra_map_pos_t pos;
+    _infra_map_find_bound(L, self, 2, 0, &pos);
+    return _infra_map_push_pos(L, self, &pos);
+}
+
+static int _infra_map_upper_bound(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    self->L = L;
+    lua_settop(L, 2);
+
+    infra_map_pos_t pos;
+    _infra_map_find_bound(L, self, 2, 1, &pos);
+    return _infra_map_push_pos(L, self, &pos);
+}
+
+/**
+ * @brief Iterator of map:range().
+ *
+ * Upvalue 1 is #infra_map_range_t, upvalue 2 and 3 are the lower and upper
+ * bound, nil for no limit.
+ */
+static int _infra_map_range_next(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    infra_map_range_t* iter = lua_touserdata(L, lua_upvalueindex(1));
+    self->L = L;
+
+    lua_settop(L, 2);
+    lua_pushvalue(L, lua_upvalueindex(2)); /* lo:3 */
+    lua_pushvalue(L, lua_upvalueindex(3)); /* hi:4 */
+    int has_lo = lua_type(L, 3) != LUA_TNIL;
+    int has_hi = lua_type(L, 4) != LUA_TNIL;
+
+    infra_map_pos_t* pos = &iter->pos;
+    if (!iter->reverse)
+    {
+        if (lua_type(L, 2) == LUA_TNIL)
+        {
+            if (has_lo)
+            {
+                _infra_map_find_bound(L, self, 3, 0, pos);
+            }
+            else
+            {
+                _infra_map_begin(self, pos);
+            }
+        }
+        else if (pos->entry != NULL && iter->version == self->version)
+        {
+            _infra_map_next(self, pos);
+        }
+        else
+        {
+            _infra_map_find_bound(L, self, 2, 1, pos);
+        }
+
+        if (pos->entry != NULL && has_hi && _infra_map_compare_entry(L, self, pos->entry, 4) > 0)
+        {
+            pos->entry = NULL;
+        }
+    }
+    else
+    {
+        if (lua_type(L, 2) == LUA_TNIL)
+        {
+            if (has_hi)
+            {
+                _infra_map_find_bound_prev(L, self, 4, 1, pos);
+            }
+            else
+            {
+                _infra_map_end(self, pos);
+            }
+        }
+        else if (pos->entry != NULL && iter->version == self->version)
+        {
+            _infra_map_prev(self, pos);
+        }
+        else
+        {
+            _infra_map_find_bound_prev(L, self, 2, 0, pos);
+        }
+
+        if (pos->entry != NULL && has_lo && _infra_map_compare_entry(L, self, pos->entry, 3) < 0)
+        {
+            pos->entry = NULL;
+        }
+    }
+
+    iter->version = self->version;
+
+    return _infra_map_push_pos(L, self, pos);
+}
+
+static int _infra_map_range(lua_State* L)
+{
+    luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    lua_settop(L, 4);
+
+    infra_map_range_t* iter = lua_newuserdata(L, sizeof(infra_map_range_t));
+    memset(iter, 0, sizeof(*iter));
+    iter->reverse = lua_toboolean(L, 4);
+
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, 3);
+    lua_pushcclosure(L, _infra_map_range_next, 3);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+/**
+ * @brief Nodes collected for bulk loading, linked by rb_right.
+ */
+typedef struct infra_map_load
+{
+    ev_map_node_t*  head;   /**< The first node. */
+    ev_map_node_t*  tail;   /**< The last node. */
+    size_t          size;   /**< The number of nodes. */
+} infra_map_load_t;
+
+/**
+ * @brief Save key at \p kidx and value at \p vidx, and append a node for
+ *   them to \p load.
+ */
+static void _infra_map_load_push(lua_State* L, infra_map_t* self, infra_map_load_t* load,
+    int kidx, int vidx)
+{
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {/* Leaves are filled in order anyway, so just insert. */
+        _infra_map_set(L, self, kidx, vidx, 0);
+        return;
+    }
+
+    infra_key_t key;
+    _infra_map_key_init(L, self, kidx, &key);
+
+    infra_map_node_t* node = ev_slab_alloc(&self->slab);
+    if (node == NULL)
+    {
+        luaL_error(L, "out of memory.");
+        return;
+    }
+
+    node->entry.key = key;
+    node->entry.id = _infra_map_alloc_id(self);
+    _infra_map_set_entry(L, self, node->entry.id, kidx, vidx);
+
+    node->node.rb_right = NULL;
+    if (load->tail == NULL)
+    {
+        load->head = &node->node;
+    }
+    else
+    {
+        load->tail->rb_right = &node->node;
+    }
+    load->tail = &node->node;
+    load->size++;
+}
+
+/**
+ * @brief Check whether \p list is in strictly ascending order.
+ */
+static int _infra_map_list_is_sorted(infra_map_t* self, ev_map_node_t* list)
+{
+    for (; list != NULL && list->rb_right != NULL; list = list->rb_right)
+    {
+        if (_infra_map_node_cmp(self, list, list->rb_right) >= 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Stable merge sort of the first \p size nodes of \p list.
+ */
+static ev_map_node_t* _infra_map_list_sort(infra_map_t* self, ev_map_node_t* list, size_t size)
+{
+    if (size <= 1)
+    {
+        return list;
+    }
+
+    size_t i;
+    ev_map_node_t* left = list;
+    ev_map_node_t* right = list;
+    for (i = 1; i < size / 2; i++)
+    {
+        right = right->rb_right;
+    }
+    ev_map_node_t* tmp = right->rb_right;
+    right->rb_right = NULL;
+    right = tmp;
+
+    left = _infra_map_list_sort(self, left, size / 2);
+    right = _infra_map_list_sort(self, right, size - size / 2);
+
+    ev_map_node_t head;
+    ev_map_node_t* tail = &head;
+    while (left != NULL && right != NULL)
+    {
+        if (_infra_map_node_cmp(self, right, left) < 0)
+        {
+            tail->rb_right = right;
+            right = right->rb_right;
+        }
+        else
+        {
+            tail->rb_right = left;
+            left = left->rb_right;
+        }
+        tail = tail->rb_right;
+    }
+    tail->rb_right = left != NULL ? left : right;
+
+    return head.rb_right;
+}
+
+/**
+ * @brief Remove duplicate keys from sorted \p list, the first one wins.
+ * @return  The number of nodes left.
+ */
+static size_t _infra_map_list_unique(lua_State* L, infra_map_t* self, ev_map_node_t* list, size_t size)
+{
+    while (list != NULL && list->rb_right != NULL)
+    {
+        ev_map_node_t* next = list->rb_right;
+        if (_infra_map_node_cmp(self, list, next) != 0)
+        {
+            list = next;
+            continue;
+        }
+
+        infra_map_node_t* node = container_of(next, infra_map_node_t, node);
+        list->rb_right = next->rb_right;
+        _infra_map_clear_entry(L, self, node->entry.id);
+        _infra_map_free_id(self, node->entry.id);
+        ev_slab_free(&self->slab, node);
+        size--;
+    }
+
+    return size;
+}
+
+/**
+ * @brief Build tree from all collected nodes.
+ * @param[in] sorted    Whether nodes are expected in ascending order. It is
+ *   checked in O(n), and nodes are sorted anyway if not.
+ */
+static void _infra_map_load_finish(lua_State* L, infra_map_t* self, infra_map_load_t* load, int sorted)
+{
+    ev_map_node_t* list = load->head;
+    size_t size = load->size;
+
+    if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        return;
+    }
+
+    if (!sorted || !_infra_map_list_is_sorted(self, list))
+    {
+        list = _infra_map_list_sort(self, list, size);
+        size = _infra_map_list_unique(L, self, list, size);
+    }
+
+    ev_map_build(&self->root, list, size);
+    self->version++;
+}
+
+static int _infra_map_copy_from_table(lua_State* L, infra_map_t* self, int src, int sorted)
+{
+    int sp = lua_gettop(L);
+    infra_map_load_t load = { NULL, NULL, 0 };
+
+    lua_pushnil(L); /* key:sp+1 */
+    while (lua_next(L, src) != 0) /* value:sp+2 */
+    {
+        _infra_map_load_push(L, self, &load, sp + 1, sp + 2);
+        lua_pop(L, 1);
+    }
+
+    _infra_map_load_finish(L, self, &load, sorted);
+    return 0;
+}
+
+static int _infra_map_copy_from_pairs(lua_State* L, infra_map_t* self, int src, int sorted)
+{
+    int sp = lua_gettop(L);
+    infra_map_load_t load = { NULL, NULL, 0 };
+
+    if (luaL_getmetafield(L, src, "__pairs") == 0)
+    {
+        return luaL_error(L, "no metamethod `__pairs`.");
+    }
+    lua_pushvalue(L, src);
+    lua_call(L, 1, 3); /* f:sp+1, s:sp+2, ctl:sp+3 */
+
+    while (1)
+    {
+        lua_pushvalue(L, sp + 1);
+        lua_pushvalue(L, sp + 2);
+        lua_pushvalue(L, sp + 3);
+        lua_call(L, 2, 2); // k:sp+4, v:sp+5
+
+        if (lua_type(L, sp + 4) == LUA_TNIL)
+        {
+            break;
+        }
+        _infra_map_load_push(L, self, &load, sp + 4, sp + 5);
+
+        lua_pop(L, 1); // sp+4
+        lua_replace(L, sp + 3); // sp+3
+    }
+
+    _infra_map_load_finish(L, self, &load, sorted);
+
+    lua_settop(L, sp);
+    return 0;
+}
+
+/**
+ * @brief Copy all key-value pairs from \p src into empty map \p self.
+ * @param[in] sorted    Whether keys of \p src are in ascending order.
+ */
+static int _infra_map_smart_copy(lua_State* L, infra_map_t* self, int src, int sorted)
+{
+    src = lua_absindex(L, src);
+
+    if (lua_type(L, src) == LUA_TTABLE)
+    {
+        return _infra_map_copy_from_table(L, self, src, sorted);
+    }
+
+    /* Another map is always iterated in order. */
+    if (lua_getmetatable(L, src))
+    {
+        luaL_getmetatable(L, INFRA_MAP_NAME);
+        sorted = sorted || lua_rawequal(L, -1, -2);
+        lua_pop(L, 2);
+    }
+
+    int type = luaL_getmetafield(L, src, "__pairs");
+    if (type == LUA_TNIL)
+    {
+        return 0;
+    }
+    lua_pop(L, 1);
+
+    if (type == LUA_TFUNCTION)
+    {
+        return _infra_map_copy_from_pairs(L, self, src, sorted);
+    }
+    return 0;
+}
+
+static int _infra_map_insert_many(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    self->L = L;
+    lua_settop(L, 2);
+
+    size_t size = _infra_map_length(self);
+    if (size == 0 && self->snap_next == NULL)
+    {/* Bulk load is much faster than insert one by one. */
+        _infra_map_copy_from_table(L, self, 2, 0);
+        lua_pushinteger(L, (lua_Integer)_infra_map_length(self));
+        return 1;
+    }
+
+    lua_Integer cnt = 0;
+    lua_pushnil(L); /* key:3 */
+    while (lua_next(L, 2) != 0) /* value:4 */
+    {
+        cnt += _infra_map_set(L, self, 3, 4, 0);
+        lua_pop(L, 1);
+    }
+
+    lua_pushinteger(L, cnt);
+    return 1;
+}
+
+static int _infra_map_find_many(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    self->L = L;
+    lua_settop(L, 2);
+
+    int i, n = (int)luaL_len(L, 2);
+    lua_createtable(L, n, 0); /* result:3 */
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data); /* data:4 */
+
+    for (i = 1; i <= n; i++)
+    {
+        lua_rawgeti(L, 2, i); /* key:5 */
+
+        infra_map_pos_t pos;
+        _infra_map_seek(L, self, 5, INFRA_MAP_SEEK_EQ, &pos);
+        if (pos.entry != NULL)
+        {
+            lua_rawgeti(L, 4, INFRA_MAP_VAL(pos.entry->id));
+            lua_rawseti(L, 3, i);
+        }
+
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 1);
+    return 1;
+}
+
+static int _infra_map_erase_many(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    self->L = L;
+    lua_settop(L, 2);
+
+    lua_Integer cnt = 0;
+    int i, n = (int)luaL_len(L, 2);
+    for (i = 1; i <= n; i++)
+    {
+        lua_rawgeti(L, 2, i); /* key:3 */
+
+        infra_map_pos_t pos;
+        _infra_map_seek(L, self, 3, INFRA_MAP_SEEK_EQ, &pos);
+        if (pos.entry != NULL)
+        {
+            _infra_map_snap_record(L, self, 3);
+            _infra_map_erase_pos(L, self, &pos);
+            cnt++;
+        }
+
+        lua_pop(L, 1);
+    }
+
+    lua_pushinteger(L, cnt);
+    return 1;
+}
+
+static int _infra_map_save(lua_State* L)
+{
+    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    const char* path = luaL_checkstring(L, 2);
+    self->L = L;
+
+    if (self->cmp_type == INFRA_MAP_CMP_LUA)
+    {
+        return luaL_error(L, "cannot save map with Lua comparator.");
+    }
+
+    return infra_map_save(L, 1, path, self->cmp_name, _infra_map_length(self));
+}
+
+typedef struct infra_map_cmp_opt
+{
+    const char*     name;       /**< Name of comparator. */
+    int             cmp_type;   /**< #infra_map_cmp_type_t. */
+    infra_map_cmp_fn cmp;       /**< Comparator in ascending order. */
+    int             reverse;    /**< Whether in descending order. */
+} infra_map_cmp_opt_t;
+
+static const infra_map_cmp_opt_t s_map_cmp_opts[] = {
+    { "reverse",            INFRA_MAP_CMP_DEFAULT,      _infra_map_cmp,             1 },
+    { "integer",            INFRA_MAP_CMP_INTEGER,      _infra_map_cmp_integer,     0 },
+    { "integer_reverse",    INFRA_MAP_CMP_INTEGER,      _infra_map_cmp_integer,     1 },
+    { "number",             INFRA_MAP_CMP_NUMBER,       _infra_map_cmp_number,      0 },
+    { "number_reverse",     INFRA_MAP_CMP_NUMBER,       _infra_map_cmp_number,      1 },
+    { "string",             INFRA_MAP_CMP_STRING,       _infra_map_cmp_string,      0 },
+    { "string_reverse",     INFRA_MAP_CMP_STRING,       _infra_map_cmp_string,      1 },
+    { "string_ci",          INFRA_MAP_CMP_STRING_CI,    _infra_map_cmp_string_ci,   0 },
+    { "string_ci_reverse",  INFRA_MAP_CMP_STRING_CI,    _infra_map_cmp_string_ci,   1 },
+};
+
+/**
+ * @brief Setup comparator of \p self from option at \p idx.
+ */
+static void _infra_map_setup_cmp(lua_State* L, infra_map_t* self, int idx)
+{
+    size_t i;
+
+    self->reverse = 0;
+    self->cmp_type = INFRA_MAP_CMP_DEFAULT;
+    self->cmp = _infra_map_cmp;
+
+    switch (lua_type(L, idx))
+    {
+    case LUA_TNIL:
+        break;
+
+    case LUA_TFUNCTION:
+        lua_pushvalue(L, idx);
+        self->ref_cmp = luaL_ref(L, LUA_REGISTRYINDEX);
+        self->cmp_type = INFRA_MAP_CMP_LUA;
+        self->cmp = _infra_map_cmp_lua;
+        break;
+
+    case LUA_TSTRING:
+        for (i = 0; i < ARRAY_SIZE(s_map_cmp_opts); i++)
+        {
+            if (strcmp(s_map_cmp_opts[i].name, lua_tostring(L, idx)) == 0)
+            {
+                self->cmp_type = s_map_cmp_opts[i].cmp_type;
+                self->cmp = s_map_cmp_opts[i].cmp;
+                self->reverse = s_map_cmp_opts[i].reverse;
+                self->cmp_name = s_map_cmp_opts[i].name;
+                break;
+            }
+        }
+        if (i == ARRAY_SIZE(s_map_cmp_opts))
+        {
+            luaL_error(L, "unknown comparator `%s`.", lua_tostring(L, idx));
+        }
+        break;
+
+    default:
+        luaL_error(L, "unknown value for `cmp`.");
+        break;
+    }
+
+    if (self->engine == INFRA_MAP_ENGINE_BTREE && self->cmp_type == INFRA_MAP_CMP_INTEGER)
+    {
+        ev_btree_init_integer(&self->btree, sizeof(infra_map_entry_t), _infra_map_btree_key, self);
+    }
+    else if (self->engine == INFRA_MAP_ENGINE_BTREE)
+    {
+        ev_btree_init(&self->btree, sizeof(infra_map_entry_t), _infra_map_btree_cmp, self);
+    }
+    else if (self->root.augment != NULL)
+    {
+        ev_map_init_augmented(&self->root, _infra_map_rbtree_cmp, self, self->root.augment);
+    }
+    else
+    {
+        ev_map_init(&self->root, _infra_map_rbtree_cmp, self);
+    }
+}
+
+/**
+ * @brief Get engine from option at \p idx.
+ */
+static int _infra_map_check_engine(lua_State* L, int idx)
+{
+    if (lua_type(L, idx) == LUA_TNIL)
+    {
+        return INFRA_MAP_ENGINE_RBTREE;
+    }
+
+    const char* engine = lua_tostring(L, idx);
+    if (engine != NULL && strcmp(engine, "rbtree") == 0)
+    {
+        return INFRA_MAP_ENGINE_RBTREE;
+    }
+    if (engine != NULL && strcmp(engine, "btree") == 0)
+    {
+        return INFRA_MAP_ENGINE_BTREE;
+    }
+    return luaL_error(L, "unknown value for `engine`.");
+}
+
+static int _infra_map_snap_gc(lua_State* L)
+{
+    infra_map_t* self = lua_touserdata(L, 1);
+
+    _infra_map_snap_detach(L, self->base, self);
+
+    return _infra_map_gc(L);
+}
+
+static infra_map_t* _infra_map_check_snapshot(lua_State* L, int idx)
+{
+    infra_map_t* self = luaL_checkudata(L, idx, INFRA_MAP_SNAPSHOT_NAME);
+    if (self->base == NULL && !self->snap_done)
+    {
+        luaL_error(L, "map is closed.");
+        return NULL;
+    }
+
+    self->L = L;
+    if (self->base != NULL)
+    {
+        self->base->L = L;
+    }
+
+    return self;
+}
+
+/**
+ * @brief Find key at \p idx in snapshot \p self.
+ * @return  1 if found, and key and value are pushed on top of stack. 0 if not.
+ */
+static int _infra_map_snap_lookup(lua_State* L, infra_map_t* self, int idx)
+{
+    infra_map_pos_t pos;
+
+    _infra_map_seek(L, self, idx, INFRA_MAP_SEEK_EQ, &pos);
+    if (pos.entry != NULL)
+    {
+        _infra_map_push_entry(L, self, pos.entry);
+        if (lua_touserdata(L, -1) == &s_map_absent)
+        {
+            lua_pop(L, 2);
+            return 0;
+        }
+        return 1;
+    }
+
+    if (self->base == NULL)
+    {
+        return 0;
+    }
+    _infra_map_seek(L, self->base, idx, INFRA_MAP_SEEK_EQ, &pos);
+    if (pos.entry == NULL)
+    {
+        return 0;
+    }
+    _infra_map_push_entry(L, self->base, pos.entry);
+    return 1;
+}
+
+/**
+ * @brief Find the first entry in snapshot \p self that after key at \p idx.
+ *
+ * Both the snapshot and the live map are searched, the nearest key wins, and
+ * keys that did not exist when \p self was taken are skipped.
+ *
+ * @param[in] idx       Stack index of key, or 0 to start from the very first
+ *                      (or last, if \p reverse is set) entry.
+ * @param[in] upper     Same as #_infra_map_find_bound() (or
+ *                      #_infra_map_find_bound_prev(), if \p reverse is set).
+ * @param[in] reverse   Search from high to low.
+ * @return              1 if found, and key and value are pushed on top of
+ *                      stack. 0 if not.
+ */
+static int _infra_map_snap_bound(lua_State* L, infra_map_t* self, int idx, int upper, int reverse)
+{
+    int sp = lua_gettop(L);
+    int has_probe = idx != 0;
+
+    lua_pushnil(L); /* best:sp+1 */
+    if (has_probe)
+    {
+        lua_pushvalue(L, idx); /* probe:sp+2 */
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+
+    while (1)
+    {
+        int has_best = 0;
+        infra_map_t* map = self;
+
+        while (1)
+        {
+            infra_map_pos_t pos;
+            if (!reverse)
+            {
+                if (has_probe)
+                {
+                    _infra_map_find_bound(L, map, sp + 2, upper, &pos);
+                }
+                else
+                {
+                    _infra_map_begin(map, &pos);
+                }
+            }
+            else
+            {
+                if (has_probe)
+                {
+                    _infra_map_find_bound_prev(L, map, sp + 2, upper, &pos);
+                }
+                else
+                {
+                    _infra_map_end(map, &pos);
+                }
+            }
+
+            if (pos.entry != NULL)
+            {
+                int ret = has_best ? _infra_map_compare_entry(L, map, pos.entry, sp + 1) : 0;
+                if (!has_best || (reverse ? ret > 0 : ret < 0))
+                {
+                    _infra_map_push_key(L, map, pos.entry);
+                    lua_replace(L, sp + 1);
+                    has_best = 1;
+                }
+            }
+
+            if (map == self->base || self->base == NULL)
+            {
+                break;
+            }
+            map = self->base;
+        }
+
+        if (!has_best)
+        {
+            lua_settop(L, sp);
+            return 0;
+        }
+
+        if (_infra_map_snap_lookup(L, self, sp + 1)) /* key:sp+3, value:sp+4 */
+        {
+            lua_replace(L, sp + 2);
+            lua_replace(L, sp + 1);
+            return 1;
+        }
+
+        /* The key was added after snapshot, skip it. */
+        lua_pushvalue(L, sp + 1);
+        lua_replace(L, sp + 2);
+        has_probe = 1;
+        upper = !reverse;
+    }
+}
+
+/**
+ * @brief Compare key at \p idx1 with key at \p idx2.
+ */
+static int _infra_map_compare_stack(lua_State* L, infra_map_t* self, int idx1, int idx2)
+{
+    infra_map_entry_t e1, e2;
+    _infra_map_init_probe(L, self, &e1, idx1);
+    _infra_map_init_probe(L, self, &e2, idx2);
+
+    return _infra_map_entry_cmp(self, &e1, &e2);
+}
+
+static int _infra_map_snap_size(lua_State* L)
+{
+    infra_map_t* self = _infra_map_check_snapshot(L, 1);
+    lua_pushinteger(L, (lua_Integer)self->snap_size);
+    return 1;
+}
+
+static int _infra_map_snap_find(lua_State* L)
+{
+    infra_map_t* self = _infra_map_check_snapshot(L, 1);
+    lua_settop(L, 2);
+
+    if (!_infra_map_snap_lookup(L, self, 2))
+    {
+        lua_pushboolean(L, 0);
+        lua_pushnil(L);
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+    lua_replace(L, -3);
+    return 2;
 }
 
-static void _infra_map_erase_node(lua_State* L, infra_map_t* self, infra_map_node_t* node)
+static int _infra_map_snap_pairs_next(lua_State* L)
 {
-    ev_map_erase(&self->root, &node->node);
+    infra_map_t* self = _infra_map_check_snapshot(L, 1);
+    lua_settop(L, 2);
 
-    luaL_unref(L, LUA_REGISTRYINDEX, node->refk);
-    node->refk = LUA_NOREF;
+    int idx = lua_type(L, 2) == LUA_TNIL ? 0 : 2;
+    if (!_infra_map_snap_bound(L, self, idx, 1, 0))
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+    return 2;
+}
 
-    luaL_unref(L, LUA_REGISTRYINDEX, node->refv);
-    node->refv = LUA_NOREF;
+static int _infra_map_snap_pairs(lua_State* L)
+{
+    _infra_map_check_snapshot(L, 1);
 
-    free(node);
+    lua_pushcfunction(L, _infra_map_snap_pairs_next);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
 }
 
-static int _infra_map_gc(lua_State* L)
+/**
+ * @brief Push key and value of first (or last, if \p reverse is set) entry
+ *   not less than (or greater than, if \p upper is set) key at \p idx.
+ */
+static int _infra_map_snap_push_bound(lua_State* L, int idx, int upper, int reverse)
 {
-    infra_map_t* self = lua_touserdata(L, 1);
+    infra_map_t* self = _infra_map_check_snapshot(L, 1);
+    lua_settop(L, 2);
 
-    ev_map_node_t* it = ev_map_begin(&self->root);
-    while (it != NULL)
+    if (!_infra_map_snap_bound(L, self, idx, upper, reverse))
     {
-        infra_map_node_t* node = container_of(it, infra_map_node_t, node);
-        it = ev_map_next(it);
-
-        _infra_map_erase_node(L, self, node);
+        lua_pushnil(L);
+        return 1;
     }
-
-    return 0;
+    return 2;
 }
 
-static int _infra_map_size(lua_State* L)
+static int _infra_map_snap_first(lua_State* L)
 {
-    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    return _infra_map_snap_push_bound(L, 0, 0, 0);
+}
 
-    size_t size = ev_map_size(&self->root);
-    lua_pushinteger(L, size);
-    return 1;
+static int _infra_map_snap_last(lua_State* L)
+{
+    return _infra_map_snap_push_bound(L, 0, 0, 1);
 }
 
-static int _infra_map_insert(lua_State* L)
+static int _infra_map_snap_lower_bound(lua_State* L)
 {
-    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
-    self->L = L;
+    return _infra_map_snap_push_bound(L, 2, 0, 0);
+}
 
-    infra_map_node_t* node = malloc(sizeof(infra_map_node_t));
-    if (node == NULL)
-    {
-        return luaL_error(L, "out of memory.");
-    }
+static int _infra_map_snap_upper_bound(lua_State* L)
+{
+    return _infra_map_snap_push_bound(L, 2, 1, 0);
+}
 
-    lua_pushvalue(L, 2);
-    node->refk = luaL_ref(L, LUA_REGISTRYINDEX);
+/**
+ * @brief Iterator of snapshot:range().
+ *
+ * Upvalue 1 and 2 are the lower and upper bound, nil for no limit. Upvalue 3
+ * is whether iterate from high to low.
+ */
+static int _infra_map_snap_range_next(lua_State* L)
+{
+    infra_map_t* self = _infra_map_check_snapshot(L, 1);
 
-    lua_pushvalue(L, 3);
-    node->refv = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_settop(L, 2);
+    lua_pushvalue(L, lua_upvalueindex(1)); /* lo:3 */
+    lua_pushvalue(L, lua_upvalueindex(2)); /* hi:4 */
+    int has_lo = lua_type(L, 3) != LUA_TNIL;
+    int has_hi = lua_type(L, 4) != LUA_TNIL;
+    int reverse = lua_toboolean(L, lua_upvalueindex(3));
 
-    ev_map_node_t* orig = ev_map_insert(&self->root, &node->node);
-    if (orig != NULL)
+    int found;
+    if (!reverse)
     {
-        luaL_unref(L, LUA_REGISTRYINDEX, node->refk);
-        node->refk = LUA_NOREF;
-        luaL_unref(L, LUA_REGISTRYINDEX, node->refv);
-        node->refv = LUA_NOREF;
-        free(node);
+        if (lua_type(L, 2) == LUA_TNIL)
+        {
+            found = _infra_map_snap_bound(L, self, has_lo ? 3 : 0, 0, 0);
+        }
+        else
+        {
+            found = _infra_map_snap_bound(L, self, 2, 1, 0);
+        }
 
-        lua_pushboolean(L, 0);
+        if (found && has_hi && _infra_map_compare_stack(L, self, -2, 4) > 0)
+        {
+            found = 0;
+        }
     }
     else
     {
-        lua_pushboolean(L, 1);
+        if (lua_type(L, 2) == LUA_TNIL)
+        {
+            found = _infra_map_snap_bound(L, self, has_hi ? 4 : 0, 1, 1);
+        }
+        else
+        {
+            found = _infra_map_snap_bound(L, self, 2, 0, 1);
+        }
+
+        if (found && has_lo && _infra_map_compare_stack(L, self, -2, 3) < 0)
+        {
+            found = 0;
+        }
     }
 
-    return 1;
+    if (!found)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+    return 2;
 }
 
-static int _infra_map_replace(lua_State* L)
+static int _infra_map_snap_range(lua_State* L)
+{
+    _infra_map_check_snapshot(L, 1);
+    lua_settop(L, 4);
+
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, 3);
+    lua_pushboolean(L, lua_toboolean(L, 4));
+    lua_pushcclosure(L, _infra_map_snap_range_next, 3);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+static int _infra_map_snapshot(lua_State* L)
 {
     infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
-    self->L = L;
 
-    infra_map_node_t* node = malloc(sizeof(infra_map_node_t));
-    if (node == NULL)
+    infra_map_t* snap = lua_newuserdata(L, sizeof(infra_map_t));
+
+    memset(snap, 0, sizeof(*snap));
+    snap->engine = INFRA_MAP_ENGINE_RBTREE;
+    snap->L = L;
+    snap->ref_data = LUA_NOREF;
+    snap->ref_cmp = LUA_NOREF;
+    snap->ref_base = LUA_NOREF;
+    snap->ref_fill = LUA_NOREF;
+    snap->cmp_type = self->cmp_type;
+    snap->cmp = self->cmp;
+    snap->reverse = self->reverse;
+    snap->cmp_name = self->cmp_name;
+    ev_map_init(&snap->root, _infra_map_rbtree_cmp, snap);
+    ev_slab_init(&snap->slab, sizeof(infra_map_node_t));
+
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _infra_map_snap_gc },
+        { "__pairs",    _infra_map_snap_pairs },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_method[] = {
+        { "size",       _infra_map_snap_size },
+        { "find",       _infra_map_snap_find },
+        { "pairs",      _infra_map_snap_pairs },
+        { "first",      _infra_map_snap_first },
+        { "last",       _infra_map_snap_last },
+        { "lower_bound", _infra_map_snap_lower_bound },
+        { "upper_bound", _infra_map_snap_upper_bound },
+        { "range",      _infra_map_snap_range },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, INFRA_MAP_SNAPSHOT_NAME) != 0)
     {
-        return luaL_error(L, "out of memory.");
+        luaL_setfuncs(L, s_meta, 0);
+
+        /* metatable.__index = s_method */
+        luaL_newlib(L, s_method);
+        lua_setfield(L, -2, "__index");
     }
+    lua_setmetatable(L, -2);
 
-    lua_pushvalue(L, 2);
-    node->refk = luaL_ref(L, LUA_REGISTRYINDEX);
-    lua_pushvalue(L, 3);
-    node->refv = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_newtable(L);
+    snap->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
 
-    ev_map_node_t* orig = ev_map_insert(&self->root, &node->node);
-    if (orig == NULL)
+    if (self->ref_cmp != LUA_NOREF)
     {
-        return 0;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_cmp);
+        snap->ref_cmp = luaL_ref(L, LUA_REGISTRYINDEX);
     }
 
-    infra_map_node_t* orig_node = container_of(orig, infra_map_node_t, node);
-    _infra_map_erase_node(L, self, orig_node);
+    lua_pushvalue(L, 1);
+    snap->ref_base = luaL_ref(L, LUA_REGISTRYINDEX);
+    snap->base = self;
+    snap->snap_size = _infra_map_length(self);
 
-    orig = ev_map_insert(&self->root, &node->node);
-    assert(orig == NULL);
+    snap->snap_next = self->snap_next;
+    if (self->snap_next != NULL)
+    {
+        self->snap_next->snap_prev = snap;
+    }
+    self->snap_next = snap;
 
-    return 0;
+    return 1;
 }
 
-static int _infra_map_erase(lua_State* L)
+/**
+ * @brief Push a new empty map that has the same engine and comparator as
+ *   \p self.
+ */
+static infra_map_t* _infra_map_push_like(lua_State* L, infra_map_t* self)
 {
-    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
-    self->L = L;
+    infra_map_t* dst = lua_newuserdata(L, sizeof(infra_map_t));
+
+    memset(dst, 0, sizeof(*dst));
+    dst->engine = self->engine;
+    dst->L = L;
+    dst->ref_data = LUA_NOREF;
+    dst->ref_cmp = LUA_NOREF;
+    if (self->root.augment != NULL)
+    {
+        ev_map_init_augmented(&dst->root, _infra_map_rbtree_cmp, dst, _infra_map_rank_augment);
+        ev_slab_init(&dst->slab, sizeof(infra_map_rank_node_t));
+    }
+    else
+    {
+        ev_map_init(&dst->root, _infra_map_rbtree_cmp, dst);
+        ev_slab_init(&dst->slab, sizeof(infra_map_node_t));
+    }
 
-    infra_map_node_t tmp_node;
-    lua_pushvalue(L, 2);
-    tmp_node.refk = luaL_ref(L, LUA_REGISTRYINDEX);
+    /* The metatable is always registered by the time a map exists. */
+    luaL_getmetatable(L, INFRA_MAP_NAME);
+    lua_setmetatable(L, -2);
 
-    ev_map_node_t* it = ev_map_find(&self->root, &tmp_node.node);
-    luaL_unref(L, LUA_REGISTRYINDEX, tmp_node.refk);
+    lua_newtable(L);
+    dst->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
 
-    if (it == NULL)
+    if (self->cmp_type == INFRA_MAP_CMP_LUA)
     {
-        lua_pushboolean(L, 0);
-        return 1;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_cmp);
     }
+    else if (self->cmp_name != NULL)
+    {
+        lua_pushstring(L, self->cmp_name);
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+    _infra_map_setup_cmp(L, dst, -1);
+    lua_pop(L, 1);
 
-    infra_map_node_t* node = container_of(it, infra_map_node_t, node);
-    _infra_map_erase_node(L, self, node);
-
-    lua_pushboolean(L, 1);
-    return 1;
+    return dst;
 }
 
-static int _infra_map_pairs_next(lua_State* L)
+/**
+ * @brief Raise an error if \p self and \p other do not order keys the same.
+ */
+static void _infra_map_check_same_order(lua_State* L, infra_map_t* self, infra_map_t* other)
 {
-    ev_map_node_t* it = NULL;
-    infra_map_node_t* node = NULL;
-
-    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
-    self->L = L;
+    int same = self->cmp_type == other->cmp_type && self->reverse == other->reverse;
 
-    if (lua_type(L, 2) == LUA_TNIL)
+    if (same && self->cmp_type == INFRA_MAP_CMP_LUA)
     {
-        if ((it = ev_map_begin(&self->root)) == NULL)
-        {
-            goto return_nil;
-        }
-
-        goto return_node;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_cmp);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, other->ref_cmp);
+        same = lua_rawequal(L, -1, -2);
+        lua_pop(L, 2);
     }
 
-    infra_map_node_t tmp_node;
-    lua_pushvalue(L, 2);
-    tmp_node.refk = luaL_ref(L, LUA_REGISTRYINDEX);
+    if (!same)
+    {
+        luaL_error(L, "maps must have the same comparator.");
+    }
+}
 
-    it = ev_map_find_upper(&self->root, &tmp_node.node);
-    luaL_unref(L, LUA_REGISTRYINDEX, tmp_node.refk);
+/**
+ * @brief Compare entry \p e1 of \p self with entry \p e2 of \p other.
+ */
+static int _infra_map_cross_cmp(lua_State* L, infra_map_t* self, const infra_map_entry_t* e1,
+    infra_map_t* other, const infra_map_entry_t* e2)
+{
+    int ret;
 
-    if (it == NULL)
+    switch (self->cmp_type)
     {
-        goto return_nil;
+    case INFRA_MAP_CMP_LUA:
+        break;
+
+    case INFRA_MAP_CMP_DEFAULT:
+        if (infra_key_compare(&e1->key, &e2->key, &ret))
+        {
+            return self->reverse ? -ret : ret;
+        }
+        break;
+
+    default:
+        /* Typed comparators only look at native copies. */
+        return _infra_map_entry_cmp(self, e1, e2);
     }
 
-return_node:
-    node = container_of(it, infra_map_node_t, node);
-    lua_rawgeti(L, LUA_REGISTRYINDEX, node->refk);
-    lua_rawgeti(L, LUA_REGISTRYINDEX, node->refv);
-    return 2;
+    /* The key of \p e2 lives in data table of \p other, so compare it on stack. */
+    _infra_map_push_key(L, other, e2);
+    infra_map_entry_t probe;
+    probe.key = e2->key;
+    probe.id = -lua_gettop(L);
 
-return_nil:
-    lua_pushnil(L);
-    return 1;
-}
+    ret = _infra_map_entry_cmp(self, e1, &probe);
+    lua_pop(L, 1);
 
-static int _infra_map_meta_pairs(lua_State* L)
-{
-    lua_pushcfunction(L, _infra_map_pairs_next);
-    lua_pushvalue(L, 1);
-    lua_pushnil(L);
-    return 3;
+    return ret;
 }
 
-static int _infra_map_pairs(lua_State* L)
+/**
+ * @brief Walk two maps of the same order side by side.
+ */
+typedef struct infra_map_join
 {
-    luaL_checkudata(L, 1, INFRA_MAP_NAME);
-    return _infra_map_meta_pairs(L);
+    infra_map_t*    m1;         /**< The first map. */
+    infra_map_t*    m2;         /**< The second map. */
+    infra_map_pos_t p1;         /**< Current entry of #infra_map_join::m1. */
+    infra_map_pos_t p2;         /**< Current entry of #infra_map_join::m2. */
+    size_t          v1;         /**< Version of #infra_map_join::m1 when started. */
+    size_t          v2;         /**< Version of #infra_map_join::m2 when started. */
+} infra_map_join_t;
+
+/**
+ * @brief Start walking map at index 1 and map at index 2.
+ */
+static void _infra_map_join_init(lua_State* L, infra_map_join_t* join)
+{
+    join->m1 = luaL_checkudata(L, 1, INFRA_MAP_NAME);
+    join->m2 = luaL_checkudata(L, 2, INFRA_MAP_NAME);
+    join->m1->L = L;
+    join->m2->L = L;
+    _infra_map_check_same_order(L, join->m1, join->m2);
+
+    _infra_map_begin(join->m1, &join->p1);
+    _infra_map_begin(join->m2, &join->p2);
+    join->v1 = join->m1->version;
+    join->v2 = join->m2->version;
 }
 
-static int _infra_map_find(lua_State* L)
+/**
+ * @brief Compare current entries.
+ * @return  Negative if only the first map has the smallest key, positive if
+ *   only the second map has it, or 0 if both have it.
+ */
+static int _infra_map_join_cmp(lua_State* L, infra_map_join_t* join)
 {
-    infra_map_t* self = luaL_checkudata(L, 1, INFRA_MAP_NAME);
-    self->L = L;
-
-    infra_map_node_t tmp_node;
-    lua_pushvalue(L, 2);
-    tmp_node.refk = luaL_ref(L, LUA_REGISTRYINDEX);
+    if (join->p1.entry == NULL)
+    {
+        return 1;
+    }
+    if (join->p2.entry == NULL)
+    {
+        return -1;
+    }
 
-    ev_map_node_t* it = ev_map_find(&self->root, &tmp_node.node);
-    luaL_unref(L, LUA_REGISTRYINDEX, tmp_node.refk);
+    int ret = _infra_map_cross_cmp(L, join->m1, join->p1.entry, join->m2, join->p2.entry);
 
-    if (it == NULL)
+    /* Lua comparators and metamethods can do anything. */
+    if (join->m1->version != join->v1 || join->m2->version != join->v2)
     {
-        lua_pushboolean(L, 0);
-        lua_pushnil(L);
-        return 2;
+        return luaL_error(L, "map is modified during join.");
     }
 
-    infra_map_node_t* node = container_of(it, infra_map_node_t, node);
-
-    lua_pushboolean(L, 1);
-    lua_rawgeti(L, LUA_REGISTRYINDEX, node->refv);
+    return ret;
+}
 
-    return 2;
+/**
+ * @brief Set operations.
+ */
+typedef enum infra_map_setop
+{
+    INFRA_MAP_SETOP_UNION,      /**< Keys in either map. */
+    INFRA_MAP_SETOP_INTERSECT,  /**< Keys in both maps. */
+    INFRA_MAP_SETOP_DIFF,       /**< Keys only in the first map. */
+} infra_map_setop_t;
+
+/**
+ * @brief Append entry at \p pos of \p src into \p dst.
+ */
+static void _infra_map_setop_take(lua_State* L, infra_map_t* dst, infra_map_load_t* load,
+    infra_map_t* src, const infra_map_pos_t* pos)
+{
+    _infra_map_push_entry(L, src, pos->entry);
+    _infra_map_load_push(L, dst, load, -2, -1);
+    lua_pop(L, 2);
 }
 
-static int _infra_map_copy_from_table(lua_State* L, int dst, int src)
+static int _infra_map_setop(lua_State* L, int op)
 {
-    int sp = lua_gettop(L);
+    infra_map_join_t join;
+    lua_settop(L, 2);
+    _infra_map_join_init(L, &join);
 
-    lua_pushnil(L); /* key:sp+1 */
-    while (lua_next(L, src) != 0) /* value:sp+2 */
+    infra_map_load_t load = { NULL, NULL, 0 };
+    infra_map_t* dst = _infra_map_push_like(L, join.m1);
+
+    while (join.p1.entry != NULL || (op == INFRA_MAP_SETOP_UNION && join.p2.entry != NULL))
     {
-        lua_pushcfunction(L, _infra_map_insert);
-        lua_pushvalue(L, dst);
-        lua_pushvalue(L, sp + 1);
-        lua_pushvalue(L, sp + 2);
-        lua_call(L, 3, 0);
+        if (join.p2.entry == NULL && op == INFRA_MAP_SETOP_INTERSECT)
+        {
+            break;
+        }
 
-        lua_pop(L, 1);
+        int ret = _infra_map_join_cmp(L, &join);
+        if (ret < 0)
+        {
+            if (op != INFRA_MAP_SETOP_INTERSECT)
+            {
+                _infra_map_setop_take(L, dst, &load, join.m1, &join.p1);
+            }
+            _infra_map_next(join.m1, &join.p1);
+        }
+        else if (ret > 0)
+        {
+            if (op == INFRA_MAP_SETOP_UNION)
+            {
+                _infra_map_setop_take(L, dst, &load, join.m2, &join.p2);
+            }
+            _infra_map_next(join.m2, &join.p2);
+        }
+        else
+        {
+            if (op != INFRA_MAP_SETOP_DIFF)
+            {
+                _infra_map_setop_take(L, dst, &load, join.m1, &join.p1);
+            }
+            _infra_map_next(join.m1, &join.p1);
+            _infra_map_next(join.m2, &join.p2);
+        }
     }
 
-    return 0;
+    _infra_map_load_finish(L, dst, &load, 1);
+    return 1;
 }
 
-static int _infra_map_copy_from_pairs(lua_State* L, int dst, int src)
+static int _infra_map_union(lua_State* L)
 {
-    int sp = lua_gettop(L);
-    if (luaL_callmeta(L, src, "__pairs") == 0)
-    {
-        return luaL_error(L, "no metamethod `__pairs`.");
-    }
-    lua_settop(L, sp + 3);
-
-    while (1)
-    {
-        lua_pushvalue(L, sp + 1);
-        lua_pushvalue(L, sp + 2);
-        lua_pushvalue(L, sp + 3);
-        lua_call(L, 2, 2); // k:sp+4, v:sp+5
-
-        lua_pushcfunction(L, _infra_map_insert); // sp+6
-        lua_pushvalue(L, dst); // sp+7
-        lua_pushvalue(L, sp + 4); // sp+8
-        lua_pushvalue(L, sp + 5); // sp+9
-        lua_call(L, 3, 0); // sp+5
+    return _infra_map_setop(L, INFRA_MAP_SETOP_UNION);
+}
 
-        lua_replace(L, sp + 3); // sp+4
-        lua_replace(L, sp + 2); // sp+3
-    }
+static int _infra_map_intersect(lua_State* L)
+{
+    return _infra_map_setop(L, INFRA_MAP_SETOP_INTERSECT);
+}
 
-    lua_settop(L, sp);
-    return 0;
+static int _infra_map_diff(lua_State* L)
+{
+    return _infra_map_setop(L, INFRA_MAP_SETOP_DIFF);
 }
 
-static int _infra_map_smart_copy(lua_State* L, int dst, int src)
+static int _infra_map_merge_join(lua_State* L)
 {
-    src = lua_absindex(L, src);
-    dst = lua_absindex(L, dst);
+    infra_map_join_t join;
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    lua_settop(L, 3);
+    _infra_map_join_init(L, &join);
 
-    if (lua_type(L, src) == LUA_TTABLE)
+    lua_Integer cnt = 0;
+    while (join.p1.entry != NULL && join.p2.entry != NULL)
     {
-        return _infra_map_copy_from_table(L, dst, src);
-    }
+        int ret = _infra_map_join_cmp(L, &join);
+        if (ret < 0)
+        {
+            _infra_map_next(join.m1, &join.p1);
+            continue;
+        }
+        if (ret > 0)
+        {
+            _infra_map_next(join.m2, &join.p2);
+            continue;
+        }
 
-    int type = luaL_getmetafield(L, src, "__pairs");
-    if (type == LUA_TNIL)
-    {
-        return 0;
-    }
-    lua_pop(L, 1);
+        lua_pushvalue(L, 3);
+        _infra_map_push_entry(L, join.m1, join.p1.entry);
+        _infra_map_push_value(L, join.m2, join.p2.entry);
+        lua_call(L, 3, 0);
+        cnt++;
 
-    if (type == LUA_TFUNCTION)
-    {
-        return _infra_map_copy_from_pairs(L, dst, src);
+        if (join.m1->version != join.v1 || join.m2->version != join.v2)
+        {
+            return luaL_error(L, "map is modified during join.");
+        }
+        _infra_map_next(join.m1, &join.p1);
+        _infra_map_next(join.m2, &join.p2);
     }
-    return 0;
+
+    lua_pushinteger(L, cnt);
+    return 1;
 }
 
 static int _infra_new_map(lua_State* L)
 {
     int sp = lua_gettop(L);
+
+    int sorted = 0, rank = 0, engine = INFRA_MAP_ENGINE_RBTREE;
+    if (sp >= 2 && lua_type(L, 2) == LUA_TTABLE)
+    {
+        lua_getfield(L, 2, "sorted");
+        sorted = lua_toboolean(L, -1);
+        lua_getfield(L, 2, "rank");
+        rank = lua_toboolean(L, -1);
+        lua_getfield(L, 2, "engine");
+        engine = _infra_map_check_engine(L, -1);
+        lua_pop(L, 3);
+    }
+
     infra_map_t* self = lua_newuserdata(L, sizeof(infra_map_t));
 
+    memset(self, 0, sizeof(*self));
+    self->engine = engine;
     self->L = L;
-    ev_map_init(&self->root, _infra_map_cmp, self);
+    self->ref_data = LUA_NOREF;
+    self->ref_cmp = LUA_NOREF;
+    self->cmp_type = INFRA_MAP_CMP_DEFAULT;
+    self->cmp = _infra_map_cmp;
+    if (rank && engine == INFRA_MAP_ENGINE_RBTREE)
+    {
+        ev_map_init_augmented(&self->root, _infra_map_rbtree_cmp, self, _infra_map_rank_augment);
+        ev_slab_init(&self->slab, sizeof(infra_map_rank_node_t));
+    }
+    else
+    {
+        ev_map_init(&self->root, _infra_map_rbtree_cmp, self);
+        ev_slab_init(&self->slab, sizeof(infra_map_node_t));
+    }
 
     static const luaL_Reg s_meta[] = {
         { "__gc",       _infra_map_gc },
@@ -341,6 +2559,24 @@ static int _infra_new_map(lua_State* L)
         { "erase",      _infra_map_erase },
         { "find",       _infra_map_find },
         { "pairs",      _infra_map_pairs },
+        { "memstat",    _infra_map_memstat },
+        { "first",      _infra_map_first },
+        { "last",       _infra_map_last },
+        { "lower_bound", _infra_map_lower_bound },
+        { "upper_bound", _infra_map_upper_bound },
+        { "range",      _infra_map_range },
+        { "at",         _infra_map_at },
+        { "rank",       _infra_map_rank },
+        { "count",      _infra_map_count },
+        { "insert_many", _infra_map_insert_many },
+        { "find_many",  _infra_map_find_many },
+        { "erase_many", _infra_map_erase_many },
+        { "snapshot",   _infra_map_snapshot },
+        { "save",       _infra_map_save },
+        { "union",      _infra_map_union },
+        { "intersect",  _infra_map_intersect },
+        { "diff",       _infra_map_diff },
+        { "merge_join", _infra_map_merge_join },
         { NULL,         NULL },
     };
     if (luaL_newmetatable(L, INFRA_MAP_NAME) != 0)
@@ -353,9 +2589,23 @@ static int _infra_new_map(lua_State* L)
     }
     lua_setmetatable(L, -2);
 
+    lua_newtable(L);
+    self->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (sp >= 2 && lua_type(L, 2) == LUA_TTABLE)
+    {
+        lua_getfield(L, 2, "cmp");
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+    _infra_map_setup_cmp(L, self, -1);
+    lua_pop(L, 1);
+
     if (sp >= 1)
     {
-        _infra_map_smart_copy(L, -1, 1);
+        _infra_map_smart_copy(L, self, 1, sorted);
     }
 
     return 1;
@@ -366,12 +2616,42 @@ const infra_lua_api_t infra_f_map = {
 "Create a new empty map.",
 
 "[SYNOPSIS]\n"
-"map make_map()\n"
+"map make_map([src[, opt]])\n"
 "\n"
 "[DESCRIPTION]\n"
 "Create a new empty map. A map is a red-black tree that able to contains strings,\n"
 "booleans, integers as it's key and anything as it's value.\n"
 "\n"
+"If `src` is a table or an object with `__pairs` metamethod, all key-value\n"
+"pairs are copied into the new map. The keys are sorted once and the tree is\n"
+"built in O(n) after the sort. If `opt.sorted` is true, `src` is expected to\n"
+"be iterated in ascending order, so the sort is skipped. Unsorted input is\n"
+"detected in O(n) and sorted anyway.\n"
+"\n"
+"By default keys are ordered as `compare()`. `opt.cmp` changes the order, it\n"
+"can be a Lua function that returns a number like `compare()`, or one of the\n"
+"native comparators:\n"
+"  + `integer`: Keys must be integers.\n"
+"  + `number`: Keys must be numbers.\n"
+"  + `string`: Keys must be strings, compared byte by byte.\n"
+"  + `string_ci`: Keys must be strings, compared ignoring case.\n"
+"Add suffix `_reverse` (e.g. `string_ci_reverse`) for descending order, or\n"
+"use `reverse` to reverse the default order. Typed maps raise an error for\n"
+"keys of other types.\n"
+"\n"
+"If `opt.rank` is true, every node also keeps the size of its subtree, so that\n"
+"`at()`, `rank()` and `count()` cost O(log n) instead of O(n).\n"
+"\n"
+"`opt.engine` selects how entries are stored:\n"
+"  + `rbtree`: The default. One red-black tree node per entry.\n"
+"  + `btree`: A B+tree that keeps entries contiguously in nodes of a few cache\n"
+"    lines. It uses much less memory and is faster to search and iterate for\n"
+"    large maps. With `integer` comparator, keys are kept in a separate array\n"
+"    in every node, which makes nodes wider and searched without calling the\n"
+"    comparator. `at()`, `rank()` and `count()` cost O(n/B) where B is the\n"
+"    number of entries in one node, and `opt.rank` is ignored.\n"
+"The API and order of keys are the same for both engines.\n"
+"\n"
 "A map have following metamethod:\n"
 "  integer map:size()\n"
 "    Return the number of elements.\n"
@@ -388,5 +2668,67 @@ const infra_lua_api_t infra_f_map = {
 "  map:pairs()\n"
 "    Use in `for k,v in map:pairs() do ... end`. This is mainly for lua5.1 and\n"
 "    luajit. If you are using lua5.2 and above, just use normal `pairs()` to\n"
-"    iterate over all key-value pairs.\n"
+"    iterate over all key-value pairs. Each step is O(1) as long as the map is\n"
+"    not modified. It is safe to modify the map during iteration.\n"
+"  table map:memstat()\n"
+"    Return memory statistics of node allocator, as a table with fields:\n"
+"    + `chunks`: The number of memory chunks.\n"
+"    + `nodes`: The number of nodes in use.\n"
+"    + `bytes`: Total bytes of memory chunks.\n"
+"    For `btree` engine, every B+tree node is a chunk.\n"
+"  any,any map:first()\n"
+"    Return the smallest key and it's value, or nil if map is empty.\n"
+"  any,any map:last()\n"
+"    Return the largest key and it's value, or nil if map is empty.\n"
+"  any,any map:lower_bound(key)\n"
+"    Return the first key that not less than `key` and it's value, or nil if\n"
+"    not found.\n"
+"  any,any map:upper_bound(key)\n"
+"    Return the first key that greater than `key` and it's value, or nil if\n"
+"    not found.\n"
+"  map:range(lo, hi[, reverse])\n"
+"    Use in `for k,v in map:range(lo, hi) do ... end` to iterate over keys in\n"
+"    [lo, hi]. A nil bound means no limit. If `reverse` is true, iterate from\n"
+"    `hi` down to `lo`. It costs O(log n + k) to visit k keys.\n"
+"  any,any map:at(pos)\n"
+"    Return the key at position `pos` (start from 1) and it's value, or nil if\n"
+"    out of range. A negative `pos` counts from the end.\n"
+"  integer map:rank(key)\n"
+"    Return the position of the first key that not less than `key`.\n"
+"  integer map:count([lo[, hi]])\n"
+"    Return the number of keys in [lo, hi]. A nil bound means no limit.\n"
+"  integer map:insert_many(t)\n"
+"    Insert all key-value pairs of table `t`, existing keys are not changed.\n"
+"    Return the number of inserted keys.\n"
+"  table map:find_many(keys)\n"
+"    Find all keys in array `keys`, return an array in which the i-th element\n"
+"    is the value of `keys[i]`, or nil if not found.\n"
+"  integer map:erase_many(keys)\n"
+"    Erase all keys in array `keys`, return the number of erased keys.\n"
+"  snapshot map:snapshot()\n"
+"    Return a read-only view of current content of the map in O(1). Later\n"
+"    modifications of the map save the original entries into the snapshot,\n"
+"    and also copy two more entries into it, so each modification costs an\n"
+"    extra O(log n) for each snapshot. After at most as many modifications\n"
+"    as it has entries, a snapshot holds a full copy of them and no longer\n"
+"    slows down modifications. Reading a snapshot costs O(log n) no matter\n"
+"    how many snapshots there are or how much the map has grown. A snapshot\n"
+"    supports `size()`, `find()`, `pairs()`, `first()`, `last()`,\n"
+"    `lower_bound()`, `upper_bound()` and `range()`.\n"
+"  map:save(path)\n"
+"    Write all key-value pairs into file `path` in sorted binary format, which\n"
+"    can be opened by `make_map_mmap()`. Keys must be strings, numbers or\n"
+"    booleans, and values must be nil, strings, numbers or booleans. A map\n"
+"    with Lua comparator cannot be saved.\n"
+"  map map:union(other)\n"
+"  map map:intersect(other)\n"
+"  map map:diff(other)\n"
+"    Return a new map of keys in either map, in both maps, or only in this\n"
+"    map. Values are taken from this map if the key is in both. `other` must\n"
+"    be a map with the same comparator. Both maps are walked side by side, so\n"
+"    it costs O(n + m) and the result is built without sorting.\n"
+"  integer map:merge_join(other, fn)\n"
+"    Call `fn(key, value, other_value)` in order for every key in both maps,\n"
+"    and return the number of calls. It costs O(n + m). Neither map can be\n"
+"    modified in `fn`.\n"
 };
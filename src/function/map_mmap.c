@@ -0,0 +1,1023 @@
+#include "__init__.h"
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define INFRA_MAP_MMAP_NAME     "__infra_map_mmap"
+#define INFRA_MAP_FILE_MAGIC    "INFRAMAP"
+#define INFRA_MAP_FILE_VERSION  1
+#define INFRA_MAP_FILE_ENDIAN   0x01020304
+
+/**
+ * @brief Type tag of encoded value.
+ *
+ * A value is encoded as one byte of tag, followed by payload:
+ * + #INFRA_MAP_FILE_NIL, #INFRA_MAP_FILE_FALSE, #INFRA_MAP_FILE_TRUE: None.
+ * + #INFRA_MAP_FILE_NUMBER: `double`.
+ * + #INFRA_MAP_FILE_INTEGER: `int64_t`.
+ * + #INFRA_MAP_FILE_STRING: `uint64_t` length, then the bytes.
+ */
+typedef enum infra_map_file_tag
+{
+    INFRA_MAP_FILE_NIL,
+    INFRA_MAP_FILE_FALSE,
+    INFRA_MAP_FILE_TRUE,
+    INFRA_MAP_FILE_NUMBER,
+    INFRA_MAP_FILE_INTEGER,
+    INFRA_MAP_FILE_STRING,
+} infra_map_file_tag_t;
+
+/**
+ * @brief File header.
+ *
+ * It is followed by an array of `uint64_t` offsets of entries, and then
+ * entries in the order of comparator. Each entry is an encoded key and an
+ * encoded value. All numbers are in host byte order.
+ */
+typedef struct infra_map_file_hdr
+{
+    char        magic[8];   /**< #INFRA_MAP_FILE_MAGIC. */
+    uint32_t    version;    /**< #INFRA_MAP_FILE_VERSION. */
+    uint32_t    endian;     /**< #INFRA_MAP_FILE_ENDIAN. */
+    uint64_t    count;      /**< The number of entries. */
+    char        cmp[24];    /**< Name of comparator, empty for default. */
+} infra_map_file_hdr_t;
+
+/**
+ * @brief How keys are compared. Must match the native comparators of map.
+ */
+typedef enum infra_map_mmap_cmp_type
+{
+    INFRA_MAP_MMAP_CMP_DEFAULT,
+    INFRA_MAP_MMAP_CMP_INTEGER,
+    INFRA_MAP_MMAP_CMP_NUMBER,
+    INFRA_MAP_MMAP_CMP_STRING,
+    INFRA_MAP_MMAP_CMP_STRING_CI,
+} infra_map_mmap_cmp_type_t;
+
+typedef struct infra_map_mmap_cmp_opt
+{
+    const char* name;       /**< Name of comparator. */
+    int         cmp_type;   /**< #infra_map_mmap_cmp_type_t. */
+    int         reverse;    /**< Whether in descending order. */
+} infra_map_mmap_cmp_opt_t;
+
+static const infra_map_mmap_cmp_opt_t s_map_mmap_cmp_opts[] = {
+    { "",                   INFRA_MAP_MMAP_CMP_DEFAULT,     0 },
+    { "reverse",            INFRA_MAP_MMAP_CMP_DEFAULT,     1 },
+    { "integer",            INFRA_MAP_MMAP_CMP_INTEGER,     0 },
+    { "integer_reverse",    INFRA_MAP_MMAP_CMP_INTEGER,     1 },
+    { "number",             INFRA_MAP_MMAP_CMP_NUMBER,      0 },
+    { "number_reverse",     INFRA_MAP_MMAP_CMP_NUMBER,      1 },
+    { "string",             INFRA_MAP_MMAP_CMP_STRING,      0 },
+    { "string_reverse",     INFRA_MAP_MMAP_CMP_STRING,      1 },
+    { "string_ci",          INFRA_MAP_MMAP_CMP_STRING_CI,   0 },
+    { "string_ci_reverse",  INFRA_MAP_MMAP_CMP_STRING_CI,   1 },
+};
+
+typedef struct infra_map_mmap
+{
+    const unsigned char*    addr;       /**< Mapped file, NULL if closed. */
+    size_t                  size;       /**< File size. */
+    size_t                  count;      /**< The number of entries. */
+    const unsigned char*    offs;       /**< Offsets of entries. */
+    int                     cmp_type;   /**< #infra_map_mmap_cmp_type_t. */
+    int                     reverse;    /**< Whether keys are in descending order. */
+} infra_map_mmap_t;
+
+/**
+ * @brief A decoded value. Strings point into mapped file.
+ */
+typedef struct infra_map_mmap_value
+{
+    int                 tag;        /**< #infra_map_file_tag_t. */
+    union
+    {
+        double          n;          /**< #INFRA_MAP_FILE_NUMBER */
+        int64_t         i;          /**< #INFRA_MAP_FILE_INTEGER */
+        struct
+        {
+            const char* str;        /**< String address. */
+            size_t      len;        /**< String length. */
+        } s;                        /**< #INFRA_MAP_FILE_STRING */
+    } v;                            /**< Value. */
+} infra_map_mmap_value_t;
+
+/**
+ * @brief State of #infra_map_save().
+ */
+typedef struct infra_map_save_ctx
+{
+    FILE*       file;       /**< Output file. */
+    uint64_t*   offs;       /**< Offsets of entries. */
+    size_t      count;      /**< The number of entries. */
+    uint64_t    pos;        /**< Current file offset. */
+} infra_map_save_ctx_t;
+
+static void _infra_map_save_write(lua_State* L, infra_map_save_ctx_t* ctx, const void* data, size_t size)
+{
+    if (size != 0 && fwrite(data, size, 1, ctx->file) != 1)
+    {
+        luaL_error(L, "failed to write map file.");
+        return;
+    }
+    ctx->pos += size;
+}
+
+/**
+ * @brief Encode value at \p idx.
+ * @param[in] what  What the value is, for error message.
+ */
+static void _infra_map_save_value(lua_State* L, infra_map_save_ctx_t* ctx, int idx, const char* what)
+{
+    unsigned char tag;
+    size_t len;
+    const char* str;
+
+    switch (lua_type(L, idx))
+    {
+    case LUA_TNIL:
+        tag = INFRA_MAP_FILE_NIL;
+        _infra_map_save_write(L, ctx, &tag, sizeof(tag));
+        break;
+
+    case LUA_TBOOLEAN:
+        tag = lua_toboolean(L, idx) ? INFRA_MAP_FILE_TRUE : INFRA_MAP_FILE_FALSE;
+        _infra_map_save_write(L, ctx, &tag, sizeof(tag));
+        break;
+
+    case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, idx))
+        {
+            int64_t i = (int64_t)lua_tointeger(L, idx);
+            tag = INFRA_MAP_FILE_INTEGER;
+            _infra_map_save_write(L, ctx, &tag, sizeof(tag));
+            _infra_map_save_write(L, ctx, &i, sizeof(i));
+            break;
+        }
+#endif
+        {
+            double n = (double)lua_tonumber(L, idx);
+            tag = INFRA_MAP_FILE_NUMBER;
+            _infra_map_save_write(L, ctx, &tag, sizeof(tag));
+            _infra_map_save_write(L, ctx, &n, sizeof(n));
+        }
+        break;
+
+    case LUA_TSTRING:
+        str = lua_tolstring(L, idx, &len);
+        {
+            uint64_t len64 = len;
+            tag = INFRA_MAP_FILE_STRING;
+            _infra_map_save_write(L, ctx, &tag, sizeof(tag));
+            _infra_map_save_write(L, ctx, &len64, sizeof(len64));
+            _infra_map_save_write(L, ctx, str, len);
+        }
+        break;
+
+    default:
+        luaL_error(L, "cannot save %s of type %s.", what, luaL_typename(L, idx));
+        break;
+    }
+}
+
+/**
+ * @brief Write all entries, run in protected mode.
+ *
+ * Argument 1 is the map, argument 2 is #infra_map_save_ctx_t.
+ */
+static int _infra_map_save_entries(lua_State* L)
+{
+    infra_map_save_ctx_t* ctx = lua_touserdata(L, 2);
+    size_t cnt = 0;
+
+    if (luaL_getmetafield(L, 1, "__pairs") == 0)
+    {
+        return luaL_error(L, "no metamethod `__pairs`.");
+    }
+    lua_pushvalue(L, 1);
+    lua_call(L, 1, 3); /* f:3, s:4, ctl:5 */
+
+    while (1)
+    {
+        lua_pushvalue(L, 3);
+        lua_pushvalue(L, 4);
+        lua_pushvalue(L, 5);
+        lua_call(L, 2, 2); /* k:6, v:7 */
+
+        if (lua_type(L, 6) == LUA_TNIL)
+        {
+            break;
+        }
+        if (cnt >= ctx->count)
+        {
+            return luaL_error(L, "map is modified while saving.");
+        }
+        int ktype = lua_type(L, 6);
+        if (ktype != LUA_TBOOLEAN && ktype != LUA_TNUMBER && ktype != LUA_TSTRING)
+        {
+            return luaL_error(L, "cannot save key of type %s.", luaL_typename(L, 6));
+        }
+
+        ctx->offs[cnt++] = ctx->pos;
+        _infra_map_save_value(L, ctx, 6, "key");
+        _infra_map_save_value(L, ctx, 7, "value");
+
+        lua_pop(L, 1);
+        lua_replace(L, 5);
+    }
+
+    if (cnt != ctx->count)
+    {
+        return luaL_error(L, "map is modified while saving.");
+    }
+
+    if (fseek(ctx->file, sizeof(infra_map_file_hdr_t), SEEK_SET) != 0)
+    {
+        return luaL_error(L, "failed to write map file.");
+    }
+    _infra_map_save_write(L, ctx, ctx->offs, sizeof(uint64_t) * ctx->count);
+
+    return 0;
+}
+
+int infra_map_save(lua_State* L, int idx, const char* path, const char* cmp, size_t count)
+{
+    idx = lua_absindex(L, idx);
+
+    infra_map_file_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, INFRA_MAP_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = INFRA_MAP_FILE_VERSION;
+    hdr.endian = INFRA_MAP_FILE_ENDIAN;
+    hdr.count = count;
+    if (cmp != NULL)
+    {
+        if (strlen(cmp) >= sizeof(hdr.cmp))
+        {
+            return luaL_error(L, "unknown comparator `%s`.", cmp);
+        }
+        memcpy(hdr.cmp, cmp, strlen(cmp));
+    }
+
+    infra_map_save_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.count = count;
+    ctx.offs = calloc(count != 0 ? count : 1, sizeof(uint64_t));
+    INFRA_CHECK_OOM(L, ctx.offs);
+
+    int ret = fopen_s(&ctx.file, path, "wb");
+    if (ret != 0)
+    {
+        free(ctx.offs);
+        ret = infra_translate_sys_error(ret);
+        return infra_raise_error(L, ret);
+    }
+
+    /* Header, and a placeholder of offsets. */
+    lua_pushcfunction(L, _infra_map_save_entries);
+    lua_pushvalue(L, idx);
+    lua_pushlightuserdata(L, &ctx);
+    if (fwrite(&hdr, sizeof(hdr), 1, ctx.file) == 1
+        && (count == 0 || fwrite(ctx.offs, sizeof(uint64_t) * count, 1, ctx.file) == 1))
+    {
+        ctx.pos = sizeof(hdr) + sizeof(uint64_t) * count;
+        ret = lua_pcall(L, 2, 0, 0);
+    }
+    else
+    {
+        lua_pop(L, 3);
+        lua_pushstring(L, "failed to write map file.");
+        ret = -1;
+    }
+
+    free(ctx.offs);
+    if (fclose(ctx.file) != 0 && ret == 0)
+    {
+        lua_pushstring(L, "failed to write map file.");
+        ret = -1;
+    }
+
+    if (ret != 0)
+    {
+        remove(path);
+        return lua_error(L);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Decode value at \p off.
+ * @return  Offset of next value, or 0 if file is corrupted.
+ */
+static size_t _infra_map_mmap_decode(const infra_map_mmap_t* self, size_t off,
+    infra_map_mmap_value_t* val)
+{
+    uint64_t len;
+    memset(val, 0, sizeof(*val));
+
+    if (off >= self->size)
+    {
+        return 0;
+    }
+    val->tag = self->addr[off++];
+
+    switch (val->tag)
+    {
+    case INFRA_MAP_FILE_NIL:
+    case INFRA_MAP_FILE_FALSE:
+    case INFRA_MAP_FILE_TRUE:
+        return off;
+
+    case INFRA_MAP_FILE_NUMBER:
+        if (self->size - off < sizeof(val->v.n))
+        {
+            return 0;
+        }
+        memcpy(&val->v.n, self->addr + off, sizeof(val->v.n));
+        return off + sizeof(val->v.n);
+
+    case INFRA_MAP_FILE_INTEGER:
+        if (self->size - off < sizeof(val->v.i))
+        {
+            return 0;
+        }
+        memcpy(&val->v.i, self->addr + off, sizeof(val->v.i));
+        return off + sizeof(val->v.i);
+
+    case INFRA_MAP_FILE_STRING:
+        if (self->size - off < sizeof(len))
+        {
+            return 0;
+        }
+        memcpy(&len, self->addr + off, sizeof(len));
+        off += sizeof(len);
+        if (self->size - off < len)
+        {
+            return 0;
+        }
+        val->v.s.str = (const char*)self->addr + off;
+        val->v.s.len = (size_t)len;
+        return off + (size_t)len;
+
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Decode key of entry \p pos.
+ * @param[out] next Offset of value.
+ */
+static void _infra_map_mmap_key(lua_State* L, const infra_map_mmap_t* self, size_t pos,
+    infra_map_mmap_value_t* key, size_t* next)
+{
+    uint64_t off;
+    memcpy(&off, self->offs + pos * sizeof(off), sizeof(off));
+
+    *next = _infra_map_mmap_decode(self, (size_t)off, key);
+    if (*next == 0 || key->tag == INFRA_MAP_FILE_NIL)
+    {
+        luaL_error(L, "corrupted map file.");
+    }
+}
+
+static void _infra_map_mmap_push(lua_State* L, const infra_map_mmap_value_t* val)
+{
+    switch (val->tag)
+    {
+    case INFRA_MAP_FILE_FALSE:
+    case INFRA_MAP_FILE_TRUE:
+        lua_pushboolean(L, val->tag == INFRA_MAP_FILE_TRUE);
+        break;
+
+    case INFRA_MAP_FILE_NUMBER:
+        lua_pushnumber(L, (lua_Number)val->v.n);
+        break;
+
+    case INFRA_MAP_FILE_INTEGER:
+#if LUA_VERSION_NUM >= 503
+        lua_pushinteger(L, (lua_Integer)val->v.i);
+#else
+        lua_pushnumber(L, (lua_Number)val->v.i);
+#endif
+        break;
+
+    case INFRA_MAP_FILE_STRING:
+        lua_pushlstring(L, val->v.s.str, val->v.s.len);
+        break;
+
+    default:
+        lua_pushnil(L);
+        break;
+    }
+}
+
+/**
+ * @brief Push key and value of entry \p pos.
+ */
+static void _infra_map_mmap_push_entry(lua_State* L, const infra_map_mmap_t* self, size_t pos)
+{
+    size_t next;
+    infra_map_mmap_value_t key, val;
+    _infra_map_mmap_key(L, self, pos, &key, &next);
+
+    if (_infra_map_mmap_decode(self, next, &val) == 0)
+    {
+        luaL_error(L, "corrupted map file.");
+        return;
+    }
+
+    _infra_map_mmap_push(L, &key);
+    _infra_map_mmap_push(L, &val);
+}
+
+/**
+ * @brief Take a native copy of key, the same as map does.
+ */
+static void _infra_map_mmap_key_init(const infra_map_mmap_t* self, const infra_map_mmap_value_t* val,
+    infra_key_t* key)
+{
+    key->native = 1;
+    key->integer = 0;
+
+    switch (val->tag)
+    {
+    case INFRA_MAP_FILE_FALSE:
+    case INFRA_MAP_FILE_TRUE:
+        key->type = LUA_TBOOLEAN;
+        key->v.b = val->tag == INFRA_MAP_FILE_TRUE;
+        break;
+
+    case INFRA_MAP_FILE_NUMBER:
+        key->type = LUA_TNUMBER;
+        if (self->cmp_type == INFRA_MAP_MMAP_CMP_INTEGER)
+        {
+            key->integer = 1;
+            key->v.i = (lua_Integer)val->v.n;
+        }
+        else
+        {
+            key->v.n = (lua_Number)val->v.n;
+        }
+        break;
+
+    case INFRA_MAP_FILE_INTEGER:
+        key->type = LUA_TNUMBER;
+#if LUA_VERSION_NUM < 503
+        if (self->cmp_type != INFRA_MAP_MMAP_CMP_INTEGER)
+        {
+            key->v.n = (lua_Number)val->v.i;
+            break;
+        }
+#endif
+        key->integer = 1;
+        key->v.i = (lua_Integer)val->v.i;
+        break;
+
+    default:
+        key->type = LUA_TSTRING;
+        key->v.s.str = val->v.s.str;
+        key->v.s.len = val->v.s.len;
+        break;
+    }
+}
+
+/**
+ * @brief Take a native copy of value at \p idx as lookup key, checking the
+ *   type required by comparator.
+ */
+static void _infra_map_mmap_probe_init(lua_State* L, const infra_map_mmap_t* self, int idx,
+    infra_key_t* key)
+{
+    const char* tname = NULL;
+
+    switch (self->cmp_type)
+    {
+    case INFRA_MAP_MMAP_CMP_INTEGER:
+        if (lua_type(L, idx) != LUA_TNUMBER)
+        {
+            tname = "integer";
+            break;
+        }
+#if LUA_VERSION_NUM >= 503
+        {
+            int isnum = 0;
+            key->v.i = lua_tointegerx(L, idx, &isnum);
+            if (!isnum)
+            {
+                tname = "integer";
+                break;
+            }
+        }
+#else
+        key->v.i = (lua_Integer)lua_tonumber(L, idx);
+        if ((lua_Number)key->v.i != lua_tonumber(L, idx))
+        {
+            tname = "integer";
+            break;
+        }
+#endif
+        key->type = LUA_TNUMBER;
+        key->native = 1;
+        key->integer = 1;
+        return;
+
+    case INFRA_MAP_MMAP_CMP_NUMBER:
+        tname = lua_type(L, idx) != LUA_TNUMBER ? "number" : NULL;
+        break;
+
+    case INFRA_MAP_MMAP_CMP_STRING:
+    case INFRA_MAP_MMAP_CMP_STRING_CI:
+        tname = lua_type(L, idx) != LUA_TSTRING ? "string" : NULL;
+        break;
+
+    default:
+        break;
+    }
+
+    if (tname != NULL)
+    {
+        luaL_error(L, "map key must be %s, got %s.", tname, luaL_typename(L, idx));
+        return;
+    }
+    infra_key_init(L, idx, key);
+}
+
+/**
+ * @brief Compare two keys with the comparator of \p self.
+ */
+static int _infra_map_mmap_cmp(const infra_map_mmap_t* self, const infra_key_t* k1, const infra_key_t* k2)
+{
+    int ret = 0;
+
+    switch (self->cmp_type)
+    {
+    case INFRA_MAP_MMAP_CMP_INTEGER:
+        ret = k1->v.i < k2->v.i ? -1 : (k1->v.i > k2->v.i ? 1 : 0);
+        break;
+
+    case INFRA_MAP_MMAP_CMP_STRING:
+        ret = infra_compare_string(k1->v.s.str, k1->v.s.len, k2->v.s.str, k2->v.s.len);
+        break;
+
+    case INFRA_MAP_MMAP_CMP_STRING_CI:
+        ret = infra_compare_string_ci(k1->v.s.str, k1->v.s.len, k2->v.s.str, k2->v.s.len);
+        break;
+
+    default:
+        if (!infra_key_compare(k1, k2, &ret))
+        {/* Keys in file are always native, so only the identity is left. */
+            ret = k1->v.p < k2->v.p ? -1 : (k1->v.p > k2->v.p ? 1 : 0);
+        }
+        break;
+    }
+
+    return self->reverse ? -ret : ret;
+}
+
+/**
+ * @brief Find the first entry not less than (or greater than, if \p upper is
+ *   set) the key at \p idx.
+ * @return  Position of entry, or the number of entries if not found.
+ */
+static size_t _infra_map_mmap_bound(lua_State* L, const infra_map_mmap_t* self, int idx, int upper)
+{
+    infra_key_t probe;
+    _infra_map_mmap_probe_init(L, self, idx, &probe);
+
+    size_t lo = 0, hi = self->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+
+        size_t next;
+        infra_map_mmap_value_t val;
+        _infra_map_mmap_key(L, self, mid, &val, &next);
+
+        infra_key_t key;
+        _infra_map_mmap_key_init(self, &val, &key);
+
+        int ret = _infra_map_mmap_cmp(self, &key, &probe);
+
+        if (ret < 0 || (upper && ret == 0))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * @brief Check whether entry \p pos equals to key at \p idx.
+ */
+static int _infra_map_mmap_equal(lua_State* L, const infra_map_mmap_t* self, size_t pos, int idx)
+{
+    if (pos >= self->count)
+    {
+        return 0;
+    }
+
+    infra_key_t probe;
+    _infra_map_mmap_probe_init(L, self, idx, &probe);
+
+    size_t next;
+    infra_map_mmap_value_t val;
+    _infra_map_mmap_key(L, self, pos, &val, &next);
+
+    infra_key_t key;
+    _infra_map_mmap_key_init(self, &val, &key);
+
+    return _infra_map_mmap_cmp(self, &key, &probe) == 0;
+}
+
+static infra_map_mmap_t* _infra_map_mmap_check(lua_State* L, int idx)
+{
+    infra_map_mmap_t* self = luaL_checkudata(L, idx, INFRA_MAP_MMAP_NAME);
+    if (self->addr == NULL)
+    {
+        luaL_error(L, "map is closed.");
+        return NULL;
+    }
+    return self;
+}
+
+static void _infra_map_mmap_unmap(infra_map_mmap_t* self)
+{
+    if (self->addr == NULL)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(self->addr);
+#else
+    munmap((void*)self->addr, self->size);
+#endif
+    self->addr = NULL;
+}
+
+static int _infra_map_mmap_gc(lua_State* L)
+{
+    infra_map_mmap_t* self = lua_touserdata(L, 1);
+    _infra_map_mmap_unmap(self);
+    return 0;
+}
+
+static int _infra_map_mmap_close(lua_State* L)
+{
+    infra_map_mmap_t* self = luaL_checkudata(L, 1, INFRA_MAP_MMAP_NAME);
+    _infra_map_mmap_unmap(self);
+    return 0;
+}
+
+static int _infra_map_mmap_size(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    lua_pushinteger(L, (lua_Integer)self->count);
+    return 1;
+}
+
+static int _infra_map_mmap_find(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    luaL_checkany(L, 2);
+
+    size_t pos = _infra_map_mmap_bound(L, self, 2, 0);
+    if (!_infra_map_mmap_equal(L, self, pos, 2))
+    {
+        lua_pushboolean(L, 0);
+        lua_pushnil(L);
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+    _infra_map_mmap_push_entry(L, self, pos);
+    lua_remove(L, -2);
+    return 2;
+}
+
+/**
+ * @brief Push key and value of entry \p pos, or nil if out of range.
+ */
+static int _infra_map_mmap_push_pos(lua_State* L, const infra_map_mmap_t* self, size_t pos)
+{
+    if (pos >= self->count)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    _infra_map_mmap_push_entry(L, self, pos);
+    return 2;
+}
+
+static int _infra_map_mmap_first(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    return _infra_map_mmap_push_pos(L, self, 0);
+}
+
+static int _infra_map_mmap_last(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    return _infra_map_mmap_push_pos(L, self, self->count - 1);
+}
+
+static int _infra_map_mmap_lower_bound(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    luaL_checkany(L, 2);
+    return _infra_map_mmap_push_pos(L, self, _infra_map_mmap_bound(L, self, 2, 0));
+}
+
+static int _infra_map_mmap_upper_bound(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    luaL_checkany(L, 2);
+    return _infra_map_mmap_push_pos(L, self, _infra_map_mmap_bound(L, self, 2, 1));
+}
+
+/**
+ * @brief Iterator function.
+ *
+ * Upvalue 1 is the next position, upvalue 2 is the position to stop, upvalue
+ * 3 is the step.
+ */
+static int _infra_map_mmap_next(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    lua_Integer pos = lua_tointeger(L, lua_upvalueindex(1));
+    lua_Integer stop = lua_tointeger(L, lua_upvalueindex(2));
+    lua_Integer step = lua_tointeger(L, lua_upvalueindex(3));
+
+    if (pos == stop)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushinteger(L, pos + step);
+    lua_replace(L, lua_upvalueindex(1));
+
+    _infra_map_mmap_push_entry(L, self, (size_t)pos);
+    return 2;
+}
+
+/**
+ * @brief Push iterator that visit entries in [\p begin, \p end).
+ */
+static int _infra_map_mmap_push_iter(lua_State* L, size_t begin, size_t end, int reverse)
+{
+    if (end < begin)
+    {
+        end = begin;
+    }
+
+    if (!reverse)
+    {
+        lua_pushinteger(L, (lua_Integer)begin);
+        lua_pushinteger(L, (lua_Integer)end);
+        lua_pushinteger(L, 1);
+    }
+    else
+    {
+        lua_pushinteger(L, (lua_Integer)end - 1);
+        lua_pushinteger(L, (lua_Integer)begin - 1);
+        lua_pushinteger(L, -1);
+    }
+    lua_pushcclosure(L, _infra_map_mmap_next, 3);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+static int _infra_map_mmap_pairs(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    return _infra_map_mmap_push_iter(L, 0, self->count, 0);
+}
+
+static int _infra_map_mmap_range(lua_State* L)
+{
+    infra_map_mmap_t* self = _infra_map_mmap_check(L, 1);
+    lua_settop(L, 4);
+
+    size_t begin = 0, end = self->count;
+    if (lua_type(L, 2) != LUA_TNIL)
+    {
+        begin = _infra_map_mmap_bound(L, self, 2, 0);
+    }
+    if (lua_type(L, 3) != LUA_TNIL)
+    {
+        end = _infra_map_mmap_bound(L, self, 3, 1);
+    }
+
+    return _infra_map_mmap_push_iter(L, begin, end, lua_toboolean(L, 4));
+}
+
+/**
+ * @brief Map file \p path into memory.
+ * @return  0 if success, otherwise error code.
+ */
+static int _infra_map_mmap_open(infra_map_mmap_t* self, const char* path)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return infra_translate_sys_error(GetLastError());
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        int ret = infra_translate_sys_error(GetLastError());
+        CloseHandle(file);
+        return ret;
+    }
+    self->size = (size_t)size.QuadPart;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+    {
+        return infra_translate_sys_error(GetLastError());
+    }
+
+    /* The view keeps the mapping alive. */
+    self->addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (self->addr == NULL)
+    {
+        return infra_translate_sys_error(GetLastError());
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return infra_translate_sys_error(errno);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int ret = infra_translate_sys_error(errno);
+        close(fd);
+        return ret;
+    }
+    self->size = (size_t)st.st_size;
+
+    void* addr = self->size != 0 ? mmap(NULL, self->size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return infra_translate_sys_error(errno);
+    }
+    self->addr = addr;
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief Check file header.
+ * @return  1 if valid, 0 if not.
+ */
+static int _infra_map_mmap_setup(infra_map_mmap_t* self)
+{
+    size_t i;
+    infra_map_file_hdr_t hdr;
+
+    if (self->addr == NULL || self->size < sizeof(hdr))
+    {
+        return 0;
+    }
+    memcpy(&hdr, self->addr, sizeof(hdr));
+
+    if (memcmp(hdr.magic, INFRA_MAP_FILE_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.version != INFRA_MAP_FILE_VERSION || hdr.endian != INFRA_MAP_FILE_ENDIAN
+        || hdr.count > (self->size - sizeof(hdr)) / sizeof(uint64_t)
+        || hdr.cmp[sizeof(hdr.cmp) - 1] != '\0')
+    {
+        return 0;
+    }
+    self->count = (size_t)hdr.count;
+    self->offs = self->addr + sizeof(hdr);
+
+    for (i = 0; i < ARRAY_SIZE(s_map_mmap_cmp_opts); i++)
+    {
+        if (strcmp(s_map_mmap_cmp_opts[i].name, hdr.cmp) == 0)
+        {
+            self->cmp_type = s_map_mmap_cmp_opts[i].cmp_type;
+            self->reverse = s_map_mmap_cmp_opts[i].reverse;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int _infra_make_map_mmap(lua_State* L)
+{
+    const char* path = luaL_checkstring(L, 1);
+
+    infra_map_mmap_t* self = lua_newuserdata(L, sizeof(infra_map_mmap_t));
+    memset(self, 0, sizeof(*self));
+
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _infra_map_mmap_gc },
+        { "__pairs",    _infra_map_mmap_pairs },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_method[] = {
+        { "size",       _infra_map_mmap_size },
+        { "find",       _infra_map_mmap_find },
+        { "pairs",      _infra_map_mmap_pairs },
+        { "first",      _infra_map_mmap_first },
+        { "last",       _infra_map_mmap_last },
+        { "lower_bound", _infra_map_mmap_lower_bound },
+        { "upper_bound", _infra_map_mmap_upper_bound },
+        { "range",      _infra_map_mmap_range },
+        { "close",      _infra_map_mmap_close },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, INFRA_MAP_MMAP_NAME) != 0)
+    {
+        luaL_setfuncs(L, s_meta, 0);
+
+        /* metatable.__index = s_method */
+        luaL_newlib(L, s_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+
+    int ret = _infra_map_mmap_open(self, path);
+    if (ret != 0)
+    {
+        return infra_raise_error(L, ret);
+    }
+
+    if (!_infra_map_mmap_setup(self))
+    {
+        _infra_map_mmap_unmap(self);
+        return luaL_error(L, "invalid map file `%s`.", path);
+    }
+
+    return 1;
+}
+
+const infra_lua_api_t infra_f_map_mmap = {
+"make_map_mmap", _infra_make_map_mmap, 0,
+"Open a map file as read-only map.",
+
+"[SYNOPSIS]\n"
+"map make_map_mmap(path)\n"
+"\n"
+"[DESCRIPTION]\n"
+"Open file `path` written by `map:save()` as a read-only map. The file is\n"
+"mapped into memory, and keys are found by binary search over the file\n"
+"content, so opening is O(1) no matter how large the file is, and Lua values\n"
+"are only created for the accessed entries. Keys keep the order of the saved\n"
+"map.\n"
+"\n"
+"The returned map have following metamethod:\n"
+"  integer map:size()\n"
+"    Return the number of elements.\n"
+"  boolean,any map:find(key)\n"
+"    Find the matching value for the key. If found, the first return value is\n"
+"    true, the second is the associated value. If not found, return false and\n"
+"    nil.\n"
+"  map:pairs()\n"
+"    Use in `for k,v in map:pairs() do ... end`. For lua5.2 and above, normal\n"
+"    `pairs()` also works.\n"
+"  any,any map:first()\n"
+"    Return the smallest key and it's value, or nil if map is empty.\n"
+"  any,any map:last()\n"
+"    Return the largest key and it's value, or nil if map is empty.\n"
+"  any,any map:lower_bound(key)\n"
+"    Return the first key that not less than `key` and it's value, or nil if\n"
+"    not found.\n"
+"  any,any map:upper_bound(key)\n"
+"    Return the first key that greater than `key` and it's value, or nil if\n"
+"    not found.\n"
+"  map:range(lo, hi[, reverse])\n"
+"    Use in `for k,v in map:range(lo, hi) do ... end` to iterate over keys in\n"
+"    [lo, hi]. A nil bound means no limit. If `reverse` is true, iterate from\n"
+"    `hi` down to `lo`.\n"
+"  map:close()\n"
+"    Unmap the file. Any further access raises an error. It is also done when\n"
+"    the map is garbage collected.\n"
+};
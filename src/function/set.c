@@ -0,0 +1,527 @@
+#include "__init__.h"
+#include "utils/map.h"
+#include "utils/slab.h"
+
+#define INFRA_SET_NAME  "__infra_set"
+
+typedef struct infra_set_node
+{
+    ev_map_node_t   node;
+    infra_key_t     key;    /**< Native copy of key. */
+
+    /**
+     * @brief Key id in data table.
+     * For a temporary lookup key, it is the negative stack index of the key.
+     */
+    int             id;
+} infra_set_node_t;
+
+typedef struct infra_set
+{
+    ev_map_t        root;       /**< Elements. */
+    ev_slab_t       slab;       /**< Allocator for #infra_set_node_t. */
+    lua_State*      L;
+    size_t          version;    /**< Increase every time a node is added or removed. */
+
+    /**
+     * @brief Reference to data table.
+     * Key of node `id` is stored at `id`. There is no value at all.
+     */
+    int             ref_data;
+    int*            free_ids;   /**< Recycled key ids. */
+    size_t          free_sz;    /**< The number of recycled ids. */
+    size_t          free_cap;   /**< Capacity of #infra_set::free_ids. */
+    int             next_id;    /**< The largest allocated id. */
+} infra_set_t;
+
+typedef struct infra_set_iter
+{
+    infra_set_t*    set;        /**< The set #infra_set_iter::node belongs to. */
+    ev_map_node_t*  node;       /**< The node last returned. */
+    size_t          version;    /**< Set version when #infra_set_iter::node is returned. */
+} infra_set_iter_t;
+
+static int _infra_set_alloc_id(infra_set_t* self)
+{
+    if (self->free_sz > 0)
+    {
+        return self->free_ids[--self->free_sz];
+    }
+    return ++self->next_id;
+}
+
+static void _infra_set_free_id(infra_set_t* self, int id)
+{
+    if (self->free_sz == self->free_cap)
+    {
+        size_t new_cap = self->free_cap == 0 ? 16 : self->free_cap * 2;
+        int* new_ids = realloc(self->free_ids, sizeof(int) * new_cap);
+        if (new_ids == NULL)
+        {/* Just leave a hole in data table. */
+            return;
+        }
+        self->free_ids = new_ids;
+        self->free_cap = new_cap;
+    }
+
+    self->free_ids[self->free_sz++] = id;
+}
+
+/**
+ * @brief Push key of node \p id on top of stack.
+ */
+static void _infra_set_push_key(lua_State* L, infra_set_t* self, int id)
+{
+    if (id <= 0)
+    {
+        lua_pushvalue(L, -id);
+        return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_rawgeti(L, -1, id);
+    lua_remove(L, -2);
+}
+
+static int _infra_set_cmp(const ev_map_node_t* key1, const ev_map_node_t* key2, void* arg)
+{
+    infra_set_t* self = arg;
+    lua_State* L = self->L;
+    const infra_set_node_t* n1 = container_of(key1, infra_set_node_t, node);
+    const infra_set_node_t* n2 = container_of(key2, infra_set_node_t, node);
+
+    int ret;
+    if (infra_key_compare(&n1->key, &n2->key, &ret))
+    {
+        return ret;
+    }
+
+    lua_pushcfunction(L, infra_f_compare.addr);
+    _infra_set_push_key(L, self, n1->id);
+    _infra_set_push_key(L, self, n2->id);
+    lua_call(L, 2, 1);
+
+    /* Metamethods might use this set from another coroutine. */
+    self->L = L;
+
+    ret = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    return ret;
+}
+
+/**
+ * @brief Initialize \p probe as a temporary lookup node for value at \p idx.
+ */
+static void _infra_set_init_probe(lua_State* L, infra_set_node_t* probe, int idx)
+{
+    if (lua_type(L, idx) == LUA_TNIL)
+    {
+        luaL_error(L, "set element cannot be nil.");
+        return;
+    }
+
+    infra_key_init(L, idx, &probe->key);
+    probe->id = -lua_absindex(L, idx);
+}
+
+static infra_set_node_t* _infra_set_find(lua_State* L, infra_set_t* self, int idx)
+{
+    infra_set_node_t probe;
+    _infra_set_init_probe(L, &probe, idx);
+
+    ev_map_node_t* node = ev_map_find(&self->root, &probe.node);
+    return node != NULL ? container_of(node, infra_set_node_t, node) : NULL;
+}
+
+/**
+ * @brief Add value at \p idx.
+ * @return  1 if added, 0 if exists.
+ */
+static int _infra_set_add_value(lua_State* L, infra_set_t* self, int idx)
+{
+    idx = lua_absindex(L, idx);
+
+    infra_set_node_t* node = ev_slab_alloc(&self->slab);
+    if (node == NULL)
+    {
+        return luaL_error(L, INFRA_LUA_ERRMSG_OOM);
+    }
+
+    /* Compare against the stack value, so a duplicate never touches data table. */
+    _infra_set_init_probe(L, node, idx);
+    if (ev_map_insert(&self->root, &node->node) != NULL)
+    {
+        ev_slab_free(&self->slab, node);
+        return 0;
+    }
+
+    node->id = _infra_set_alloc_id(self);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushvalue(L, idx);
+    lua_rawseti(L, -2, node->id);
+    lua_pop(L, 1);
+
+    self->version++;
+    return 1;
+}
+
+/**
+ * @brief Remove value at \p idx.
+ * @return  1 if removed, 0 if not found.
+ */
+static int _infra_set_remove_value(lua_State* L, infra_set_t* self, int idx)
+{
+    infra_set_node_t* node = _infra_set_find(L, self, idx);
+    if (node == NULL)
+    {
+        return 0;
+    }
+
+    ev_map_erase(&self->root, &node->node);
+    self->version++;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref_data);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, node->id);
+    lua_pop(L, 1);
+
+    _infra_set_free_id(self, node->id);
+    ev_slab_free(&self->slab, node);
+
+    return 1;
+}
+
+static infra_set_t* _infra_set_check(lua_State* L, int idx)
+{
+    infra_set_t* self = luaL_checkudata(L, idx, INFRA_SET_NAME);
+    self->L = L;
+    return self;
+}
+
+static int _infra_set_gc(lua_State* L)
+{
+    infra_set_t* self = lua_touserdata(L, 1);
+
+    /* All nodes live in slab, and all keys live in data table. */
+    ev_map_init(&self->root, _infra_set_cmp, self);
+    ev_slab_exit(&self->slab);
+
+    free(self->free_ids);
+    self->free_ids = NULL;
+    self->free_sz = 0;
+    self->free_cap = 0;
+
+    luaL_unref(L, LUA_REGISTRYINDEX, self->ref_data);
+    self->ref_data = LUA_NOREF;
+
+    return 0;
+}
+
+static int _infra_set_size(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    lua_pushinteger(L, (lua_Integer)ev_map_size(&self->root));
+    return 1;
+}
+
+static int _infra_set_add(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    luaL_checkany(L, 2);
+
+    lua_pushboolean(L, _infra_set_add_value(L, self, 2));
+    return 1;
+}
+
+static int _infra_set_remove(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    luaL_checkany(L, 2);
+
+    lua_pushboolean(L, _infra_set_remove_value(L, self, 2));
+    return 1;
+}
+
+static int _infra_set_contains(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    luaL_checkany(L, 2);
+
+    lua_pushboolean(L, _infra_set_find(L, self, 2) != NULL);
+    return 1;
+}
+
+/**
+ * @brief Push key of \p node, or nil if \p node is NULL.
+ */
+static int _infra_set_push_node(lua_State* L, infra_set_t* self, ev_map_node_t* node)
+{
+    if (node == NULL)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    _infra_set_push_key(L, self, container_of(node, infra_set_node_t, node)->id);
+    return 1;
+}
+
+static int _infra_set_first(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    return _infra_set_push_node(L, self, ev_map_begin(&self->root));
+}
+
+static int _infra_set_last(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    return _infra_set_push_node(L, self, ev_map_end(&self->root));
+}
+
+/**
+ * @brief Check if the cached node of \p iter is the control key at 2.
+ */
+static int _infra_set_iter_cached(lua_State* L, infra_set_t* self, const infra_set_iter_t* iter)
+{
+    if (iter->set != self || iter->version != self->version || iter->node == NULL)
+    {
+        return 0;
+    }
+
+    _infra_set_push_key(L, self, container_of(iter->node, infra_set_node_t, node)->id);
+    int ret = lua_rawequal(L, 2, -1);
+    lua_pop(L, 1);
+
+    return ret;
+}
+
+/**
+ * @brief Iterator function.
+ *
+ * The last returned node is cached in upvalue, so in most cases the next
+ * element is found in O(1). The cache is only used if it belongs to the same
+ * set, the set is not modified since then, and the control key is the key
+ * last returned. Otherwise we search by the control key instead.
+ */
+static int _infra_set_pairs_next(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    infra_set_iter_t* iter = lua_touserdata(L, lua_upvalueindex(1));
+
+    if (lua_type(L, 2) == LUA_TNIL)
+    {
+        iter->node = ev_map_begin(&self->root);
+    }
+    else if (_infra_set_iter_cached(L, self, iter))
+    {
+        iter->node = ev_map_next(iter->node);
+    }
+    else
+    {
+        infra_set_node_t probe;
+        _infra_set_init_probe(L, &probe, 2);
+        iter->node = ev_map_find_upper(&self->root, &probe.node);
+    }
+
+    iter->set = self;
+    iter->version = self->version;
+
+    if (iter->node == NULL)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    _infra_set_push_node(L, self, iter->node);
+    lua_pushboolean(L, 1);
+    return 2;
+}
+
+static int _infra_set_meta_pairs(lua_State* L)
+{
+    infra_set_iter_t* iter = lua_newuserdata(L, sizeof(infra_set_iter_t));
+    memset(iter, 0, sizeof(*iter));
+
+    lua_pushcclosure(L, _infra_set_pairs_next, 1);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+static int _infra_set_pairs(lua_State* L)
+{
+    _infra_set_check(L, 1);
+    return _infra_set_meta_pairs(L);
+}
+
+static int _infra_set_add_many(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_settop(L, 2);
+
+    lua_Integer cnt = 0;
+    lua_pushnil(L); /* key:3 */
+    while (lua_next(L, 2) != 0) /* value:4 */
+    {
+        cnt += _infra_set_add_value(L, self, 4);
+        lua_pop(L, 1);
+    }
+
+    lua_pushinteger(L, cnt);
+    return 1;
+}
+
+static int _infra_set_remove_many(lua_State* L)
+{
+    infra_set_t* self = _infra_set_check(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_settop(L, 2);
+
+    lua_Integer cnt = 0;
+    lua_pushnil(L); /* key:3 */
+    while (lua_next(L, 2) != 0) /* value:4 */
+    {
+        cnt += _infra_set_remove_value(L, self, 4);
+        lua_pop(L, 1);
+    }
+
+    lua_pushinteger(L, cnt);
+    return 1;
+}
+
+/**
+ * @brief Add all values of table \p src, or all keys of object \p src with
+ *   `__pairs` metamethod.
+ */
+static int _infra_set_copy(lua_State* L, infra_set_t* self, int src)
+{
+    int sp = lua_gettop(L);
+
+    if (lua_type(L, src) == LUA_TTABLE)
+    {
+        lua_pushnil(L); /* key:sp+1 */
+        while (lua_next(L, src) != 0) /* value:sp+2 */
+        {
+            _infra_set_add_value(L, self, sp + 2);
+            lua_pop(L, 1);
+        }
+        return 0;
+    }
+
+    if (luaL_getmetafield(L, src, "__pairs") == 0)
+    {
+        return 0;
+    }
+    lua_pushvalue(L, src);
+    lua_call(L, 1, 3); /* f:sp+1, s:sp+2, k:sp+3 */
+
+    while (1)
+    {
+        lua_pushvalue(L, sp + 1);
+        lua_pushvalue(L, sp + 2);
+        lua_pushvalue(L, sp + 3);
+        lua_call(L, 2, 1); /* k:sp+4 */
+
+        if (lua_type(L, sp + 4) == LUA_TNIL)
+        {
+            break;
+        }
+        _infra_set_add_value(L, self, sp + 4);
+        lua_replace(L, sp + 3);
+    }
+
+    lua_settop(L, sp);
+    return 0;
+}
+
+static int _infra_new_set(lua_State* L)
+{
+    lua_settop(L, 1);
+
+    infra_set_t* self = lua_newuserdata(L, sizeof(infra_set_t));
+    memset(self, 0, sizeof(*self));
+    self->L = L;
+    self->ref_data = LUA_NOREF;
+    ev_map_init(&self->root, _infra_set_cmp, self);
+    ev_slab_init(&self->slab, sizeof(infra_set_node_t));
+
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _infra_set_gc },
+        { "__pairs",    _infra_set_meta_pairs },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_method[] = {
+        { "size",       _infra_set_size },
+        { "add",        _infra_set_add },
+        { "remove",     _infra_set_remove },
+        { "contains",   _infra_set_contains },
+        { "pairs",      _infra_set_pairs },
+        { "first",      _infra_set_first },
+        { "last",       _infra_set_last },
+        { "add_many",   _infra_set_add_many },
+        { "remove_many", _infra_set_remove_many },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, INFRA_SET_NAME) != 0)
+    {
+        luaL_setfuncs(L, s_meta, 0);
+
+        /* metatable.__index = s_method */
+        luaL_newlib(L, s_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+
+    lua_newtable(L);
+    self->ref_data = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (lua_type(L, 1) != LUA_TNIL)
+    {
+        _infra_set_copy(L, self, 1);
+    }
+
+    return 1;
+}
+
+const infra_lua_api_t infra_f_set = {
+"make_set", _infra_new_set, 0,
+"Create a new empty set.",
+
+"[SYNOPSIS]\n"
+"set make_set([src])\n"
+"\n"
+"[DESCRIPTION]\n"
+"Create a new empty set. A set is a red-black tree of keys ordered as\n"
+"`compare()`. It able to contains anything except nil. Unlike a map that\n"
+"stores `true` for every key, a set only stores the key itself, so it costs\n"
+"about half the memory of the equivalent map.\n"
+"\n"
+"If `src` is a table, all values of it are added. If `src` is an object that\n"
+"have metamethod `__pairs` (e.g. a map or another set), all keys of it are\n"
+"added.\n"
+"\n"
+"A set have following metamethod:\n"
+"  integer set:size()\n"
+"    Return the number of elements.\n"
+"  boolean set:add(key)\n"
+"    Add key into set. If the key is exist, return false.\n"
+"  boolean set:remove(key)\n"
+"    Remove key from set. If the key is not exist, return false.\n"
+"  boolean set:contains(key)\n"
+"    Check whether key is in set.\n"
+"  set:pairs()\n"
+"    Use in `for k in set:pairs() do ... end` to iterate over keys in\n"
+"    ascending order. The second value is always true, so code written for a\n"
+"    map of `true` values also works. For lua5.2 and above, normal `pairs()`\n"
+"    also works. It is safe to modify the set during iteration.\n"
+"  any set:first()\n"
+"    Return the smallest key, or nil if set is empty.\n"
+"  any set:last()\n"
+"    Return the largest key, or nil if set is empty.\n"
+"  integer set:add_many(t)\n"
+"    Add all values of table `t`, return the number of added keys.\n"
+"  integer set:remove_many(t)\n"
+"    Remove all values of table `t`, return the number of removed keys.\n"
+};
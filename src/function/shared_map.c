@@ -0,0 +1,1085 @@
+#include "__init__.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#define INFRA_SHARED_MAP_NAME       "__infra_shared_map"
+#define INFRA_SHARED_MAP_MAX_LEVEL  24
+#define INFRA_SHARED_MAP_MAX_DEPTH  32
+#define INFRA_SHARED_MAP_LOCKS      16
+
+/**
+ * @brief Type tag of encoded value.
+ *
+ * A value is encoded as one byte of tag, followed by payload:
+ * + #INFRA_SHARED_FALSE, #INFRA_SHARED_TRUE: None.
+ * + #INFRA_SHARED_NUMBER: `double`.
+ * + #INFRA_SHARED_INTEGER: `int64_t`.
+ * + #INFRA_SHARED_STRING: `uint64_t` length, then the bytes.
+ * + #INFRA_SHARED_TABLE: `uint64_t` count, then encoded key and value of
+ *   each field.
+ */
+typedef enum infra_shared_tag
+{
+    INFRA_SHARED_FALSE,
+    INFRA_SHARED_TRUE,
+    INFRA_SHARED_NUMBER,
+    INFRA_SHARED_INTEGER,
+    INFRA_SHARED_STRING,
+    INFRA_SHARED_TABLE,
+} infra_shared_tag_t;
+
+#if defined(_WIN32)
+
+typedef SRWLOCK infra_rwlock_t;
+#define INFRA_RWLOCK_INITIALIZER    SRWLOCK_INIT
+
+static int _infra_rwlock_init(infra_rwlock_t* lock)
+{
+    InitializeSRWLock(lock);
+    return 0;
+}
+
+static void _infra_rwlock_exit(infra_rwlock_t* lock)
+{
+    (void)lock;
+}
+
+static void _infra_rwlock_rdlock(infra_rwlock_t* lock)
+{
+    AcquireSRWLockShared(lock);
+}
+
+static void _infra_rwlock_rdunlock(infra_rwlock_t* lock)
+{
+    ReleaseSRWLockShared(lock);
+}
+
+static void _infra_rwlock_wrlock(infra_rwlock_t* lock)
+{
+    AcquireSRWLockExclusive(lock);
+}
+
+static void _infra_rwlock_wrunlock(infra_rwlock_t* lock)
+{
+    ReleaseSRWLockExclusive(lock);
+}
+
+#else
+
+typedef pthread_rwlock_t infra_rwlock_t;
+#define INFRA_RWLOCK_INITIALIZER    PTHREAD_RWLOCK_INITIALIZER
+
+static int _infra_rwlock_init(infra_rwlock_t* lock)
+{
+    return pthread_rwlock_init(lock, NULL);
+}
+
+static void _infra_rwlock_exit(infra_rwlock_t* lock)
+{
+    pthread_rwlock_destroy(lock);
+}
+
+static void _infra_rwlock_rdlock(infra_rwlock_t* lock)
+{
+    pthread_rwlock_rdlock(lock);
+}
+
+static void _infra_rwlock_rdunlock(infra_rwlock_t* lock)
+{
+    pthread_rwlock_unlock(lock);
+}
+
+static void _infra_rwlock_wrlock(infra_rwlock_t* lock)
+{
+    pthread_rwlock_wrlock(lock);
+}
+
+static void _infra_rwlock_wrunlock(infra_rwlock_t* lock)
+{
+    pthread_rwlock_unlock(lock);
+}
+
+#endif
+
+/**
+ * @brief Lock padded to its own cachelines, so readers that take different
+ *   locks do not write the same cacheline.
+ */
+typedef union infra_shared_lock
+{
+    infra_rwlock_t      lock;       /**< The lock. */
+    char                pad[128];   /**< Padding. */
+} infra_shared_lock_t;
+
+/**
+ * @brief Key of shared map. Numbers sort before strings.
+ */
+typedef struct infra_shared_key
+{
+    int                 tag;        /**< #INFRA_SHARED_NUMBER, #INFRA_SHARED_INTEGER or #INFRA_SHARED_STRING. */
+    union
+    {
+        double          n;          /**< #INFRA_SHARED_NUMBER */
+        int64_t         i;          /**< #INFRA_SHARED_INTEGER */
+    } v;                            /**< Number value. */
+    const char*         str;        /**< #INFRA_SHARED_STRING */
+    size_t              len;        /**< String length. */
+} infra_shared_key_t;
+
+/**
+ * @brief Skip list node.
+ *
+ * It is followed by #infra_shared_node::level forward links, the key string
+ * and the encoded value, in one allocation.
+ */
+typedef struct infra_shared_node
+{
+    infra_shared_key_t  key;        /**< Key, string points into node. */
+    const char*         value;      /**< Encoded value, points into node. */
+    size_t              value_sz;   /**< Encoded value size. */
+    int                 level;      /**< The number of forward links. */
+} infra_shared_node_t;
+
+typedef struct infra_shared_map
+{
+    struct infra_shared_map*    next;       /**< Next map in registry. */
+    size_t                      refcnt;     /**< Protected by registry lock. */
+    const char*                 name;       /**< Name, points after this struct. */
+    size_t                      name_sz;    /**< Name length. */
+    size_t                      handles;    /**< The number of handles ever opened, protected by registry lock. */
+
+    /**
+     * @brief Protect following fields. A reader takes the lock of its
+     *   handle, and a writer takes all of them.
+     */
+    infra_shared_lock_t         locks[INFRA_SHARED_MAP_LOCKS];
+    size_t                      size;       /**< The number of nodes. */
+    int                         level;      /**< Current max level. */
+    infra_shared_node_t*        head[INFRA_SHARED_MAP_MAX_LEVEL];
+} infra_shared_map_t;
+
+/**
+ * @brief Per-state handle of shared map.
+ */
+typedef struct infra_shared_map_handle
+{
+    infra_shared_map_t* map;        /**< Shared map, NULL if not open. */
+    char*               buf;        /**< Scratch buffer for encoding and decoding. */
+    size_t              buf_sz;     /**< Used size of buffer. */
+    size_t              buf_cap;    /**< Capacity of buffer. */
+    uint32_t            seed;       /**< Random seed for node level. */
+    size_t              lock_idx;   /**< Index of read lock in #infra_shared_map::locks. */
+} infra_shared_map_handle_t;
+
+static infra_rwlock_t s_shared_map_lock = INFRA_RWLOCK_INITIALIZER;
+static infra_shared_map_t* s_shared_map_list = NULL;
+
+static infra_shared_node_t** _infra_shared_node_links(infra_shared_node_t* node)
+{
+    return (infra_shared_node_t**)(node + 1);
+}
+
+#if LUA_VERSION_NUM >= 503
+
+/**
+ * @brief Convert number key \p src into native key \p dst.
+ */
+static void _infra_shared_key_number(const infra_shared_key_t* src, infra_key_t* dst)
+{
+    dst->type = LUA_TNUMBER;
+    dst->native = 1;
+    dst->integer = src->tag == INFRA_SHARED_INTEGER;
+    if (dst->integer)
+    {
+        dst->v.i = (lua_Integer)src->v.i;
+    }
+    else
+    {
+        dst->v.n = src->v.n;
+    }
+}
+
+#endif
+
+static int _infra_shared_key_cmp(const infra_shared_key_t* a, const infra_shared_key_t* b)
+{
+    int a_str = a->tag == INFRA_SHARED_STRING;
+    int b_str = b->tag == INFRA_SHARED_STRING;
+    if (a_str != b_str)
+    {
+        return a_str ? 1 : -1;
+    }
+
+    if (a_str)
+    {
+        size_t len = a->len < b->len ? a->len : b->len;
+        int ret = memcmp(a->str, b->str, len);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        return a->len == b->len ? 0 : (a->len < b->len ? -1 : 1);
+    }
+
+    if (a->tag == INFRA_SHARED_INTEGER && b->tag == INFRA_SHARED_INTEGER)
+    {
+        return a->v.i == b->v.i ? 0 : (a->v.i < b->v.i ? -1 : 1);
+    }
+
+#if LUA_VERSION_NUM >= 503
+    /* Integers do not fit in double, compare them exactly. */
+    infra_key_t k1, k2;
+    _infra_shared_key_number(a, &k1);
+    _infra_shared_key_number(b, &k2);
+    return infra_key_compare_number(&k1, &k2);
+#else
+    return a->v.n == b->v.n ? 0 : (a->v.n < b->v.n ? -1 : 1);
+#endif
+}
+
+/**
+ * @brief Get key at \p idx. The key string is valid as long as the value at
+ *   \p idx is on the stack.
+ */
+static void _infra_shared_key_check(lua_State* L, int idx, infra_shared_key_t* key)
+{
+    memset(key, 0, sizeof(*key));
+    key->str = "";
+
+    switch (lua_type(L, idx))
+    {
+    case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, idx))
+        {
+            key->tag = INFRA_SHARED_INTEGER;
+            key->v.i = lua_tointeger(L, idx);
+            return;
+        }
+        else
+        {
+            /* Float with integral value is the same key as the integer. */
+            lua_Number n = lua_tonumber(L, idx);
+            if (n >= -9223372036854775808.0 && n < 9223372036854775808.0 && (lua_Number)(lua_Integer)n == n)
+            {
+                key->tag = INFRA_SHARED_INTEGER;
+                key->v.i = (lua_Integer)n;
+                return;
+            }
+        }
+#endif
+        key->tag = INFRA_SHARED_NUMBER;
+        key->v.n = lua_tonumber(L, idx);
+        if (key->v.n != key->v.n)
+        {
+            luaL_error(L, "key is NaN.");
+        }
+        return;
+
+    case LUA_TSTRING:
+        key->tag = INFRA_SHARED_STRING;
+        key->str = lua_tolstring(L, idx, &key->len);
+        return;
+
+    default:
+        luaL_error(L, "key must be a number or a string, got %s.", luaL_typename(L, idx));
+        return;
+    }
+}
+
+static void _infra_shared_key_push(lua_State* L, const infra_shared_key_t* key)
+{
+    switch (key->tag)
+    {
+    case INFRA_SHARED_INTEGER:
+#if LUA_VERSION_NUM >= 503
+        lua_pushinteger(L, (lua_Integer)key->v.i);
+#else
+        lua_pushnumber(L, (lua_Number)key->v.i);
+#endif
+        break;
+
+    case INFRA_SHARED_NUMBER:
+        lua_pushnumber(L, key->v.n);
+        break;
+
+    default:
+        lua_pushlstring(L, key->str, key->len);
+        break;
+    }
+}
+
+/**
+ * @brief Ensure scratch buffer have at least \p size bytes.
+ * @return 0 if success, or -1 if out of memory.
+ */
+static int _infra_shared_buf_reserve(infra_shared_map_handle_t* self, size_t size)
+{
+    if (size <= self->buf_cap)
+    {
+        return 0;
+    }
+
+    size_t new_cap = self->buf_cap != 0 ? self->buf_cap : 64;
+    while (new_cap < size)
+    {
+        new_cap *= 2;
+    }
+
+    char* new_buf = realloc(self->buf, new_cap);
+    if (new_buf == NULL)
+    {
+        return -1;
+    }
+
+    self->buf = new_buf;
+    self->buf_cap = new_cap;
+    return 0;
+}
+
+static void _infra_shared_buf_append(lua_State* L, infra_shared_map_handle_t* self, const void* data, size_t size)
+{
+    if (_infra_shared_buf_reserve(self, self->buf_sz + size) != 0)
+    {
+        luaL_error(L, INFRA_LUA_ERRMSG_OOM);
+        return;
+    }
+
+    memcpy(self->buf + self->buf_sz, data, size);
+    self->buf_sz += size;
+}
+
+static void _infra_shared_buf_append_tag(lua_State* L, infra_shared_map_handle_t* self, int tag)
+{
+    unsigned char c = (unsigned char)tag;
+    _infra_shared_buf_append(L, self, &c, sizeof(c));
+}
+
+/**
+ * @brief Append encoded value at \p idx into scratch buffer.
+ */
+static void _infra_shared_encode(lua_State* L, infra_shared_map_handle_t* self, int idx, int depth)
+{
+    switch (lua_type(L, idx))
+    {
+    case LUA_TBOOLEAN:
+        _infra_shared_buf_append_tag(L, self, lua_toboolean(L, idx) ? INFRA_SHARED_TRUE : INFRA_SHARED_FALSE);
+        break;
+
+    case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, idx))
+        {
+            int64_t i = (int64_t)lua_tointeger(L, idx);
+            _infra_shared_buf_append_tag(L, self, INFRA_SHARED_INTEGER);
+            _infra_shared_buf_append(L, self, &i, sizeof(i));
+            break;
+        }
+#endif
+        {
+            double n = (double)lua_tonumber(L, idx);
+            _infra_shared_buf_append_tag(L, self, INFRA_SHARED_NUMBER);
+            _infra_shared_buf_append(L, self, &n, sizeof(n));
+        }
+        break;
+
+    case LUA_TSTRING:
+        {
+            size_t len;
+            const char* str = lua_tolstring(L, idx, &len);
+            uint64_t len64 = len;
+            _infra_shared_buf_append_tag(L, self, INFRA_SHARED_STRING);
+            _infra_shared_buf_append(L, self, &len64, sizeof(len64));
+            _infra_shared_buf_append(L, self, str, len);
+        }
+        break;
+
+    case LUA_TTABLE:
+        {
+            if (depth >= INFRA_SHARED_MAP_MAX_DEPTH)
+            {
+                luaL_error(L, "table is nested too deep.");
+                return;
+            }
+            luaL_checkstack(L, 3, NULL);
+
+            uint64_t cnt = 0;
+            _infra_shared_buf_append_tag(L, self, INFRA_SHARED_TABLE);
+            size_t cnt_pos = self->buf_sz;
+            _infra_shared_buf_append(L, self, &cnt, sizeof(cnt));
+
+            int sp = lua_gettop(L);
+            idx = lua_absindex(L, idx);
+            lua_pushnil(L);
+            while (lua_next(L, idx) != 0)
+            {
+                _infra_shared_encode(L, self, sp + 1, depth + 1);
+                _infra_shared_encode(L, self, sp + 2, depth + 1);
+                lua_pop(L, 1);
+                cnt++;
+            }
+            memcpy(self->buf + cnt_pos, &cnt, sizeof(cnt));
+        }
+        break;
+
+    default:
+        luaL_error(L, "cannot share value of type %s.", luaL_typename(L, idx));
+        break;
+    }
+}
+
+/**
+ * @brief Push value decoded from \p pos, and move \p pos to next value.
+ */
+static void _infra_shared_decode(lua_State* L, const char** pos)
+{
+    unsigned char tag = (unsigned char)**pos;
+    *pos += 1;
+
+    switch (tag)
+    {
+    case INFRA_SHARED_FALSE:
+    case INFRA_SHARED_TRUE:
+        lua_pushboolean(L, tag == INFRA_SHARED_TRUE);
+        break;
+
+    case INFRA_SHARED_NUMBER:
+        {
+            double n;
+            memcpy(&n, *pos, sizeof(n));
+            *pos += sizeof(n);
+            lua_pushnumber(L, (lua_Number)n);
+        }
+        break;
+
+    case INFRA_SHARED_INTEGER:
+        {
+            int64_t i;
+            memcpy(&i, *pos, sizeof(i));
+            *pos += sizeof(i);
+#if LUA_VERSION_NUM >= 503
+            lua_pushinteger(L, (lua_Integer)i);
+#else
+            lua_pushnumber(L, (lua_Number)i);
+#endif
+        }
+        break;
+
+    case INFRA_SHARED_STRING:
+        {
+            uint64_t len;
+            memcpy(&len, *pos, sizeof(len));
+            *pos += sizeof(len);
+            lua_pushlstring(L, *pos, (size_t)len);
+            *pos += len;
+        }
+        break;
+
+    default:
+        {
+            uint64_t i, cnt;
+            memcpy(&cnt, *pos, sizeof(cnt));
+            *pos += sizeof(cnt);
+
+            luaL_checkstack(L, 3, NULL);
+            lua_createtable(L, 0, cnt > INT32_MAX ? INT32_MAX : (int)cnt);
+            for (i = 0; i < cnt; i++)
+            {
+                _infra_shared_decode(L, pos);
+                _infra_shared_decode(L, pos);
+                lua_rawset(L, -3);
+            }
+        }
+        break;
+    }
+}
+
+static void _infra_shared_map_free(infra_shared_map_t* map)
+{
+    size_t i;
+    infra_shared_node_t* node = map->head[0];
+    while (node != NULL)
+    {
+        infra_shared_node_t* next = _infra_shared_node_links(node)[0];
+        free(node);
+        node = next;
+    }
+
+    for (i = 0; i < INFRA_SHARED_MAP_LOCKS; i++)
+    {
+        _infra_rwlock_exit(&map->locks[i].lock);
+    }
+    free(map);
+}
+
+/**
+ * @brief Find map by \p name in registry, or create it if not exist.
+ * @param[out] lock_idx Read lock for the new handle.
+ * @return Shared map with reference count increased, or NULL if out of memory.
+ */
+static infra_shared_map_t* _infra_shared_map_acquire(const char* name, size_t name_sz, size_t* lock_idx)
+{
+    infra_shared_map_t* map;
+    size_t i;
+
+    _infra_rwlock_wrlock(&s_shared_map_lock);
+    for (map = s_shared_map_list; map != NULL; map = map->next)
+    {
+        if (map->name_sz == name_sz && memcmp(map->name, name, name_sz) == 0)
+        {
+            goto finish;
+        }
+    }
+
+    if ((map = calloc(1, sizeof(infra_shared_map_t) + name_sz + 1)) == NULL)
+    {
+        goto error;
+    }
+    for (i = 0; i < INFRA_SHARED_MAP_LOCKS; i++)
+    {
+        if (_infra_rwlock_init(&map->locks[i].lock) != 0)
+        {
+            while (i-- > 0)
+            {
+                _infra_rwlock_exit(&map->locks[i].lock);
+            }
+            free(map);
+            map = NULL;
+            goto error;
+        }
+    }
+    memcpy(map + 1, name, name_sz);
+    map->name = (const char*)(map + 1);
+    map->name_sz = name_sz;
+    map->level = 1;
+    map->next = s_shared_map_list;
+    s_shared_map_list = map;
+
+finish:
+    map->refcnt++;
+    *lock_idx = map->handles++ % INFRA_SHARED_MAP_LOCKS;
+error:
+    _infra_rwlock_wrunlock(&s_shared_map_lock);
+    return map;
+}
+
+/**
+ * @brief Decrease reference count of \p map, and destroy it if no one use it.
+ */
+static void _infra_shared_map_release(infra_shared_map_t* map)
+{
+    infra_shared_map_t** link;
+
+    _infra_rwlock_wrlock(&s_shared_map_lock);
+    if (--map->refcnt != 0)
+    {
+        map = NULL;
+    }
+    else
+    {
+        for (link = &s_shared_map_list; *link != map; link = &(*link)->next)
+        {
+        }
+        *link = map->next;
+    }
+    _infra_rwlock_wrunlock(&s_shared_map_lock);
+
+    if (map != NULL)
+    {
+        _infra_shared_map_free(map);
+    }
+}
+
+static void _infra_shared_map_rdlock(infra_shared_map_handle_t* self)
+{
+    _infra_rwlock_rdlock(&self->map->locks[self->lock_idx].lock);
+}
+
+static void _infra_shared_map_rdunlock(infra_shared_map_handle_t* self)
+{
+    _infra_rwlock_rdunlock(&self->map->locks[self->lock_idx].lock);
+}
+
+static void _infra_shared_map_wrlock(infra_shared_map_t* map)
+{
+    size_t i;
+    for (i = 0; i < INFRA_SHARED_MAP_LOCKS; i++)
+    {
+        _infra_rwlock_wrlock(&map->locks[i].lock);
+    }
+}
+
+static void _infra_shared_map_wrunlock(infra_shared_map_t* map)
+{
+    size_t i = INFRA_SHARED_MAP_LOCKS;
+    while (i-- > 0)
+    {
+        _infra_rwlock_wrunlock(&map->locks[i].lock);
+    }
+}
+
+/**
+ * @brief Find links that point to the first node not less than \p key.
+ * @note Must hold lock.
+ */
+static void _infra_shared_map_search(infra_shared_map_t* map, const infra_shared_key_t* key,
+    infra_shared_node_t** update[INFRA_SHARED_MAP_MAX_LEVEL])
+{
+    int i;
+    infra_shared_node_t* node;
+    infra_shared_node_t** links = map->head;
+
+    for (i = map->level - 1; i >= 0; i--)
+    {
+        while ((node = links[i]) != NULL && _infra_shared_key_cmp(&node->key, key) < 0)
+        {
+            links = _infra_shared_node_links(node);
+        }
+        update[i] = &links[i];
+    }
+}
+
+/**
+ * @brief Find node equal to \p key.
+ * @note Must hold lock.
+ */
+static infra_shared_node_t* _infra_shared_map_find(infra_shared_map_t* map, const infra_shared_key_t* key)
+{
+    infra_shared_node_t** update[INFRA_SHARED_MAP_MAX_LEVEL];
+    _infra_shared_map_search(map, key, update);
+
+    infra_shared_node_t* node = *update[0];
+    if (node != NULL && _infra_shared_key_cmp(&node->key, key) == 0)
+    {
+        return node;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find first node greater than \p key.
+ * @note Must hold lock.
+ */
+static infra_shared_node_t* _infra_shared_map_upper_bound(infra_shared_map_t* map, const infra_shared_key_t* key)
+{
+    infra_shared_node_t** update[INFRA_SHARED_MAP_MAX_LEVEL];
+    _infra_shared_map_search(map, key, update);
+
+    infra_shared_node_t* node = *update[0];
+    if (node != NULL && _infra_shared_key_cmp(&node->key, key) == 0)
+    {
+        node = _infra_shared_node_links(node)[0];
+    }
+    return node;
+}
+
+/**
+ * @brief Find the last node.
+ * @note Must hold lock.
+ */
+static infra_shared_node_t* _infra_shared_map_last(infra_shared_map_t* map)
+{
+    int i;
+    infra_shared_node_t* node = NULL;
+    infra_shared_node_t** links = map->head;
+
+    for (i = map->level - 1; i >= 0; i--)
+    {
+        while (links[i] != NULL)
+        {
+            node = links[i];
+            links = _infra_shared_node_links(node);
+        }
+    }
+    return node;
+}
+
+/**
+ * @brief Unlink node equal to \p key.
+ * @note Must hold write lock.
+ * @return The unlinked node, or NULL if not found.
+ */
+static infra_shared_node_t* _infra_shared_map_unlink(infra_shared_map_t* map, const infra_shared_key_t* key,
+    infra_shared_node_t** update[INFRA_SHARED_MAP_MAX_LEVEL])
+{
+    int i;
+    _infra_shared_map_search(map, key, update);
+
+    infra_shared_node_t* node = *update[0];
+    if (node == NULL || _infra_shared_key_cmp(&node->key, key) != 0)
+    {
+        return NULL;
+    }
+
+    infra_shared_node_t** links = _infra_shared_node_links(node);
+    for (i = 0; i < node->level; i++)
+    {
+        *update[i] = links[i];
+    }
+    map->size--;
+
+    return node;
+}
+
+static infra_shared_map_handle_t* _infra_shared_map_check(lua_State* L, int idx)
+{
+    infra_shared_map_handle_t* self = luaL_checkudata(L, idx, INFRA_SHARED_MAP_NAME);
+    if (self->map == NULL)
+    {
+        luaL_error(L, "shared map is closed.");
+    }
+    return self;
+}
+
+/**
+ * @brief Copy key string and value of \p node into scratch buffer.
+ * @note Must hold lock. Never raise error.
+ * @param[out] key  Key that points into scratch buffer.
+ * @return 0 if success, or -1 if out of memory.
+ */
+static int _infra_shared_map_copy_node(infra_shared_map_handle_t* self, const infra_shared_node_t* node,
+    infra_shared_key_t* key)
+{
+    if (_infra_shared_buf_reserve(self, node->key.len + node->value_sz) != 0)
+    {
+        return -1;
+    }
+
+    *key = node->key;
+    memcpy(self->buf, node->key.str, node->key.len);
+    memcpy(self->buf + node->key.len, node->value, node->value_sz);
+    key->str = self->buf;
+    self->buf_sz = node->key.len + node->value_sz;
+
+    return 0;
+}
+
+/**
+ * @brief Push key and value copied by #_infra_shared_map_copy_node().
+ */
+static int _infra_shared_map_push_copy(lua_State* L, infra_shared_map_handle_t* self,
+    const infra_shared_key_t* key)
+{
+    const char* pos = self->buf + key->len;
+    _infra_shared_key_push(L, key);
+    _infra_shared_decode(L, &pos);
+    return 2;
+}
+
+/**
+ * @brief Read the node found by \p fn under read lock, and push its key and value.
+ * @return The number of pushed values.
+ */
+static int _infra_shared_map_read(lua_State* L, infra_shared_map_handle_t* self,
+    infra_shared_node_t* (*fn)(infra_shared_map_t*, const infra_shared_key_t*), const infra_shared_key_t* key)
+{
+    infra_shared_key_t copy;
+    int ret = 0;
+
+    _infra_shared_map_rdlock(self);
+    infra_shared_node_t* node = fn(self->map, key);
+    if (node != NULL)
+    {
+        ret = _infra_shared_map_copy_node(self, node, &copy) == 0 ? 1 : -1;
+    }
+    _infra_shared_map_rdunlock(self);
+
+    if (ret < 0)
+    {
+        return luaL_error(L, INFRA_LUA_ERRMSG_OOM);
+    }
+    if (ret == 0)
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+    return _infra_shared_map_push_copy(L, self, &copy);
+}
+
+static infra_shared_node_t* _infra_shared_map_first_wrap(infra_shared_map_t* map, const infra_shared_key_t* key)
+{
+    (void)key;
+    return map->head[0];
+}
+
+static infra_shared_node_t* _infra_shared_map_last_wrap(infra_shared_map_t* map, const infra_shared_key_t* key)
+{
+    (void)key;
+    return _infra_shared_map_last(map);
+}
+
+static int _infra_shared_map_gc(lua_State* L)
+{
+    infra_shared_map_handle_t* self = lua_touserdata(L, 1);
+
+    if (self->map != NULL)
+    {
+        _infra_shared_map_release(self->map);
+        self->map = NULL;
+    }
+
+    free(self->buf);
+    self->buf = NULL;
+    self->buf_sz = 0;
+    self->buf_cap = 0;
+
+    return 0;
+}
+
+static int _infra_shared_map_size(lua_State* L)
+{
+    infra_shared_map_handle_t* self = _infra_shared_map_check(L, 1);
+
+    _infra_shared_map_rdlock(self);
+    size_t size = self->map->size;
+    _infra_shared_map_rdunlock(self);
+
+    lua_pushinteger(L, (lua_Integer)size);
+    return 1;
+}
+
+static int _infra_shared_map_get(lua_State* L)
+{
+    infra_shared_map_handle_t* self = _infra_shared_map_check(L, 1);
+
+    infra_shared_key_t key;
+    _infra_shared_key_check(L, 2, &key);
+
+    if (_infra_shared_map_read(L, self, _infra_shared_map_find, &key) == 2)
+    {
+        lua_remove(L, -2);
+    }
+    return 1;
+}
+
+static int _infra_shared_map_remove(lua_State* L)
+{
+    infra_shared_map_handle_t* self = _infra_shared_map_check(L, 1);
+
+    infra_shared_key_t key;
+    _infra_shared_key_check(L, 2, &key);
+
+    infra_shared_node_t** update[INFRA_SHARED_MAP_MAX_LEVEL];
+    _infra_shared_map_wrlock(self->map);
+    infra_shared_node_t* node = _infra_shared_map_unlink(self->map, &key, update);
+    _infra_shared_map_wrunlock(self->map);
+
+    free(node);
+    lua_pushboolean(L, node != NULL);
+    return 1;
+}
+
+static int _infra_shared_map_random_level(infra_shared_map_handle_t* self)
+{
+    int level = 1;
+    for (;;)
+    {
+        /* xorshift32 */
+        self->seed ^= self->seed << 13;
+        self->seed ^= self->seed >> 17;
+        self->seed ^= self->seed << 5;
+
+        if (level >= INFRA_SHARED_MAP_MAX_LEVEL || (self->seed & 3) != 0)
+        {
+            break;
+        }
+        level++;
+    }
+    return level;
+}
+
+static int _infra_shared_map_set(lua_State* L)
+{
+    infra_shared_map_handle_t* self = _infra_shared_map_check(L, 1);
+    lua_settop(L, 3);
+
+    if (lua_type(L, 3) == LUA_TNIL)
+    {
+        lua_pop(L, 1);
+        _infra_shared_map_remove(L);
+        return 0;
+    }
+
+    infra_shared_key_t key;
+    _infra_shared_key_check(L, 2, &key);
+
+    self->buf_sz = 0;
+    _infra_shared_encode(L, self, 3, 0);
+
+    /* Build node outside of lock. */
+    int i, level = _infra_shared_map_random_level(self);
+    size_t links_sz = sizeof(infra_shared_node_t*) * level;
+    infra_shared_node_t* node = malloc(sizeof(infra_shared_node_t) + links_sz + key.len + self->buf_sz);
+    INFRA_CHECK_OOM(L, node);
+
+    char* pos = (char*)(node + 1) + links_sz;
+    node->key = key;
+    node->key.str = pos;
+    memcpy(pos, key.str, key.len);
+    node->value = pos + key.len;
+    node->value_sz = self->buf_sz;
+    memcpy(pos + key.len, self->buf, self->buf_sz);
+    node->level = level;
+
+    infra_shared_node_t** update[INFRA_SHARED_MAP_MAX_LEVEL];
+    infra_shared_node_t** links = _infra_shared_node_links(node);
+    infra_shared_map_t* map = self->map;
+
+    _infra_shared_map_wrlock(map);
+    {
+        infra_shared_node_t* old = _infra_shared_map_unlink(map, &key, update);
+        for (i = map->level; i < level; i++)
+        {
+            update[i] = &map->head[i];
+        }
+        if (level > map->level)
+        {
+            map->level = level;
+        }
+        for (i = 0; i < level; i++)
+        {
+            links[i] = *update[i];
+            *update[i] = node;
+        }
+        map->size++;
+        node = old;
+    }
+    _infra_shared_map_wrunlock(map);
+
+    free(node);
+    return 0;
+}
+
+static int _infra_shared_map_first(lua_State* L)
+{
+    infra_shared_map_handle_t* self = _infra_shared_map_check(L, 1);
+    return _infra_shared_map_read(L, self, _infra_shared_map_first_wrap, NULL);
+}
+
+static int _infra_shared_map_last_method(lua_State* L)
+{
+    infra_shared_map_handle_t* self = _infra_shared_map_check(L, 1);
+    return _infra_shared_map_read(L, self, _infra_shared_map_last_wrap, NULL);
+}
+
+/**
+ * @brief Iterator function. Each step look up the next key again, so it is
+ *   safe to modify the map during iteration.
+ */
+static int _infra_shared_map_next(lua_State* L)
+{
+    infra_shared_map_handle_t* self = _infra_shared_map_check(L, 1);
+
+    if (lua_type(L, 2) == LUA_TNIL)
+    {
+        return _infra_shared_map_read(L, self, _infra_shared_map_first_wrap, NULL);
+    }
+
+    infra_shared_key_t key;
+    _infra_shared_key_check(L, 2, &key);
+    return _infra_shared_map_read(L, self, _infra_shared_map_upper_bound, &key);
+}
+
+static int _infra_shared_map_pairs(lua_State* L)
+{
+    _infra_shared_map_check(L, 1);
+
+    lua_pushcfunction(L, _infra_shared_map_next);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+static int _infra_shared_map_name(lua_State* L)
+{
+    infra_shared_map_handle_t* self = _infra_shared_map_check(L, 1);
+    lua_pushlstring(L, self->map->name, self->map->name_sz);
+    return 1;
+}
+
+static int _infra_new_shared_map(lua_State* L)
+{
+    size_t name_sz;
+    const char* name = luaL_checklstring(L, 1, &name_sz);
+
+    infra_shared_map_handle_t* self = lua_newuserdata(L, sizeof(infra_shared_map_handle_t));
+    memset(self, 0, sizeof(*self));
+    self->seed = (uint32_t)(uintptr_t)self | 1;
+
+    static const luaL_Reg s_meta[] = {
+        { "__gc",       _infra_shared_map_gc },
+        { "__pairs",    _infra_shared_map_pairs },
+        { NULL,         NULL },
+    };
+    static const luaL_Reg s_method[] = {
+        { "name",       _infra_shared_map_name },
+        { "size",       _infra_shared_map_size },
+        { "get",        _infra_shared_map_get },
+        { "set",        _infra_shared_map_set },
+        { "remove",     _infra_shared_map_remove },
+        { "first",      _infra_shared_map_first },
+        { "last",       _infra_shared_map_last_method },
+        { "pairs",      _infra_shared_map_pairs },
+        { NULL,         NULL },
+    };
+    if (luaL_newmetatable(L, INFRA_SHARED_MAP_NAME) != 0)
+    {
+        luaL_setfuncs(L, s_meta, 0);
+
+        /* metatable.__index = s_method */
+        luaL_newlib(L, s_method);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+
+    self->map = _infra_shared_map_acquire(name, name_sz, &self->lock_idx);
+    INFRA_CHECK_OOM(L, self->map);
+
+    return 1;
+}
+
+const infra_lua_api_t infra_f_shared_map = {
+"make_shared_map", _infra_new_shared_map, 0,
+"Open a map that is shared by all Lua states in the process.",
+
+"[SYNOPSIS]\n"
+"shared_map make_shared_map(name)\n"
+"\n"
+"[DESCRIPTION]\n"
+"Open the ordered map called `name`, creating it if not exist. Every call\n"
+"with the same `name`, from any Lua state on any thread of the process,\n"
+"opens the same map. The map lives in C memory, and it is destroyed when\n"
+"the last handle is garbage collected.\n"
+"\n"
+"Keys must be numbers or strings. Numbers sort before strings, and strings\n"
+"compare byte by byte. Values are copied into the map on write, and copied\n"
+"back on read, so they must be plain data: boolean, number, string, or table\n"
+"that only contains plain data. Assign nil to remove a key.\n"
+"\n"
+"Each map is protected by 16 reader-writer locks. Every handle reads under\n"
+"one of them, picked in turn as handles are opened, and a write takes all of\n"
+"them. So any number of states can read at the same time, and readers on\n"
+"different locks do not touch the same cacheline. Decoding happens after\n"
+"the lock is released.\n"
+"\n"
+"A shared map have following metamethod:\n"
+"  string shared_map:name()\n"
+"    Return the name of map.\n"
+"  integer shared_map:size()\n"
+"    Return the number of keys.\n"
+"  any shared_map:get(key)\n"
+"    Return a copy of the value, or nil if not found.\n"
+"  shared_map:set(key, value)\n"
+"    Store a copy of `value`, or remove `key` if `value` is nil.\n"
+"  boolean shared_map:remove(key)\n"
+"    Remove `key`. Return true if `key` was found.\n"
+"  any,any shared_map:first()\n"
+"    Return the smallest key and its value, or nil if map is empty.\n"
+"  any,any shared_map:last()\n"
+"    Return the largest key and its value, or nil if map is empty.\n"
+"  shared_map:pairs()\n"
+"    Use in `for k,v in shared_map:pairs() do ... end`. Keys are visited in\n"
+"    order, and it is safe to modify the map during iteration.\n"
+};
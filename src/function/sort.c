@@ -0,0 +1,515 @@
+#include "__init__.h"
+
+/**
+ * @brief Ranges not larger than this are sorted by insertion sort.
+ */
+#define INFRA_SORT_INSERTION_THRESHOLD  16
+
+typedef struct infra_sort_entry
+{
+    infra_key_t         key;        /**< Native copy of element. */
+    lua_Integer         pos;        /**< Position of element in value copy. */
+} infra_sort_entry_t;
+
+struct infra_sort;
+typedef int (*infra_sort_cmp_fn)(struct infra_sort* self, const infra_sort_entry_t* e1,
+    const infra_sort_entry_t* e2);
+
+typedef struct infra_sort
+{
+    lua_State*          L;          /**< Lua VM. */
+    infra_sort_cmp_fn   cmp;        /**< Comparator. */
+    int                 reverse;    /**< Whether in descending order. */
+    int                 idx_copy;   /**< Stack index of value copy. */
+    int                 idx_cmp;    /**< Stack index of Lua comparator. */
+} infra_sort_t;
+
+static int _infra_sort_cmp_number(infra_sort_t* self, const infra_sort_entry_t* e1,
+    const infra_sort_entry_t* e2)
+{
+    (void)self;
+    return infra_key_compare_number(&e1->key, &e2->key);
+}
+
+static int _infra_sort_cmp_string(infra_sort_t* self, const infra_sort_entry_t* e1,
+    const infra_sort_entry_t* e2)
+{
+    (void)self;
+    return infra_compare_string(e1->key.v.s.str, e1->key.v.s.len, e2->key.v.s.str, e2->key.v.s.len);
+}
+
+static int _infra_sort_cmp_default(infra_sort_t* self, const infra_sort_entry_t* e1,
+    const infra_sort_entry_t* e2)
+{
+    int ret;
+    if (infra_key_compare(&e1->key, &e2->key, &ret))
+    {
+        return ret;
+    }
+
+    lua_State* L = self->L;
+    lua_pushcfunction(L, infra_f_compare.addr);
+    lua_rawgeti(L, self->idx_copy, e1->pos);
+    lua_rawgeti(L, self->idx_copy, e2->pos);
+    lua_call(L, 2, 1);
+
+    ret = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    return ret;
+}
+
+static int _infra_sort_cmp_lua(infra_sort_t* self, const infra_sort_entry_t* e1,
+    const infra_sort_entry_t* e2)
+{
+    lua_State* L = self->L;
+    lua_pushvalue(L, self->idx_cmp);
+    lua_rawgeti(L, self->idx_copy, e1->pos);
+    lua_rawgeti(L, self->idx_copy, e2->pos);
+    lua_call(L, 2, 1);
+
+    lua_Number ret = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
+    return ret < 0 ? -1 : (ret > 0 ? 1 : 0);
+}
+
+static int _infra_sort_cmp(infra_sort_t* self, const infra_sort_entry_t* e1, const infra_sort_entry_t* e2)
+{
+    int ret = self->cmp(self, e1, e2);
+    return self->reverse ? -ret : ret;
+}
+
+static void _infra_sort_swap(infra_sort_entry_t* e1, infra_sort_entry_t* e2)
+{
+    infra_sort_entry_t tmp = *e1;
+    *e1 = *e2;
+    *e2 = tmp;
+}
+
+/**
+ * @brief Stable insertion sort.
+ */
+static void _infra_sort_insertion(infra_sort_t* self, infra_sort_entry_t* e, size_t n)
+{
+    size_t i, j;
+    for (i = 1; i < n; i++)
+    {
+        infra_sort_entry_t tmp = e[i];
+        for (j = i; j > 0 && _infra_sort_cmp(self, &tmp, &e[j - 1]) < 0; j--)
+        {
+            e[j] = e[j - 1];
+        }
+        e[j] = tmp;
+    }
+}
+
+/**
+ * @brief Sift down \p pos in max-heap \p e of \p n elements.
+ */
+static void _infra_sort_sift_down(infra_sort_t* self, infra_sort_entry_t* e, size_t pos, size_t n)
+{
+    for (;;)
+    {
+        size_t child = pos * 2 + 1;
+        if (child >= n)
+        {
+            break;
+        }
+        if (child + 1 < n && _infra_sort_cmp(self, &e[child], &e[child + 1]) < 0)
+        {
+            child++;
+        }
+        if (_infra_sort_cmp(self, &e[pos], &e[child]) >= 0)
+        {
+            break;
+        }
+        _infra_sort_swap(&e[pos], &e[child]);
+        pos = child;
+    }
+}
+
+static void _infra_sort_make_heap(infra_sort_t* self, infra_sort_entry_t* e, size_t n)
+{
+    size_t i;
+    for (i = n / 2; i > 0; i--)
+    {
+        _infra_sort_sift_down(self, e, i - 1, n);
+    }
+}
+
+/**
+ * @brief Sort a max-heap in place.
+ */
+static void _infra_sort_sort_heap(infra_sort_t* self, infra_sort_entry_t* e, size_t n)
+{
+    for (; n > 1; n--)
+    {
+        _infra_sort_swap(&e[0], &e[n - 1]);
+        _infra_sort_sift_down(self, e, 0, n - 1);
+    }
+}
+
+/**
+ * @brief Partition around median of three.
+ *
+ * The scans are bounded, so an inconsistent comparator gives an unspecified
+ * order instead of reading out of range.
+ *
+ * @return Final position of pivot. Elements before it are not greater, and
+ *   elements after it are not less.
+ */
+static size_t _infra_sort_partition(infra_sort_t* self, infra_sort_entry_t* e, size_t n)
+{
+    size_t mid = n / 2;
+    if (_infra_sort_cmp(self, &e[mid], &e[0]) < 0)
+    {
+        _infra_sort_swap(&e[mid], &e[0]);
+    }
+    if (_infra_sort_cmp(self, &e[n - 1], &e[mid]) < 0)
+    {
+        _infra_sort_swap(&e[n - 1], &e[mid]);
+        if (_infra_sort_cmp(self, &e[mid], &e[0]) < 0)
+        {
+            _infra_sort_swap(&e[mid], &e[0]);
+        }
+    }
+    _infra_sort_swap(&e[0], &e[mid]);
+
+    size_t i = 0, j = n;
+    for (;;)
+    {
+        do
+        {
+            i++;
+        } while (i < n && _infra_sort_cmp(self, &e[i], &e[0]) < 0);
+
+        do
+        {
+            j--;
+        } while (j > 0 && _infra_sort_cmp(self, &e[0], &e[j]) < 0);
+
+        if (i >= j)
+        {
+            break;
+        }
+        _infra_sort_swap(&e[i], &e[j]);
+    }
+
+    _infra_sort_swap(&e[0], &e[j]);
+    return j;
+}
+
+/**
+ * @brief Introsort: quick sort that falls back to heap sort when recursion
+ *   goes too deep.
+ */
+static void _infra_sort_intro(infra_sort_t* self, infra_sort_entry_t* e, size_t n, int depth)
+{
+    while (n > INFRA_SORT_INSERTION_THRESHOLD)
+    {
+        if (depth-- == 0)
+        {
+            _infra_sort_make_heap(self, e, n);
+            _infra_sort_sort_heap(self, e, n);
+            return;
+        }
+
+        /* Recurse into the smaller part, loop on the larger one. */
+        size_t p = _infra_sort_partition(self, e, n);
+        if (p < n - p - 1)
+        {
+            _infra_sort_intro(self, e, p, depth);
+            e += p + 1;
+            n -= p + 1;
+        }
+        else
+        {
+            _infra_sort_intro(self, e + p + 1, n - p - 1, depth);
+            n = p;
+        }
+    }
+
+    _infra_sort_insertion(self, e, n);
+}
+
+/**
+ * @brief Stable merge sort.
+ * @param[in] aux   Buffer of at least `n / 2` elements.
+ */
+static void _infra_sort_merge(infra_sort_t* self, infra_sort_entry_t* e, size_t n, infra_sort_entry_t* aux)
+{
+    if (n <= INFRA_SORT_INSERTION_THRESHOLD)
+    {
+        _infra_sort_insertion(self, e, n);
+        return;
+    }
+
+    size_t m = n / 2;
+    _infra_sort_merge(self, e, m, aux);
+    _infra_sort_merge(self, e + m, n - m, aux);
+
+    /* Already in order. */
+    if (_infra_sort_cmp(self, &e[m - 1], &e[m]) <= 0)
+    {
+        return;
+    }
+
+    size_t i = 0, j = m, k = 0;
+    memcpy(aux, e, sizeof(infra_sort_entry_t) * m);
+    while (i < m && j < n)
+    {
+        e[k++] = _infra_sort_cmp(self, &e[j], &aux[i]) < 0 ? e[j++] : aux[i++];
+    }
+    while (i < m)
+    {
+        e[k++] = aux[i++];
+    }
+}
+
+/**
+ * @brief Move the smallest \p k elements to the front in order.
+ */
+static void _infra_sort_partial(infra_sort_t* self, infra_sort_entry_t* e, size_t n, size_t k)
+{
+    size_t i;
+    if (k == 0)
+    {
+        return;
+    }
+
+    _infra_sort_make_heap(self, e, k);
+    for (i = k; i < n; i++)
+    {
+        if (_infra_sort_cmp(self, &e[i], &e[0]) < 0)
+        {
+            _infra_sort_swap(&e[i], &e[0]);
+            _infra_sort_sift_down(self, e, 0, k);
+        }
+    }
+    _infra_sort_sort_heap(self, e, k);
+}
+
+/**
+ * @brief Put the element that would be at \p nth after sorting to \p nth,
+ *   with no greater element before it and no less element after it.
+ */
+static void _infra_sort_nth(infra_sort_t* self, infra_sort_entry_t* e, size_t n, size_t nth, int depth)
+{
+    while (n > INFRA_SORT_INSERTION_THRESHOLD)
+    {
+        if (depth-- == 0)
+        {
+            _infra_sort_make_heap(self, e, n);
+            _infra_sort_sort_heap(self, e, n);
+            return;
+        }
+
+        size_t p = _infra_sort_partition(self, e, n);
+        if (nth == p)
+        {
+            return;
+        }
+        if (nth < p)
+        {
+            n = p;
+        }
+        else
+        {
+            e += p + 1;
+            n -= p + 1;
+            nth -= p + 1;
+        }
+    }
+
+    _infra_sort_insertion(self, e, n);
+}
+
+static int _infra_sort_depth_limit(size_t n)
+{
+    int depth = 0;
+    for (; n > 1; n >>= 1)
+    {
+        depth += 2;
+    }
+    return depth;
+}
+
+/**
+ * @brief Setup comparator from option at \p idx.
+ */
+static void _infra_sort_setup_cmp(lua_State* L, infra_sort_t* self, int idx)
+{
+    switch (lua_type(L, idx))
+    {
+    case LUA_TNIL:
+        break;
+
+    case LUA_TFUNCTION:
+        self->cmp = _infra_sort_cmp_lua;
+        self->idx_cmp = lua_absindex(L, idx);
+        break;
+
+    case LUA_TSTRING:
+        if (strcmp(lua_tostring(L, idx), "reverse") != 0)
+        {
+            luaL_error(L, "unknown comparator `%s`.", lua_tostring(L, idx));
+            return;
+        }
+        self->reverse = 1;
+        break;
+
+    default:
+        luaL_error(L, "unknown value for `cmp`.");
+        break;
+    }
+}
+
+/**
+ * @brief Get optional integer field \p name of option at \p idx.
+ * @return 1 if field exists, 0 if not.
+ */
+static int _infra_sort_opt_integer(lua_State* L, int idx, const char* name, lua_Integer* value)
+{
+    int ret = 0;
+
+    lua_getfield(L, idx, name);
+    if (lua_type(L, -1) != LUA_TNIL)
+    {
+        if (lua_type(L, -1) != LUA_TNUMBER)
+        {
+            return luaL_error(L, "`%s` must be an integer.", name);
+        }
+        *value = lua_tointeger(L, -1);
+        ret = 1;
+    }
+    lua_pop(L, 1);
+
+    return ret;
+}
+
+static int _infra_sort(lua_State* L)
+{
+    size_t i, n;
+    int stable = 0, has_partial = 0, has_nth = 0;
+    lua_Integer partial = 0, nth = 0;
+
+    infra_sort_t self;
+    memset(&self, 0, sizeof(self));
+    self.L = L;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 2);
+    lua_pushnil(L); /* sp+3: Lua comparator. */
+
+    if (lua_type(L, 2) == LUA_TTABLE)
+    {
+        lua_getfield(L, 2, "cmp");
+        lua_replace(L, 3);
+
+        lua_getfield(L, 2, "stable");
+        stable = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+
+        has_partial = _infra_sort_opt_integer(L, 2, "partial_sort", &partial);
+        has_nth = _infra_sort_opt_integer(L, 2, "nth_element", &nth);
+    }
+    else if (lua_type(L, 2) != LUA_TNIL)
+    {
+        lua_pushvalue(L, 2);
+        lua_replace(L, 3);
+    }
+    _infra_sort_setup_cmp(L, &self, 3);
+
+    n = (size_t)luaL_len(L, 1);
+    if (has_nth && (nth < 1 || (size_t)nth > n))
+    {
+        return luaL_error(L, "`nth_element` out of range.");
+    }
+
+    /*
+     * Elements are sorted in a private copy, so the comparator can neither
+     * change them nor release strings that native keys borrow.
+     */
+    lua_createtable(L, n > INT32_MAX ? INT32_MAX : (int)n, 0);
+    self.idx_copy = lua_gettop(L);
+
+    infra_sort_entry_t* e = lua_newuserdata(L, sizeof(infra_sort_entry_t) * (n != 0 ? n : 1));
+    int all_number = 1, all_string = 1;
+    for (i = 0; i < n; i++)
+    {
+        lua_rawgeti(L, 1, (lua_Integer)i + 1);
+        infra_key_init(L, -1, &e[i].key);
+        e[i].pos = (lua_Integer)i + 1;
+        lua_rawseti(L, self.idx_copy, e[i].pos);
+
+        all_number = all_number && e[i].key.type == LUA_TNUMBER;
+        all_string = all_string && e[i].key.type == LUA_TSTRING;
+    }
+
+    /* Select a specialized comparator so there is no type check for each compare. */
+    if (self.cmp == NULL)
+    {
+        self.cmp = all_number ? _infra_sort_cmp_number :
+            (all_string ? _infra_sort_cmp_string : _infra_sort_cmp_default);
+    }
+
+    if (stable)
+    {
+        infra_sort_entry_t* aux = lua_newuserdata(L, sizeof(infra_sort_entry_t) * (n / 2 + 1));
+        _infra_sort_merge(&self, e, n, aux);
+    }
+    else if (has_nth)
+    {
+        _infra_sort_nth(&self, e, n, (size_t)nth - 1, _infra_sort_depth_limit(n));
+    }
+    else if (has_partial)
+    {
+        _infra_sort_partial(&self, e, n, partial < 0 ? 0 : ((size_t)partial > n ? n : (size_t)partial));
+    }
+    else
+    {
+        _infra_sort_intro(&self, e, n, _infra_sort_depth_limit(n));
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        lua_rawgeti(L, self.idx_copy, e[i].pos);
+        lua_rawseti(L, 1, (lua_Integer)i + 1);
+    }
+
+    lua_settop(L, 1);
+    return 1;
+}
+
+const infra_lua_api_t infra_f_sort = {
+"sort", _infra_sort, 0,
+"Sort array in place.",
+
+"[SYNOPSIS]\n"
+"table sort(table t[, table opt])\n"
+"table sort(table t[, function cmp])\n"
+"\n"
+"[DESCRIPTION]\n"
+"Sort elements `t[1]` to `t[#t]` in place, and return `t`.\n"
+"\n"
+"By default elements are ordered as `compare()`. Elements are compared\n"
+"natively, and arrays that only contain numbers or only contain strings use\n"
+"a specialized comparator. Unlike `table.sort()`, the sort is done on a copy\n"
+"of elements, so an inconsistent comparator never breaks the array, and\n"
+"metamethods of `t` are not used.\n"
+"\n"
+"The `opt` is a table that contains following field:\n"
+"  + `cmp`: A Lua function that returns a number like `compare()`, or\n"
+"    `reverse` to sort in descending order. Passing a function as second\n"
+"    argument is the same as `{ cmp = cmp }`.\n"
+"  + `stable`: If true, equal elements keep their relative order.\n"
+"  + `partial_sort`: An integer `k`. Only the smallest `k` elements are\n"
+"    sorted and moved to the front, the order of the rest is unspecified.\n"
+"  + `nth_element`: An integer `n`. Move the element that would be `t[n]`\n"
+"    after sorting to `t[n]`, with no greater elements before it and no less\n"
+"    elements after it.\n"
+"\n"
+"`stable` takes precedence over `nth_element`, which takes precedence over\n"
+"`partial_sort`.\n"
+};
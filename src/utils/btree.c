@@ -0,0 +1,1003 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "btree.h"
+
+/**
+ * @brief Max height of tree. Every inner node has at least 2 children, so
+ *   it is enough for any number of items that fits in memory.
+ */
+#define EV_BTREE_MAX_HEIGHT     (sizeof(size_t) * 8)
+
+/**
+ * @brief Max item size, so that a node always holds a few items.
+ */
+#define EV_BTREE_MAX_ITEM_SIZE  (EV_BTREE_NODE_SIZE / 4)
+
+/**
+ * @brief The minimum capacity of node.
+ */
+#define EV_BTREE_MIN_CAP        4
+
+/**
+ * @brief Node header size.
+ */
+#define EV_BTREE_HDR_SIZE       ALIGN_SIZE(sizeof(ev_btree_node_t), sizeof(void*) * 2)
+
+/**
+ * @brief Address of item \p i in \p base.
+ */
+#define EV_BTREE_ITEM(t, base, i)   ((char*)(base) + (i) * (t)->item_size)
+
+/**
+ * @brief Address of key \p i in \p base.
+ */
+#define EV_BTREE_KEY(t, base, i)    ((char*)(base) + (i) * (t)->key_size)
+
+struct ev_btree_node
+{
+    unsigned            leaf;   /**< Whether this is a leaf */
+    unsigned            num;    /**< Items in leaf, or separators in inner node */
+    ev_btree_node_t*    prev;   /**< Previous leaf */
+    ev_btree_node_t*    next;   /**< Next leaf */
+
+    /*
+     * Leaf:  item[leaf_cap]
+     * Inner: child[inner_cap], separator[inner_cap - 1]
+     *
+     * With integer keys, leaf is key[leaf_cap], item[leaf_cap], and
+     * separator is a key.
+     */
+};
+
+/**
+ * @brief The key to search for.
+ */
+typedef struct ev_btree_probe
+{
+    const void*         item;   /**< The item user given */
+    int64_t             key;    /**< Key of #ev_btree_probe::item, for integer keys */
+} ev_btree_probe_t;
+
+/**
+ * @brief One level of the path from root to leaf.
+ */
+typedef struct ev_btree_path
+{
+    ev_btree_node_t*    node;   /**< Inner node */
+    size_t              idx;    /**< Index of child that the path goes through */
+} ev_btree_path_t;
+
+/**
+ * @brief Keys of leaf. Without integer keys, they are the items themselves.
+ */
+static char* _ev_btree_leaf_keys(ev_btree_node_t* node)
+{
+    return (char*)node + EV_BTREE_HDR_SIZE;
+}
+
+static char* _ev_btree_items(const ev_btree_t* t, ev_btree_node_t* node)
+{
+    size_t offset = t->cmp.key != NULL ? t->leaf_cap * t->key_size : 0;
+    return (char*)node + EV_BTREE_HDR_SIZE + offset;
+}
+
+static ev_btree_node_t** _ev_btree_children(ev_btree_node_t* node)
+{
+    return (ev_btree_node_t**)((char*)node + EV_BTREE_HDR_SIZE);
+}
+
+static char* _ev_btree_keys(const ev_btree_t* t, ev_btree_node_t* node)
+{
+    return (char*)node + EV_BTREE_HDR_SIZE + t->inner_cap * sizeof(ev_btree_node_t*);
+}
+
+static ev_btree_node_t* _ev_btree_new_node(ev_btree_t* t, int leaf)
+{
+    ev_btree_node_t* node = malloc(t->node_size);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
+    node->leaf = leaf;
+    node->num = 0;
+    node->prev = NULL;
+    node->next = NULL;
+    t->node_cnt++;
+
+    return node;
+}
+
+static void _ev_btree_free_node(ev_btree_t* t, ev_btree_node_t* node)
+{
+    t->node_cnt--;
+    free(node);
+}
+
+static void _ev_btree_free_tree(ev_btree_t* t, ev_btree_node_t* node)
+{
+    if (!node->leaf)
+    {
+        unsigned i;
+        ev_btree_node_t** children = _ev_btree_children(node);
+        for (i = 0; i <= node->num; i++)
+        {
+            _ev_btree_free_tree(t, children[i]);
+        }
+    }
+    _ev_btree_free_node(t, node);
+}
+
+static void _ev_btree_probe(const ev_btree_t* t, const void* item, ev_btree_probe_t* probe)
+{
+    probe->item = item;
+    probe->key = t->cmp.key != NULL ? t->cmp.key(item, t->cmp.arg) : 0;
+}
+
+/**
+ * @brief Count keys less than \p key.
+ *
+ * Scan all keys instead of binary search, a node only has a few cache lines
+ * of keys. The signed compare is done by hand (sign of `keys[i] - key`,
+ * corrected for overflow), so the loop is vectorized even if the target has
+ * no 64-bit compare instruction.
+ */
+static size_t _ev_btree_search_integer(const int64_t* keys, size_t size, int64_t key)
+{
+    size_t i;
+    uint64_t cnt = 0;
+    uint64_t k = (uint64_t)key;
+
+    for (i = 0; i < size; i++)
+    {
+        uint64_t v = (uint64_t)keys[i];
+        uint64_t d = v - k;
+        cnt += (d ^ ((v ^ k) & (d ^ v))) >> 63;
+    }
+
+    return (size_t)cnt;
+}
+
+/**
+ * @brief Find position of \p probe in \p keys.
+ * @param[in] keys  Separators of inner node, or keys of leaf.
+ */
+static size_t _ev_btree_search(const ev_btree_t* t, const char* keys, size_t size,
+    const ev_btree_probe_t* probe, int* found)
+{
+    size_t lo = 0, hi = size;
+    *found = 0;
+
+    if (t->cmp.key != NULL)
+    {
+        const int64_t* ikeys = (const int64_t*)keys;
+        lo = _ev_btree_search_integer(ikeys, size, probe->key);
+        *found = lo < size && ikeys[lo] == probe->key;
+        return lo;
+    }
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int ret = t->cmp.cmp(EV_BTREE_ITEM(t, keys, mid), probe->item, t->cmp.arg);
+        if (ret < 0)
+        {
+            lo = mid + 1;
+        }
+        else if (ret > 0)
+        {
+            hi = mid;
+        }
+        else
+        {
+            *found = 1;
+            return mid;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * @brief Find the leaf that may contain \p probe.
+ * @param[out] path     Inner nodes from root. Can be NULL
+ * @param[out] depth    The number of inner nodes in path. Can be NULL
+ */
+static ev_btree_node_t* _ev_btree_descend(const ev_btree_t* t, const ev_btree_probe_t* probe,
+    ev_btree_path_t* path, size_t* depth)
+{
+    ev_btree_node_t* node = t->root;
+    size_t level = 0;
+
+    while (!node->leaf)
+    {
+        int found;
+        size_t pos = _ev_btree_search(t, _ev_btree_keys(t, node), node->num, probe, &found);
+
+        /* Separator equals to the smallest item of right child. */
+        pos += found;
+
+        if (path != NULL)
+        {
+            path[level].node = node;
+            path[level].idx = pos;
+        }
+        level++;
+        node = _ev_btree_children(node)[pos];
+    }
+
+    if (depth != NULL)
+    {
+        *depth = level;
+    }
+    return node;
+}
+
+/**
+ * @brief The smallest key of node at \p level changed to \p key, update the
+ *   separator that refers to it.
+ */
+static void _ev_btree_fix_min(ev_btree_t* t, ev_btree_path_t* path, size_t level,
+    const void* key)
+{
+    while (level > 0)
+    {
+        level--;
+        if (path[level].idx > 0)
+        {
+            memcpy(EV_BTREE_KEY(t, _ev_btree_keys(t, path[level].node), path[level].idx - 1),
+                key, t->key_size);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Insert \p item at \p pos. \p key is its integer key, unused without
+ *   integer keys.
+ */
+static void _ev_btree_leaf_insert(ev_btree_t* t, ev_btree_node_t* leaf, size_t pos,
+    const void* item, const void* key)
+{
+    char* items = _ev_btree_items(t, leaf);
+    memmove(EV_BTREE_ITEM(t, items, pos + 1), EV_BTREE_ITEM(t, items, pos),
+        (leaf->num - pos) * t->item_size);
+    memcpy(EV_BTREE_ITEM(t, items, pos), item, t->item_size);
+
+    if (t->cmp.key != NULL)
+    {
+        char* keys = _ev_btree_leaf_keys(leaf);
+        memmove(EV_BTREE_KEY(t, keys, pos + 1), EV_BTREE_KEY(t, keys, pos),
+            (leaf->num - pos) * t->key_size);
+        memcpy(EV_BTREE_KEY(t, keys, pos), key, t->key_size);
+    }
+
+    leaf->num++;
+}
+
+static void _ev_btree_leaf_remove(ev_btree_t* t, ev_btree_node_t* leaf, size_t pos)
+{
+    char* items = _ev_btree_items(t, leaf);
+    memmove(EV_BTREE_ITEM(t, items, pos), EV_BTREE_ITEM(t, items, pos + 1),
+        (leaf->num - pos - 1) * t->item_size);
+
+    if (t->cmp.key != NULL)
+    {
+        char* keys = _ev_btree_leaf_keys(leaf);
+        memmove(EV_BTREE_KEY(t, keys, pos), EV_BTREE_KEY(t, keys, pos + 1),
+            (leaf->num - pos - 1) * t->key_size);
+    }
+
+    leaf->num--;
+}
+
+/**
+ * @brief Copy \p cnt items from \p spos of \p src to \p dpos of \p dst.
+ */
+static void _ev_btree_leaf_copy(ev_btree_t* t, ev_btree_node_t* dst, size_t dpos,
+    ev_btree_node_t* src, size_t spos, size_t cnt)
+{
+    memcpy(EV_BTREE_ITEM(t, _ev_btree_items(t, dst), dpos),
+        EV_BTREE_ITEM(t, _ev_btree_items(t, src), spos), cnt * t->item_size);
+
+    if (t->cmp.key != NULL)
+    {
+        memcpy(EV_BTREE_KEY(t, _ev_btree_leaf_keys(dst), dpos),
+            EV_BTREE_KEY(t, _ev_btree_leaf_keys(src), spos), cnt * t->key_size);
+    }
+}
+
+/**
+ * @brief Insert separator at \p kpos and child at \p kpos + 1.
+ */
+static void _ev_btree_inner_insert(ev_btree_t* t, ev_btree_node_t* node, size_t kpos,
+    const void* key, ev_btree_node_t* child)
+{
+    char* keys = _ev_btree_keys(t, node);
+    ev_btree_node_t** children = _ev_btree_children(node);
+
+    memmove(EV_BTREE_KEY(t, keys, kpos + 1), EV_BTREE_KEY(t, keys, kpos),
+        (node->num - kpos) * t->key_size);
+    memcpy(EV_BTREE_KEY(t, keys, kpos), key, t->key_size);
+
+    memmove(&children[kpos + 2], &children[kpos + 1],
+        (node->num - kpos) * sizeof(ev_btree_node_t*));
+    children[kpos + 1] = child;
+
+    node->num++;
+}
+
+/**
+ * @brief Remove separator at \p kpos and child at \p kpos + 1.
+ */
+static void _ev_btree_inner_remove(ev_btree_t* t, ev_btree_node_t* node, size_t kpos)
+{
+    char* keys = _ev_btree_keys(t, node);
+    ev_btree_node_t** children = _ev_btree_children(node);
+
+    memmove(EV_BTREE_KEY(t, keys, kpos), EV_BTREE_KEY(t, keys, kpos + 1),
+        (node->num - kpos - 1) * t->key_size);
+    memmove(&children[kpos + 1], &children[kpos + 2],
+        (node->num - kpos - 1) * sizeof(ev_btree_node_t*));
+
+    node->num--;
+}
+
+/**
+ * @brief Split full \p leaf and insert \p item with integer key \p key at
+ *   \p pos.
+ * @param[out] sep  Separator for the new leaf.
+ * @return          The new leaf on the right.
+ */
+static ev_btree_node_t* _ev_btree_split_leaf(ev_btree_t* t, ev_btree_node_t* leaf,
+    ev_btree_node_t* right, size_t pos, const void* item, const void* key, void* sep)
+{
+    size_t cap = leaf->num;
+    size_t keep = (cap + 1) / 2;
+    size_t from = pos < keep ? keep - 1 : keep;
+
+    _ev_btree_leaf_copy(t, right, 0, leaf, from, cap - from);
+    right->num = (unsigned)(cap - from);
+    leaf->num = (unsigned)from;
+
+    if (pos < keep)
+    {
+        _ev_btree_leaf_insert(t, leaf, pos, item, key);
+    }
+    else
+    {
+        _ev_btree_leaf_insert(t, right, pos - keep, item, key);
+    }
+
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next != NULL)
+    {
+        leaf->next->prev = right;
+    }
+    else
+    {
+        t->tail = right;
+    }
+    leaf->next = right;
+
+    memcpy(sep, _ev_btree_leaf_keys(right), t->key_size);
+    return right;
+}
+
+/**
+ * @brief Split full inner \p node and insert separator \p key at \p kpos and
+ *   \p child at \p kpos + 1.
+ * @param[in,out] key   Separator to insert. Set to the separator that moves up.
+ */
+static ev_btree_node_t* _ev_btree_split_inner(ev_btree_t* t, ev_btree_node_t* node,
+    ev_btree_node_t* right, size_t kpos, void* key, ev_btree_node_t* child)
+{
+    size_t i;
+    size_t cnt = node->num; /* Number of separators before insert. */
+    size_t keep = (cnt + 1) / 2;
+    unsigned char up[EV_BTREE_MAX_ITEM_SIZE];
+
+    char* keys = _ev_btree_keys(t, node);
+    ev_btree_node_t** children = _ev_btree_children(node);
+    char* r_keys = _ev_btree_keys(t, right);
+    ev_btree_node_t** r_children = _ev_btree_children(right);
+
+    /*
+     * Combined separators are keys[0, kpos) + key + keys[kpos, cnt), and
+     * combined children are children[0, kpos] + child + children[kpos + 1, cnt].
+     * The left node keeps `keep` separators, the one at `keep` moves up.
+     */
+#define COMB_KEY(i) \
+    ((i) < kpos ? EV_BTREE_KEY(t, keys, (i)) : ((i) == kpos ? (char*)key : EV_BTREE_KEY(t, keys, (i) - 1)))
+#define COMB_CHILD(i) \
+    ((i) <= kpos ? children[(i)] : ((i) == kpos + 1 ? child : children[(i) - 1]))
+
+    for (i = keep + 1; i <= cnt; i++)
+    {
+        memcpy(EV_BTREE_KEY(t, r_keys, i - keep - 1), COMB_KEY(i), t->key_size);
+    }
+    for (i = keep + 1; i <= cnt + 1; i++)
+    {
+        r_children[i - keep - 1] = COMB_CHILD(i);
+    }
+    right->num = (unsigned)(cnt - keep);
+    memcpy(up, COMB_KEY(keep), t->key_size);
+
+#undef COMB_KEY
+#undef COMB_CHILD
+
+    node->num = (unsigned)(kpos < keep ? keep - 1 : keep);
+    if (kpos < keep)
+    {
+        _ev_btree_inner_insert(t, node, kpos, key, child);
+    }
+
+    memcpy(key, up, t->key_size);
+    return right;
+}
+
+static void _ev_btree_init(ev_btree_t* handler, size_t item_size,
+    ev_btree_cmp_fn cmp, ev_btree_key_fn key, void* arg)
+{
+    assert(item_size > 0 && item_size <= EV_BTREE_MAX_ITEM_SIZE);
+
+    memset(handler, 0, sizeof(*handler));
+    handler->item_size = item_size;
+    handler->key_size = key != NULL ? sizeof(int64_t) : item_size;
+    handler->cmp.cmp = cmp;
+    handler->cmp.key = key;
+    handler->cmp.arg = arg;
+
+    /* With integer keys, every item in leaf comes with a key. */
+    size_t key_size = handler->key_size;
+    size_t leaf_unit = key != NULL ? item_size + key_size : item_size;
+
+    size_t space = EV_BTREE_NODE_SIZE - EV_BTREE_HDR_SIZE;
+    handler->leaf_cap = space / leaf_unit;
+    if (handler->leaf_cap < EV_BTREE_MIN_CAP)
+    {
+        handler->leaf_cap = EV_BTREE_MIN_CAP;
+    }
+    handler->inner_cap = (space + key_size) / (key_size + sizeof(ev_btree_node_t*));
+    if (handler->inner_cap < EV_BTREE_MIN_CAP)
+    {
+        handler->inner_cap = EV_BTREE_MIN_CAP;
+    }
+
+    size_t leaf_size = EV_BTREE_HDR_SIZE + handler->leaf_cap * leaf_unit;
+    size_t inner_size = EV_BTREE_HDR_SIZE + handler->inner_cap * sizeof(ev_btree_node_t*)
+        + (handler->inner_cap - 1) * key_size;
+    handler->node_size = leaf_size > inner_size ? leaf_size : inner_size;
+}
+
+void ev_btree_init(ev_btree_t* handler, size_t item_size,
+    ev_btree_cmp_fn cmp, void* arg)
+{
+    _ev_btree_init(handler, item_size, cmp, NULL, arg);
+}
+
+void ev_btree_init_integer(ev_btree_t* handler, size_t item_size,
+    ev_btree_key_fn key, void* arg)
+{
+    _ev_btree_init(handler, item_size, NULL, key, arg);
+}
+
+void ev_btree_exit(ev_btree_t* handler)
+{
+    if (handler->root != NULL)
+    {
+        _ev_btree_free_tree(handler, handler->root);
+    }
+    handler->root = NULL;
+    handler->head = NULL;
+    handler->tail = NULL;
+    handler->size = 0;
+}
+
+int ev_btree_insert(ev_btree_t* handler, const void* item, ev_btree_iter_t* iter)
+{
+    size_t i, depth, need = 0;
+    ev_btree_path_t path[EV_BTREE_MAX_HEIGHT];
+    ev_btree_node_t* spare[EV_BTREE_MAX_HEIGHT + 1];
+    unsigned char sep[EV_BTREE_MAX_ITEM_SIZE];
+    ev_btree_probe_t probe;
+
+    if (handler->root == NULL)
+    {
+        ev_btree_node_t* leaf = _ev_btree_new_node(handler, 1);
+        if (leaf == NULL)
+        {
+            return -1;
+        }
+        handler->root = handler->head = handler->tail = leaf;
+    }
+
+    _ev_btree_probe(handler, item, &probe);
+    ev_btree_node_t* leaf = _ev_btree_descend(handler, &probe, path, &depth);
+
+    int found;
+    size_t pos = _ev_btree_search(handler, _ev_btree_leaf_keys(leaf), leaf->num, &probe, &found);
+    if (found)
+    {
+        if (iter != NULL)
+        {
+            iter->leaf = leaf;
+            iter->pos = pos;
+        }
+        return 1;
+    }
+
+    if (leaf->num < handler->leaf_cap)
+    {
+        _ev_btree_leaf_insert(handler, leaf, pos, item, &probe.key);
+        handler->size++;
+        if (pos == 0)
+        {
+            _ev_btree_fix_min(handler, path, depth, _ev_btree_leaf_keys(leaf));
+        }
+        return 0;
+    }
+
+    /* Allocate all nodes for split first, so the tree is never half updated. */
+    need = 1;
+    for (i = depth; i > 0 && path[i - 1].node->num == handler->inner_cap - 1; i--)
+    {
+        need++;
+    }
+    if (i == 0)
+    {
+        need++;
+    }
+    for (i = 0; i < need; i++)
+    {
+        spare[i] = _ev_btree_new_node(handler, i == 0);
+        if (spare[i] == NULL)
+        {
+            while (i > 0)
+            {
+                _ev_btree_free_node(handler, spare[--i]);
+            }
+            return -1;
+        }
+    }
+
+    ev_btree_node_t* node = leaf;
+    ev_btree_node_t* right = _ev_btree_split_leaf(handler, leaf, spare[0], pos, item, &probe.key, sep);
+    size_t used = 1;
+    size_t level = depth;
+
+    while (1)
+    {
+        if (level == 0)
+        {
+            ev_btree_node_t* root = spare[used++];
+            root->leaf = 0;
+            root->num = 1;
+            _ev_btree_children(root)[0] = node;
+            _ev_btree_children(root)[1] = right;
+            memcpy(_ev_btree_keys(handler, root), sep, handler->key_size);
+            handler->root = root;
+            break;
+        }
+
+        ev_btree_node_t* parent = path[level - 1].node;
+        size_t kpos = path[level - 1].idx;
+        if (parent->num < handler->inner_cap - 1)
+        {
+            _ev_btree_inner_insert(handler, parent, kpos, sep, right);
+            break;
+        }
+
+        ev_btree_node_t* new_right = spare[used++];
+        new_right->leaf = 0;
+        right = _ev_btree_split_inner(handler, parent, new_right, kpos, sep, right);
+        node = parent;
+        level--;
+    }
+
+    assert(used == need);
+    handler->size++;
+    return 0;
+}
+
+/**
+ * @brief Fix underflow of \p node at \p level.
+ */
+static void _ev_btree_rebalance(ev_btree_t* t, ev_btree_path_t* path, size_t level,
+    ev_btree_node_t* node)
+{
+    while (1)
+    {
+        if (level == 0)
+        {
+            if (node->leaf && node->num == 0)
+            {
+                _ev_btree_free_node(t, node);
+                t->root = t->head = t->tail = NULL;
+            }
+            else if (!node->leaf && node->num == 0)
+            {
+                t->root = _ev_btree_children(node)[0];
+                _ev_btree_free_node(t, node);
+            }
+            return;
+        }
+
+        size_t min = node->leaf ? t->leaf_cap / 2 : (t->inner_cap - 1) / 2;
+        if (node->num >= min)
+        {
+            return;
+        }
+
+        ev_btree_node_t* parent = path[level - 1].node;
+        size_t idx = path[level - 1].idx;
+        char* p_keys = _ev_btree_keys(t, parent);
+        ev_btree_node_t** p_children = _ev_btree_children(parent);
+        ev_btree_node_t* left = idx > 0 ? p_children[idx - 1] : NULL;
+        ev_btree_node_t* right = idx < parent->num ? p_children[idx + 1] : NULL;
+
+        if (node->leaf)
+        {
+            if (left != NULL && left->num > min)
+            {
+                _ev_btree_leaf_insert(t, node, 0,
+                    EV_BTREE_ITEM(t, _ev_btree_items(t, left), left->num - 1),
+                    EV_BTREE_KEY(t, _ev_btree_leaf_keys(left), left->num - 1));
+                left->num--;
+                memcpy(EV_BTREE_KEY(t, p_keys, idx - 1), _ev_btree_leaf_keys(node), t->key_size);
+                return;
+            }
+            if (right != NULL && right->num > min)
+            {
+                int was_empty = node->num == 0;
+                _ev_btree_leaf_insert(t, node, node->num, _ev_btree_items(t, right),
+                    _ev_btree_leaf_keys(right));
+                _ev_btree_leaf_remove(t, right, 0);
+                memcpy(EV_BTREE_KEY(t, p_keys, idx), _ev_btree_leaf_keys(right), t->key_size);
+                if (was_empty)
+                {
+                    _ev_btree_fix_min(t, path, level, _ev_btree_leaf_keys(node));
+                }
+                return;
+            }
+
+            /* Merge with sibling, always merge the right one into the left one. */
+            int was_empty = node->num == 0;
+            ev_btree_node_t* dst = left != NULL ? left : node;
+            ev_btree_node_t* src = left != NULL ? node : right;
+            size_t kpos = left != NULL ? idx - 1 : idx;
+
+            _ev_btree_leaf_copy(t, dst, dst->num, src, 0, src->num);
+            dst->num += src->num;
+
+            dst->next = src->next;
+            if (src->next != NULL)
+            {
+                src->next->prev = dst;
+            }
+            else
+            {
+                t->tail = dst;
+            }
+
+            _ev_btree_inner_remove(t, parent, kpos);
+            _ev_btree_free_node(t, src);
+
+            if (left == NULL && was_empty)
+            {
+                _ev_btree_fix_min(t, path, level, _ev_btree_leaf_keys(node));
+            }
+        }
+        else
+        {
+            char* keys = _ev_btree_keys(t, node);
+            ev_btree_node_t** children = _ev_btree_children(node);
+
+            if (left != NULL && left->num > min)
+            {
+                char* l_keys = _ev_btree_keys(t, left);
+                ev_btree_node_t** l_children = _ev_btree_children(left);
+
+                memmove(EV_BTREE_KEY(t, keys, 1), keys, node->num * t->key_size);
+                memmove(&children[1], &children[0], (node->num + 1) * sizeof(ev_btree_node_t*));
+                memcpy(keys, EV_BTREE_KEY(t, p_keys, idx - 1), t->key_size);
+                children[0] = l_children[left->num];
+                node->num++;
+
+                memcpy(EV_BTREE_KEY(t, p_keys, idx - 1), EV_BTREE_KEY(t, l_keys, left->num - 1),
+                    t->key_size);
+                left->num--;
+                return;
+            }
+            if (right != NULL && right->num > min)
+            {
+                char* r_keys = _ev_btree_keys(t, right);
+                ev_btree_node_t** r_children = _ev_btree_children(right);
+
+                memcpy(EV_BTREE_KEY(t, keys, node->num), EV_BTREE_KEY(t, p_keys, idx), t->key_size);
+                children[node->num + 1] = r_children[0];
+                node->num++;
+
+                memcpy(EV_BTREE_KEY(t, p_keys, idx), r_keys, t->key_size);
+                memmove(r_keys, EV_BTREE_KEY(t, r_keys, 1), (right->num - 1) * t->key_size);
+                memmove(&r_children[0], &r_children[1], right->num * sizeof(ev_btree_node_t*));
+                right->num--;
+                return;
+            }
+
+            ev_btree_node_t* dst = left != NULL ? left : node;
+            ev_btree_node_t* src = left != NULL ? node : right;
+            size_t kpos = left != NULL ? idx - 1 : idx;
+            char* d_keys = _ev_btree_keys(t, dst);
+
+            memcpy(EV_BTREE_KEY(t, d_keys, dst->num), EV_BTREE_KEY(t, p_keys, kpos), t->key_size);
+            memcpy(EV_BTREE_KEY(t, d_keys, dst->num + 1), _ev_btree_keys(t, src),
+                src->num * t->key_size);
+            memcpy(&_ev_btree_children(dst)[dst->num + 1], _ev_btree_children(src),
+                (src->num + 1) * sizeof(ev_btree_node_t*));
+            dst->num += src->num + 1;
+
+            _ev_btree_inner_remove(t, parent, kpos);
+            _ev_btree_free_node(t, src);
+        }
+
+        node = parent;
+        level--;
+    }
+}
+
+int ev_btree_replace(ev_btree_t* handler, const void* item)
+{
+    int found;
+    size_t pos;
+    ev_btree_probe_t probe;
+    ev_btree_node_t* node = handler->root;
+
+    if (node == NULL)
+    {
+        return 0;
+    }
+
+    _ev_btree_probe(handler, item, &probe);
+    while (!node->leaf)
+    {
+        char* keys = _ev_btree_keys(handler, node);
+        pos = _ev_btree_search(handler, keys, node->num, &probe, &found);
+        /* Integer separators are only keys, they never change. */
+        if (found && handler->cmp.key == NULL)
+        {
+            memcpy(EV_BTREE_KEY(handler, keys, pos), item, handler->key_size);
+        }
+        node = _ev_btree_children(node)[pos + found];
+    }
+
+    pos = _ev_btree_search(handler, _ev_btree_leaf_keys(node), node->num, &probe, &found);
+    if (found)
+    {
+        memcpy(EV_BTREE_ITEM(handler, _ev_btree_items(handler, node), pos), item, handler->item_size);
+    }
+    return found;
+}
+
+int ev_btree_erase(ev_btree_t* handler, const void* key, void* item)
+{
+    size_t depth;
+    ev_btree_path_t path[EV_BTREE_MAX_HEIGHT];
+    ev_btree_probe_t probe;
+
+    if (handler->root == NULL)
+    {
+        return 0;
+    }
+
+    _ev_btree_probe(handler, key, &probe);
+    ev_btree_node_t* leaf = _ev_btree_descend(handler, &probe, path, &depth);
+
+    int found;
+    size_t pos = _ev_btree_search(handler, _ev_btree_leaf_keys(leaf), leaf->num, &probe, &found);
+    if (!found)
+    {
+        return 0;
+    }
+
+    if (item != NULL)
+    {
+        memcpy(item, EV_BTREE_ITEM(handler, _ev_btree_items(handler, leaf), pos), handler->item_size);
+    }
+    _ev_btree_leaf_remove(handler, leaf, pos);
+    handler->size--;
+
+    if (pos == 0 && leaf->num > 0)
+    {
+        _ev_btree_fix_min(handler, path, depth, _ev_btree_leaf_keys(leaf));
+    }
+    _ev_btree_rebalance(handler, path, depth, leaf);
+
+    return 1;
+}
+
+size_t ev_btree_size(const ev_btree_t* handler)
+{
+    return handler->size;
+}
+
+/**
+ * @brief Make \p iter point to item \p pos of \p leaf, or the first item of
+ *   next leaf if \p pos is out of range.
+ */
+static int _ev_btree_set_iter(ev_btree_node_t* leaf, size_t pos, ev_btree_iter_t* iter)
+{
+    if (pos >= leaf->num)
+    {
+        leaf = leaf->next;
+        pos = 0;
+    }
+
+    iter->leaf = leaf;
+    iter->pos = pos;
+    return leaf != NULL;
+}
+
+int ev_btree_find(const ev_btree_t* handler, const void* key, ev_btree_iter_t* iter)
+{
+    iter->leaf = NULL;
+    iter->pos = 0;
+    if (handler->root == NULL)
+    {
+        return 0;
+    }
+
+    ev_btree_probe_t probe;
+    _ev_btree_probe(handler, key, &probe);
+    ev_btree_node_t* leaf = _ev_btree_descend(handler, &probe, NULL, NULL);
+
+    int found;
+    size_t pos = _ev_btree_search(handler, _ev_btree_leaf_keys(leaf), leaf->num, &probe, &found);
+    if (!found)
+    {
+        return 0;
+    }
+
+    iter->leaf = leaf;
+    iter->pos = pos;
+    return 1;
+}
+
+int ev_btree_find_lower(const ev_btree_t* handler, const void* key, ev_btree_iter_t* iter)
+{
+    iter->leaf = NULL;
+    iter->pos = 0;
+    if (handler->root == NULL)
+    {
+        return 0;
+    }
+
+    ev_btree_probe_t probe;
+    _ev_btree_probe(handler, key, &probe);
+    ev_btree_node_t* leaf = _ev_btree_descend(handler, &probe, NULL, NULL);
+
+    int found;
+    size_t pos = _ev_btree_search(handler, _ev_btree_leaf_keys(leaf), leaf->num, &probe, &found);
+    return _ev_btree_set_iter(leaf, pos, iter);
+}
+
+int ev_btree_find_upper(const ev_btree_t* handler, const void* key, ev_btree_iter_t* iter)
+{
+    iter->leaf = NULL;
+    iter->pos = 0;
+    if (handler->root == NULL)
+    {
+        return 0;
+    }
+
+    ev_btree_probe_t probe;
+    _ev_btree_probe(handler, key, &probe);
+    ev_btree_node_t* leaf = _ev_btree_descend(handler, &probe, NULL, NULL);
+
+    int found;
+    size_t pos = _ev_btree_search(handler, _ev_btree_leaf_keys(leaf), leaf->num, &probe, &found);
+    return _ev_btree_set_iter(leaf, pos + found, iter);
+}
+
+int ev_btree_begin(const ev_btree_t* handler, ev_btree_iter_t* iter)
+{
+    iter->leaf = handler->head;
+    iter->pos = 0;
+    return iter->leaf != NULL;
+}
+
+int ev_btree_end(const ev_btree_t* handler, ev_btree_iter_t* iter)
+{
+    iter->leaf = handler->tail;
+    iter->pos = handler->tail != NULL ? handler->tail->num - 1 : 0;
+    return iter->leaf != NULL;
+}
+
+int ev_btree_next(ev_btree_iter_t* iter)
+{
+    if (iter->leaf == NULL)
+    {
+        return 0;
+    }
+    return _ev_btree_set_iter(iter->leaf, iter->pos + 1, iter);
+}
+
+int ev_btree_prev(ev_btree_iter_t* iter)
+{
+    if (iter->leaf == NULL)
+    {
+        return 0;
+    }
+
+    if (iter->pos > 0)
+    {
+        iter->pos--;
+        return 1;
+    }
+
+    iter->leaf = iter->leaf->prev;
+    iter->pos = iter->leaf != NULL ? iter->leaf->num - 1 : 0;
+    return iter->leaf != NULL;
+}
+
+void* ev_btree_item(const ev_btree_t* handler, const ev_btree_iter_t* iter)
+{
+    if (iter->leaf == NULL)
+    {
+        return NULL;
+    }
+    return EV_BTREE_ITEM(handler, _ev_btree_items(handler, iter->leaf), iter->pos);
+}
+
+size_t ev_btree_index(const ev_btree_t* handler, const ev_btree_iter_t* iter)
+{
+    if (iter->leaf == NULL)
+    {
+        return handler->size;
+    }
+
+    size_t cnt = iter->pos;
+    ev_btree_node_t* leaf = iter->leaf->prev;
+    for (; leaf != NULL; leaf = leaf->prev)
+    {
+        cnt += leaf->num;
+    }
+    return cnt;
+}
+
+int ev_btree_at(const ev_btree_t* handler, size_t index, ev_btree_iter_t* iter)
+{
+    ev_btree_node_t* leaf;
+
+    iter->leaf = NULL;
+    iter->pos = 0;
+    if (index >= handler->size)
+    {
+        return 0;
+    }
+
+    /* Walk from the nearest end. */
+    if (index < handler->size / 2)
+    {
+        for (leaf = handler->head; index >= leaf->num; leaf = leaf->next)
+        {
+            index -= leaf->num;
+        }
+    }
+    else
+    {
+        size_t rindex = handler->size - 1 - index;
+        for (leaf = handler->tail; rindex >= leaf->num; leaf = leaf->prev)
+        {
+            rindex -= leaf->num;
+        }
+        index = leaf->num - 1 - rindex;
+    }
+
+    iter->leaf = leaf;
+    iter->pos = index;
+    return 1;
+}
@@ -0,0 +1,254 @@
+#ifndef __INFRA_UTILS_BTREE_H__
+#define __INFRA_UTILS_BTREE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup EV_UTILS_BTREE B+tree
+ * @ingroup EV_UTILS
+ *
+ * A B+tree that stores fixed-size items by value. Items are kept
+ * contiguously in leaves, and every node has the same size of a few cache
+ * lines, so a lookup touches far fewer cache lines than a binary tree.
+ *
+ * Inner nodes hold copies of items as separators: separator `i` is always a
+ * copy of the smallest item in child `i + 1`. Thus a separator never refers
+ * to an erased item.
+ *
+ * A tree created by ev_btree_init_integer() orders items by an integer key
+ * instead. Every node keeps the keys in an array of its own, next to the
+ * items in leaves, and separators are only keys. So inner nodes have a much
+ * larger fanout, and a node is searched by a branch-free scan over the key
+ * array that the compiler is able to vectorize.
+ *
+ * @{
+ */
+
+/**
+ * @brief Target size of one node in bytes.
+ */
+#define EV_BTREE_NODE_SIZE  512
+
+/**
+ * @brief Compare function.
+ * @param key1  The item in the tree
+ * @param key2  The item user given
+ * @param arg   User defined argument
+ * @return      -1 if key1 < key2. 1 if key1 > key2. 0 if key1 == key2.
+ */
+typedef int(*ev_btree_cmp_fn)(const void* key1, const void* key2, void* arg);
+
+/**
+ * @brief Get integer key of item.
+ * @param item  The item
+ * @param arg   User defined argument
+ * @return      The key. Items are sorted by key in ascending order
+ */
+typedef int64_t(*ev_btree_key_fn)(const void* item, void* arg);
+
+/**
+ * @brief The node of B+tree.
+ */
+typedef struct ev_btree_node ev_btree_node_t;
+
+/**
+ * @brief B+tree.
+ * @see ev_btree_init()
+ */
+typedef struct ev_btree
+{
+    ev_btree_node_t*    root;       /**< Root node */
+    ev_btree_node_t*    head;       /**< The first leaf */
+    ev_btree_node_t*    tail;       /**< The last leaf */
+
+    size_t              item_size;  /**< Item size */
+    size_t              key_size;   /**< Separator size, `sizeof(int64_t)` for integer keys */
+    size_t              leaf_cap;   /**< Max number of items in leaf */
+    size_t              inner_cap;  /**< Max number of children in inner node */
+    size_t              node_size;  /**< Allocation size of one node */
+
+    size_t              size;       /**< The number of items */
+    size_t              node_cnt;   /**< The number of nodes */
+
+    struct
+    {
+        ev_btree_cmp_fn     cmp;    /**< Compare function, NULL for integer keys */
+        ev_btree_key_fn     key;    /**< Integer key of item, NULL if use #ev_btree_t::cmp */
+        void*               arg;    /**< User defined argument */
+    } cmp;                          /**< Compare function data */
+} ev_btree_t;
+
+/**
+ * @brief Position of an item.
+ * @note Any modification of the tree invalidates all positions.
+ */
+typedef struct ev_btree_iter
+{
+    ev_btree_node_t*    leaf;       /**< The leaf, NULL if not point to an item */
+    size_t              pos;        /**< Position in leaf */
+} ev_btree_iter_t;
+
+/**
+ * @brief Initialize B+tree.
+ * @param handler   The B+tree
+ * @param item_size Item size, should be multiple of machine size
+ * @param cmp       The compare function. Must not NULL
+ * @param arg       User defined argument. Can be anything
+ */
+API_LOCAL void ev_btree_init(ev_btree_t* handler, size_t item_size,
+    ev_btree_cmp_fn cmp, void* arg);
+
+/**
+ * @brief Initialize B+tree that orders items by integer key.
+ * @param handler   The B+tree
+ * @param item_size Item size, should be multiple of machine size
+ * @param key       Get key of item. Must not NULL
+ * @param arg       User defined argument. Can be anything
+ */
+API_LOCAL void ev_btree_init_integer(ev_btree_t* handler, size_t item_size,
+    ev_btree_key_fn key, void* arg);
+
+/**
+ * @brief Release all nodes.
+ * @param handler   The B+tree
+ */
+API_LOCAL void ev_btree_exit(ev_btree_t* handler);
+
+/**
+ * @brief Insert a copy of \p item.
+ * @param handler   The B+tree
+ * @param item      The item
+ * @param[out] iter Position of the existing item if \p item is not inserted.
+ *                  Can be NULL
+ * @return          0 if inserted, 1 if an equal item exists, -1 if out of memory
+ */
+API_LOCAL int ev_btree_insert(ev_btree_t* handler, const void* item,
+    ev_btree_iter_t* iter);
+
+/**
+ * @brief Replace the item that equals to \p item, including all separators
+ *   copied from it.
+ * @param handler   The B+tree
+ * @param item      The new item
+ * @return          1 if replaced, 0 if not found
+ */
+API_LOCAL int ev_btree_replace(ev_btree_t* handler, const void* item);
+
+/**
+ * @brief Erase the item that equals to \p key.
+ * @param handler   The B+tree
+ * @param key       The key
+ * @param[out] item Copy of erased item. Can be NULL
+ * @return          1 if erased, 0 if not found
+ */
+API_LOCAL int ev_btree_erase(ev_btree_t* handler, const void* key, void* item);
+
+/**
+ * @brief Get the number of items.
+ * @param handler   The B+tree
+ * @return          The number of items
+ */
+API_LOCAL size_t ev_btree_size(const ev_btree_t* handler);
+
+/**
+ * @brief Finds item with specific key.
+ * @param handler   The B+tree
+ * @param key       The key
+ * @param[out] iter Position of the found item
+ * @return          1 if found, 0 if not
+ */
+API_LOCAL int ev_btree_find(const ev_btree_t* handler, const void* key,
+    ev_btree_iter_t* iter);
+
+/**
+ * @brief Find the first item not less than the given key.
+ * @param handler   The B+tree
+ * @param key       The key
+ * @param[out] iter Position of the found item
+ * @return          1 if found, 0 if not
+ */
+API_LOCAL int ev_btree_find_lower(const ev_btree_t* handler, const void* key,
+    ev_btree_iter_t* iter);
+
+/**
+ * @brief Find the first item greater than the given key.
+ * @param handler   The B+tree
+ * @param key       The key
+ * @param[out] iter Position of the found item
+ * @return          1 if found, 0 if not
+ */
+API_LOCAL int ev_btree_find_upper(const ev_btree_t* handler, const void* key,
+    ev_btree_iter_t* iter);
+
+/**
+ * @brief Get position of the first item.
+ * @param handler   The B+tree
+ * @param[out] iter Position
+ * @return          1 if found, 0 if tree is empty
+ */
+API_LOCAL int ev_btree_begin(const ev_btree_t* handler, ev_btree_iter_t* iter);
+
+/**
+ * @brief Get position of the last item.
+ * @param handler   The B+tree
+ * @param[out] iter Position
+ * @return          1 if found, 0 if tree is empty
+ */
+API_LOCAL int ev_btree_end(const ev_btree_t* handler, ev_btree_iter_t* iter);
+
+/**
+ * @brief Move to next item.
+ * @param[in,out] iter  Position
+ * @return              1 if success, 0 if there is no more item
+ */
+API_LOCAL int ev_btree_next(ev_btree_iter_t* iter);
+
+/**
+ * @brief Move to previous item.
+ * @param[in,out] iter  Position
+ * @return              1 if success, 0 if there is no more item
+ */
+API_LOCAL int ev_btree_prev(ev_btree_iter_t* iter);
+
+/**
+ * @brief Get the item at position.
+ * @param handler   The B+tree
+ * @param iter      Position
+ * @return          The item, or NULL if \p iter does not point to an item
+ */
+API_LOCAL void* ev_btree_item(const ev_btree_t* handler, const ev_btree_iter_t* iter);
+
+/**
+ * @brief Get the number of items before \p iter.
+ * @note It costs O(n / B), where B is the number of items in one leaf.
+ * @param handler   The B+tree
+ * @param iter      Position
+ * @return          The number of items
+ */
+API_LOCAL size_t ev_btree_index(const ev_btree_t* handler, const ev_btree_iter_t* iter);
+
+/**
+ * @brief Get position of the item at \p index.
+ * @note It costs O(n / B), where B is the number of items in one leaf.
+ * @param handler   The B+tree
+ * @param index     Index, start from 0
+ * @param[out] iter Position
+ * @return          1 if found, 0 if \p index is out of range
+ */
+API_LOCAL int ev_btree_at(const ev_btree_t* handler, size_t index,
+    ev_btree_iter_t* iter);
+
+/**
+ * @} EV_UTILS/EV_UTILS_BTREE
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -89,6 +89,31 @@ static void __rb_rotate_set_parents(ev_map_node_t* old, ev_map_node_t* new_node,
     __rb_change_child(old, new_node, parent, root);
 }
 
+/*
+* Update augmented data after rotation:
+* - new_node takes the place of old
+* - old becomes a child of new_node
+*/
+static void __rb_augment_rotate(ev_map_t* root, ev_map_node_t* old,
+    ev_map_node_t* new_node)
+{
+    if (root->augment) {
+        root->augment(old);
+        root->augment(new_node);
+    }
+}
+
+/*
+* Update augmented data from node up to the root.
+*/
+static void __rb_augment_propagate(ev_map_t* root, ev_map_node_t* node)
+{
+    if (!root->augment)
+        return;
+    for (; node; node = rb_parent(node))
+        root->augment(node);
+}
+
 static void __rb_insert(ev_map_node_t* node, ev_map_t* root)
 {
     ev_map_node_t* parent = rb_red_parent(node), *gparent, *tmp;
@@ -154,6 +179,7 @@ static void __rb_insert(ev_map_node_t* node, ev_map_t* root)
                     rb_set_parent_color(tmp, parent,
                     RB_BLACK);
                 rb_set_parent_color(parent, node, RB_RED);
+                __rb_augment_rotate(root, parent, node);
                 parent = node;
                 tmp = node->rb_right;
             }
@@ -172,6 +198,7 @@ static void __rb_insert(ev_map_node_t* node, ev_map_t* root)
             if (tmp)
                 rb_set_parent_color(tmp, gparent, RB_BLACK);
             __rb_rotate_set_parents(gparent, parent, root, RB_RED);
+            __rb_augment_rotate(root, gparent, parent);
             break;
         }
         else {
@@ -195,6 +222,7 @@ static void __rb_insert(ev_map_node_t* node, ev_map_t* root)
                     rb_set_parent_color(tmp, parent,
                     RB_BLACK);
                 rb_set_parent_color(parent, node, RB_RED);
+                __rb_augment_rotate(root, parent, node);
                 parent = node;
                 tmp = node->rb_left;
             }
@@ -205,6 +233,7 @@ static void __rb_insert(ev_map_node_t* node, ev_map_t* root)
             if (tmp)
                 rb_set_parent_color(tmp, gparent, RB_BLACK);
             __rb_rotate_set_parents(gparent, parent, root, RB_RED);
+            __rb_augment_rotate(root, gparent, parent);
             break;
         }
     }
@@ -309,6 +338,7 @@ static ev_map_node_t* __rb_erase_augmented(ev_map_node_t* node, ev_map_t* root)
         tmp = successor;
     }
 
+    __rb_augment_propagate(root, parent);
     return rebalance;
 }
 
@@ -346,6 +376,7 @@ ____rb_erase_color(ev_map_node_t* parent, ev_map_t* root)
                 rb_set_parent_color(tmp1, parent, RB_BLACK);
                 __rb_rotate_set_parents(parent, sibling, root,
                     RB_RED);
+                __rb_augment_rotate(root, parent, sibling);
                 sibling = tmp1;
             }
             tmp1 = sibling->rb_right;
@@ -397,6 +428,7 @@ ____rb_erase_color(ev_map_node_t* parent, ev_map_t* root)
                 if (tmp1)
                     rb_set_parent_color(tmp1, sibling,
                     RB_BLACK);
+                __rb_augment_rotate(root, sibling, tmp2);
                 tmp1 = sibling;
                 sibling = tmp2;
             }
@@ -419,6 +451,7 @@ ____rb_erase_color(ev_map_node_t* parent, ev_map_t* root)
                 rb_set_parent(tmp2, parent);
             __rb_rotate_set_parents(parent, sibling, root,
                 RB_BLACK);
+            __rb_augment_rotate(root, parent, sibling);
             break;
         }
         else {
@@ -430,6 +463,7 @@ ____rb_erase_color(ev_map_node_t* parent, ev_map_t* root)
                 rb_set_parent_color(tmp1, parent, RB_BLACK);
                 __rb_rotate_set_parents(parent, sibling, root,
                     RB_RED);
+                __rb_augment_rotate(root, parent, sibling);
                 sibling = tmp1;
             }
             tmp1 = sibling->rb_left;
@@ -456,6 +490,7 @@ ____rb_erase_color(ev_map_node_t* parent, ev_map_t* root)
                 if (tmp1)
                     rb_set_parent_color(tmp1, sibling,
                     RB_BLACK);
+                __rb_augment_rotate(root, sibling, tmp2);
                 tmp1 = sibling;
                 sibling = tmp2;
             }
@@ -467,6 +502,7 @@ ____rb_erase_color(ev_map_node_t* parent, ev_map_t* root)
                 rb_set_parent(tmp2, parent);
             __rb_rotate_set_parents(parent, sibling, root,
                 RB_BLACK);
+            __rb_augment_rotate(root, parent, sibling);
             break;
         }
     }
@@ -627,6 +663,14 @@ void ev_map_init(ev_map_t* handler, ev_map_cmp_fn cmp, void* arg)
     handler->cmp.cmp = cmp;
     handler->cmp.arg = arg;
     handler->size = 0;
+    handler->augment = NULL;
+}
+
+void ev_map_init_augmented(ev_map_t* handler, ev_map_cmp_fn cmp,
+    void* arg, ev_map_augment_fn augment)
+{
+    ev_map_init(handler, cmp, arg);
+    handler->augment = augment;
 }
 
 ev_map_node_t* ev_map_insert(ev_map_t* handler, ev_map_node_t* node)
@@ -655,6 +699,7 @@ ev_map_node_t* ev_map_insert(ev_map_t* handler, ev_map_node_t* node)
 
     handler->size++;
     _ev_map_low_link_node(node, parent, new_node);
+    __rb_augment_propagate(handler, node);
     _ev_map_low_insert_color(node, handler);
 
     return NULL;
@@ -666,6 +711,69 @@ void ev_map_erase(ev_map_t* handler, ev_map_node_t* node)
     _ev_map_low_erase(handler, node);
 }
 
+/**
+ * @brief Link the first \p size nodes of \p list into a balanced subtree.
+ *
+ * The left subtree takes half of the nodes, so all leaves are in the last two
+ * levels. Nodes in the last level are colored red and all others are black,
+ * which keeps the black height the same on every path.
+ *
+ * @param root      The map
+ * @param list      Sorted nodes. Point to the first unused node on return.
+ * @param size      The number of nodes to link
+ * @param depth     Depth of the subtree root
+ * @param red_depth Depth of the last level
+ * @return          The subtree root
+ */
+static ev_map_node_t* _ev_map_build_subtree(ev_map_t* root, ev_map_node_t** list,
+    size_t size, size_t depth, size_t red_depth)
+{
+    if (size == 0)
+    {
+        return NULL;
+    }
+
+    ev_map_node_t* left = _ev_map_build_subtree(root, list, size / 2, depth + 1, red_depth);
+
+    ev_map_node_t* node = *list;
+    *list = node->rb_right;
+
+    node->rb_left = left;
+    node->rb_right = _ev_map_build_subtree(root, list, size - size / 2 - 1, depth + 1, red_depth);
+    rb_set_parent_color(node, NULL, depth == red_depth ? RB_RED : RB_BLACK);
+
+    if (node->rb_left != NULL)
+    {
+        rb_set_parent_color(node->rb_left, node, rb_color(node->rb_left));
+    }
+    if (node->rb_right != NULL)
+    {
+        rb_set_parent_color(node->rb_right, node, rb_color(node->rb_right));
+    }
+    if (root->augment)
+    {
+        root->augment(node);
+    }
+
+    return node;
+}
+
+void ev_map_build(ev_map_t* handler, ev_map_node_t* list, size_t size)
+{
+    size_t height = 0;
+    while (height < sizeof(size_t) * 8 && ((size_t)1 << height) <= size)
+    {
+        height++;
+    }
+
+    handler->rb_root = _ev_map_build_subtree(handler, &list, size, 0, height - 1);
+    if (handler->rb_root != NULL)
+    {
+        rb_set_black(handler->rb_root);
+    }
+    handler->size = size;
+}
+
 size_t ev_map_size(const ev_map_t* handler)
 {
     return handler->size;
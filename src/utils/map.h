@@ -32,7 +32,7 @@ typedef struct ev_map_node
  * @param[in] cmp   Compare function
  * @param[in] arg   Argument for compare function
  */
-#define EV_MAP_INIT(cmp, arg)   { NULL, { cmp, arg }, 0 }
+#define EV_MAP_INIT(cmp, arg)   { NULL, { cmp, arg }, 0, NULL }
 
 /**
  * @brief Static initializer for #ev_map_node_t
@@ -49,6 +49,17 @@ typedef struct ev_map_node
  */
 typedef int(*ev_map_cmp_fn)(const ev_map_node_t* key1, const ev_map_node_t* key2, void* arg);
 
+/**
+ * @brief Augment function.
+ *
+ * Recalculate augmented data of \p node (e.g. subtree size) from itself and
+ * its children. It is called every time the children of \p node change, and
+ * children are always updated before their parent.
+ *
+ * @param node  The node
+ */
+typedef void(*ev_map_augment_fn)(ev_map_node_t* node);
+
 /**
  * @brief Map implemented as red-black tree
  * @see EV_MAP_INIT
@@ -64,6 +75,7 @@ typedef struct ev_map
     }cmp;                           /**< Compare function data */
 
     size_t              size;       /**< The number of nodes */
+    ev_map_augment_fn   augment;    /**< Augment function, NULL if not augmented */
 } ev_map_t;
 
 /**
@@ -74,6 +86,17 @@ typedef struct ev_map
  */
 API_LOCAL void ev_map_init(ev_map_t* handler, ev_map_cmp_fn cmp, void* arg);
 
+/**
+ * @brief Initialize an augmented map.
+ * @see ev_map_augment_fn
+ * @param handler   The pointer to the map
+ * @param cmp       The compare function. Must not NULL
+ * @param arg       User defined argument. Can be anything
+ * @param augment   The augment function. Must not NULL
+ */
+API_LOCAL void ev_map_init_augmented(ev_map_t* handler, ev_map_cmp_fn cmp,
+    void* arg, ev_map_augment_fn augment);
+
 /**
  * @brief Insert the node into map.
  * @warning the node must not exist in any map.
@@ -91,6 +114,16 @@ API_LOCAL ev_map_node_t* ev_map_insert(ev_map_t* handler, ev_map_node_t* node);
  */
 API_LOCAL void ev_map_erase(ev_map_t* handler, ev_map_node_t* node);
 
+/**
+ * @brief Build a balanced map from sorted nodes in O(n).
+ * @warning The map must be empty.
+ * @param handler   The pointer to the map
+ * @param list      Nodes linked by #ev_map_node_t::rb_right, in strictly
+ *                  ascending order
+ * @param size      The number of nodes in \p list
+ */
+API_LOCAL void ev_map_build(ev_map_t* handler, ev_map_node_t* list, size_t size);
+
 /**
  * @brief Get the number of nodes in the map.
  * @param handler   The pointer to the map
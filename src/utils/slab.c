@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "slab.h"
+
+/**
+ * @brief The number of objects in the first chunk.
+ */
+#define EV_SLAB_MIN_OBJECTS     16
+
+/**
+ * @brief The max number of objects in one chunk.
+ */
+#define EV_SLAB_MAX_OBJECTS     4096
+
+struct ev_slab_chunk
+{
+    ev_slab_chunk_t*    next;       /**< Next (older) chunk. */
+    size_t              capacity;   /**< The number of objects. */
+};
+
+/**
+ * @brief Alignment of objects, twice of machine size.
+ */
+#define EV_SLAB_ALIGN           (sizeof(void*) * 2)
+
+/**
+ * @brief Size of chunk header, objects are placed right after it.
+ */
+#define EV_SLAB_CHUNK_HDR_SIZE      \
+    ((size_t)ALIGN_SIZE(sizeof(ev_slab_chunk_t), EV_SLAB_ALIGN))
+
+/**
+ * @brief The first object in chunk.
+ */
+#define EV_SLAB_CHUNK_DATA(chunk)   ((char*)(chunk) + EV_SLAB_CHUNK_HDR_SIZE)
+
+static ev_slab_chunk_t* _ev_slab_new_chunk(ev_slab_t* handler)
+{
+    /* Chunks grow geometrically, so small slabs stay small. */
+    size_t capacity = EV_SLAB_MIN_OBJECTS;
+    if (handler->chunks != NULL)
+    {
+        capacity = handler->chunks->capacity * 2;
+        if (capacity > EV_SLAB_MAX_OBJECTS)
+        {
+            capacity = EV_SLAB_MAX_OBJECTS;
+        }
+    }
+
+    size_t bytes = EV_SLAB_CHUNK_HDR_SIZE + handler->obj_size * capacity;
+    ev_slab_chunk_t* chunk = malloc(bytes);
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+
+    chunk->capacity = capacity;
+    chunk->next = handler->chunks;
+    handler->chunks = chunk;
+    handler->chunk_cnt++;
+    handler->chunk_used = 0;
+    handler->bytes += bytes;
+
+    return chunk;
+}
+
+void ev_slab_init(ev_slab_t* handler, size_t size)
+{
+    handler->obj_size = ALIGN_SIZE(size, EV_SLAB_ALIGN);
+    handler->chunks = NULL;
+    handler->free_list = NULL;
+    handler->chunk_cnt = 0;
+    handler->chunk_used = 0;
+    handler->live = 0;
+    handler->bytes = 0;
+}
+
+void ev_slab_exit(ev_slab_t* handler)
+{
+    ev_slab_chunk_t* chunk;
+    while ((chunk = handler->chunks) != NULL)
+    {
+        handler->chunks = chunk->next;
+        free(chunk);
+    }
+
+    handler->free_list = NULL;
+    handler->chunk_cnt = 0;
+    handler->chunk_used = 0;
+    handler->live = 0;
+    handler->bytes = 0;
+}
+
+void* ev_slab_alloc(ev_slab_t* handler)
+{
+    void* obj;
+
+    if ((obj = handler->free_list) != NULL)
+    {
+        handler->free_list = *(void**)obj;
+        goto finish;
+    }
+
+    if (handler->chunks == NULL || handler->chunk_used == handler->chunks->capacity)
+    {
+        if (_ev_slab_new_chunk(handler) == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    obj = EV_SLAB_CHUNK_DATA(handler->chunks) + handler->obj_size * handler->chunk_used;
+    handler->chunk_used++;
+
+finish:
+    handler->live++;
+    return obj;
+}
+
+void ev_slab_free(ev_slab_t* handler, void* obj)
+{
+    *(void**)obj = handler->free_list;
+    handler->free_list = obj;
+    handler->live--;
+}
@@ -0,0 +1,78 @@
+#ifndef __INFRA_UTILS_SLAB_H__
+#define __INFRA_UTILS_SLAB_H__
+
+#include <stddef.h>
+#include "defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup EV_UTILS_SLAB Slab
+ * @ingroup EV_UTILS
+ *
+ * A slab hands out fixed-size objects from chunked arenas. Freed objects are
+ * kept in a free list and reused by later allocations, so frequently
+ * created and destroyed objects do not go through malloc(). Memory is only
+ * given back by #ev_slab_exit().
+ *
+ * @{
+ */
+
+/**
+ * @brief The chunk header.
+ */
+typedef struct ev_slab_chunk ev_slab_chunk_t;
+
+/**
+ * @brief Fixed-size object allocator.
+ * @see ev_slab_init()
+ */
+typedef struct ev_slab
+{
+    size_t              obj_size;   /**< Object size, aligned to twice of machine size. */
+    ev_slab_chunk_t*    chunks;     /**< Chunk list, newest first. */
+    void*               free_list;  /**< Freed objects. */
+    size_t              chunk_cnt;  /**< The number of chunks. */
+    size_t              chunk_used; /**< The number of used objects in newest chunk. */
+    size_t              live;       /**< The number of live objects. */
+    size_t              bytes;      /**< Total bytes of chunks. */
+} ev_slab_t;
+
+/**
+ * @brief Initialize slab.
+ * @param[out] handler  The slab.
+ * @param[in] size      Object size.
+ */
+API_LOCAL void ev_slab_init(ev_slab_t* handler, size_t size);
+
+/**
+ * @brief Release all chunks.
+ * @warning All objects allocated from this slab become invalid.
+ * @param[in] handler   The slab.
+ */
+API_LOCAL void ev_slab_exit(ev_slab_t* handler);
+
+/**
+ * @brief Allocate an object.
+ * @param[in] handler   The slab.
+ * @return              Object address, or NULL if out of memory.
+ */
+API_LOCAL void* ev_slab_alloc(ev_slab_t* handler);
+
+/**
+ * @brief Release an object.
+ * @param[in] handler   The slab.
+ * @param[in] obj       Object returned by #ev_slab_alloc().
+ */
+API_LOCAL void ev_slab_free(ev_slab_t* handler, void* obj);
+
+/**
+ * @} EV_UTILS/EV_UTILS_SLAB
+ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif
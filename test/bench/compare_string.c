@@ -0,0 +1,120 @@
+/**
+ * @file
+ * Microbenchmark of string comparators on long keys with a shared prefix,
+ * like file paths stored in a map.
+ */
+#include "function/__init__.h"
+#include <time.h>
+
+#define BENCH_KEY_COUNT     4096
+#define BENCH_PREFIX_SIZE   200
+#define BENCH_ROUNDS        50
+
+typedef struct bench_key
+{
+    char*   str;
+    size_t  len;
+} bench_key_t;
+
+/**
+ * @brief The byte by byte comparator that #infra_compare_string() replaced.
+ */
+static int _bench_compare_bytewise(const char* dat1, size_t dat1_sz,
+    const char* dat2, size_t dat2_sz)
+{
+    size_t pos = 0;
+    for (; pos < dat1_sz && pos < dat2_sz; pos++)
+    {
+        if (dat1[pos] < dat2[pos])
+        {
+            return -1;
+        }
+        else if (dat1[pos] > dat2[pos])
+        {
+            return 1;
+        }
+    }
+    if (dat1_sz < dat2_sz)
+    {
+        return -1;
+    }
+    if (dat1_sz > dat2_sz)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+static int _bench_compare_memcmp(const char* dat1, size_t dat1_sz,
+    const char* dat2, size_t dat2_sz)
+{
+    return infra_compare_string(dat1, dat1_sz, dat2, dat2_sz);
+}
+
+/**
+ * @brief Binary search every key in \p keys, with \p cmp.
+ * @return The sum of found positions, to keep the work observable.
+ */
+static size_t _bench_search(const bench_key_t* keys, size_t n,
+    int (*cmp)(const char*, size_t, const char*, size_t))
+{
+    size_t i, sum = 0;
+    for (i = 0; i < n; i++)
+    {
+        size_t lo = 0, hi = n;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (cmp(keys[mid].str, keys[mid].len, keys[i].str, keys[i].len) < 0)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        sum += lo;
+    }
+    return sum;
+}
+
+static double _bench_now(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+    static bench_key_t keys[BENCH_KEY_COUNT];
+    size_t i, r, sum;
+    double t;
+
+    /* Keys are generated in sorted order. */
+    for (i = 0; i < BENCH_KEY_COUNT; i++)
+    {
+        keys[i].str = malloc(BENCH_PREFIX_SIZE + 16);
+        memset(keys[i].str, '/', BENCH_PREFIX_SIZE);
+        keys[i].len = BENCH_PREFIX_SIZE + snprintf(keys[i].str + BENCH_PREFIX_SIZE, 16, "%08zu", i);
+    }
+
+    t = _bench_now();
+    for (r = 0, sum = 0; r < BENCH_ROUNDS; r++)
+    {
+        sum += _bench_search(keys, BENCH_KEY_COUNT, _bench_compare_bytewise);
+    }
+    printf("bytewise: %.3fs (%zu)\n", _bench_now() - t, sum);
+
+    t = _bench_now();
+    for (r = 0, sum = 0; r < BENCH_ROUNDS; r++)
+    {
+        sum += _bench_search(keys, BENCH_KEY_COUNT, _bench_compare_memcmp);
+    }
+    printf("memcmp:   %.3fs (%zu)\n", _bench_now() - t, sum);
+
+    for (i = 0; i < BENCH_KEY_COUNT; i++)
+    {
+        free(keys[i].str);
+    }
+    return 0;
+}
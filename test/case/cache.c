@@ -0,0 +1,79 @@
+#include "test.h"
+
+INFRA_TEST(cache_lru,
+"local evicted = {}" LF
+"local cache = infra.make_cache({ capacity = 3, on_evict = function(k, v)" LF
+"    evicted[#evicted + 1] = k .. \"=\" .. v" LF
+"end })" LF
+"cache:set(\"a\", 1)" LF
+"cache:set(\"b\", 2)" LF
+"cache:set(\"c\", 3)" LF
+"test.assert_eq(select(2, cache:get(\"a\")), 1)" LF
+"cache:set(\"d\", 4)" LF
+"test.assert_eq(cache:size(), 3)" LF
+"test.assert_eq(cache:peek(\"b\"), false)" LF
+"test.assert_eq(table.concat(evicted, \",\"), \"b=2\")" LF
+"cache:set(\"c\", 30)" LF
+"cache:set(\"e\", 5)" LF
+"test.assert_eq(table.concat(evicted, \",\"), \"b=2,a=1\")" LF
+"test.assert_eq(select(2, cache:get(\"c\")), 30)" LF
+"test.assert_eq(cache:get(\"x\"), false)" LF
+"test.assert_eq(cache:remove(\"c\"), true)" LF
+"test.assert_eq(cache:remove(\"c\"), false)" LF
+"local stats = cache:stats()" LF
+"test.assert_eq(stats.hits, 2)" LF
+"test.assert_eq(stats.misses, 1)" LF
+"test.assert_eq(stats.evictions, 2)" LF
+"test.assert_eq(stats.size, 2)" LF
+"cache:clear()" LF
+"test.assert_eq(cache:size(), 0)" LF
+"test.assert_eq(cache:stats().bytes, 0)" LF
+"test.assert_eq(#evicted, 2)" LF
+);
+
+INFRA_TEST(cache_lfu,
+"local cache = infra.make_cache({ capacity = 3, policy = \"lfu\" })" LF
+"cache:set(\"a\", 1)" LF
+"cache:set(\"b\", 2)" LF
+"cache:set(\"c\", 3)" LF
+"cache:get(\"a\")" LF
+"cache:get(\"a\")" LF
+"cache:get(\"b\")" LF
+"cache:set(\"d\", 4)" LF
+"test.assert_eq(cache:peek(\"c\"), false)" LF
+"cache:set(\"e\", 5)" LF
+"test.assert_eq(cache:peek(\"d\"), false)" LF
+"test.assert_eq(cache:peek(\"a\"), true)" LF
+"test.assert_eq(cache:peek(\"b\"), true)" LF
+"cache:get(\"e\")" LF
+"cache:set(\"f\", 6)" LF
+"test.assert_eq(cache:peek(\"b\"), false)" LF
+"for i = 1, 1000 do" LF
+"    cache:set(i % 7, i)" LF
+"    cache:get(i % 5)" LF
+"end" LF
+"test.assert_eq(cache:size(), 3)" LF
+"test.assert_eq(pcall(infra.make_cache, { policy = \"foo\" }), false)" LF
+"test.assert_eq(pcall(infra.make_cache, { capacity = 10.5 }), false)" LF
+"test.assert_eq(pcall(infra.make_cache, { capacity = -1 }), false)" LF
+"test.assert_eq(pcall(infra.make_cache, { max_bytes = \"1k\" }), false)" LF
+"local ok, err = pcall(infra.make_cache, { capacity = 0.5 })" LF
+"test.assert_ne(string.find(err, \"capacity\", 1, true), nil)" LF
+"cache = infra.make_cache({ capacity = 2.0 })" LF
+"for i = 1, 3 do cache:set(i, i) end" LF
+"test.assert_eq(cache:size(), 2)" LF
+);
+
+INFRA_TEST(cache_bytes,
+"local cache = infra.make_cache({ max_bytes = 1000 })" LF
+"test.assert_eq(cache:set(\"big\", string.rep(\"x\", 2000)), false)" LF
+"test.assert_eq(cache:size(), 0)" LF
+"for i = 1, 10 do" LF
+"    test.assert_eq(cache:set(i, {}, 300), true)" LF
+"end" LF
+"test.assert_eq(cache:size(), 3)" LF
+"test.assert_eq(cache:stats().bytes, 900)" LF
+"test.assert_eq(cache:stats().evictions, 7)" LF
+"test.assert_eq(cache:peek(10), true)" LF
+"test.assert_eq(cache:peek(7), false)" LF
+);
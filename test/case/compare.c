@@ -12,6 +12,7 @@ LF
 "ds[" STRINGIFY(__LINE__) "] = { \"hello\", \"hello\", 0 }" LF
 "ds[" STRINGIFY(__LINE__) "] = { \"hello\", \"hello world\", -1 }" LF
 "ds[" STRINGIFY(__LINE__) "] = { \"hellz\", \"hello\", 1 }" LF
+"ds[" STRINGIFY(__LINE__) "] = { \"hello\", \"hell\\255\", -1 }" LF
 LF
 "-- Pure nil compare" LF
 "ds[" STRINGIFY(__LINE__) "] = { nil, nil, 0 }" LF
@@ -43,3 +44,126 @@ LF
 ;
 
 INFRA_TEST(compare, ut_compare_script);
+
+INFRA_TEST(compare_deep,
+"local deep = { deep = true }" LF
+"test.assert_eq(infra.compare({}, {}, deep), 0)" LF
+"test.assert_eq(infra.compare({ 1, 2, { a = \"x\" } }, { 1, 2, { a = \"x\" } }, deep), 0)" LF
+"test.assert_eq(infra.compare({ 1, 2, { a = \"x\" } }, { 1, 2, { a = \"y\" } }, deep), -1)" LF
+"test.assert_eq(infra.compare({ 1, 2, 3 }, { 1, 2 }, deep), 1)" LF
+"test.assert_eq(infra.compare({ a = 1 }, { b = 1 }, deep), -1)" LF
+"test.assert_eq(infra.compare({ a = 1, b = 2 }, { b = 2, a = 1 }, deep), 0)" LF
+"test.assert_eq(infra.compare({ a = 1 }, 1, deep), 1)" LF
+"test.assert_eq(infra.compare(2, 1, deep), 1)" LF
+"local t1, t2 = { x = 1 }, { x = 1 }" LF
+"test.assert_ne(infra.compare(t1, t2), 0)" LF
+"t1.self, t2.self = t1, t2" LF
+"test.assert_eq(infra.compare(t1, t2, deep), 0)" LF
+"t2.self = t1" LF
+"test.assert_eq(infra.compare(t1, t2, deep), 0)" LF
+"t2.x = 2" LF
+"test.assert_eq(infra.compare(t1, t2, deep), -1)" LF
+"test.assert_eq(infra.compare(t2, t1, deep), 1)" LF
+);
+
+INFRA_TEST(compare_deep_table_key,
+"local deep = { deep = true }" LF
+"test.assert_eq(infra.compare({ [{ 1 }] = true }, { [{ 1 }] = true }, deep), 0)" LF
+"test.assert_eq(infra.compare({ [{ 1 }] = true }, { [{ 2 }] = true }, deep), -1)" LF
+"test.assert_eq(infra.compare({ [{ 2 }] = true }, { [{ 1 }] = true }, deep), 1)" LF
+"for i = 1, 20 do" LF
+"    local x, y = {}, {}" LF
+"    test.assert_eq(infra.compare({ [x] = 1, [y] = 2 }, { [y] = 1, [x] = 2 }, deep), 0)" LF
+"    x, y = { 1 }, { 2 }" LF
+"    test.assert_eq(infra.compare({ [x] = 1, [y] = 2 }, { [y] = 1, [x] = 2 }, deep), -1)" LF
+"    test.assert_eq(infra.compare({ [y] = 1, [x] = 2 }, { [x] = 1, [y] = 2 }, deep), 1)" LF
+"    test.assert_eq(infra.compare({ [x] = 1, [y] = 2 }, { [{ 2 }] = 2, [{ 1 }] = 1 }, deep), 0)" LF
+"end" LF
+"local t1 = { [{ a = { 1 } }] = 1, [{ a = { 2 } }] = 2, [{}] = 0, k = \"v\" }" LF
+"local t2 = { k = \"v\", [{}] = 0, [{ a = { 2 } }] = 2, [{ a = { 1 } }] = 1 }" LF
+"test.assert_eq(infra.compare(t1, t2, deep), 0)" LF
+"local c1, c2 = {}, {}" LF
+"c1[c1], c2[c2] = 1, 1" LF
+"test.assert_eq(infra.compare(c1, c2, deep), 0)" LF
+"local a, b = test.lightuserdata(1), test.lightuserdata(2)" LF
+"test.assert_eq(infra.compare({ [a] = 1, [b] = { 2 } }, { [b] = { 2 }, [a] = 1 }, deep), 0)" LF
+);
+
+INFRA_TEST(compare_meta,
+"local a, b = test.lightuserdata(1), test.lightuserdata(2)" LF
+"test.assert_eq(pcall(infra.compare, a, b), false)" LF
+"local id = {}" LF
+"for i = 1, 20 do id[test.lightuserdata(i)] = i end" LF
+"local function addr(v) return id[v] end" LF
+"local cnt = 0" LF
+"debug.setmetatable(a, {" LF
+"    __cmp = function(x, y) cnt = cnt + 1 return addr(x) - addr(y) end," LF
+"})" LF
+"test.assert_eq(infra.compare(a, b), -1)" LF
+"test.assert_eq(infra.compare(b, a), 1)" LF
+"test.assert_eq(infra.compare(a, test.lightuserdata(1)), 0)" LF
+"test.assert_eq(cnt, 2)" LF
+"debug.setmetatable(a, {" LF
+"    __lt = function(x, y) return addr(x) < addr(y) end," LF
+"    __le = function(x, y) return addr(x) <= addr(y) end," LF
+"})" LF
+"test.assert_eq(infra.compare(a, b), -1)" LF
+"test.assert_eq(infra.compare(b, a), 1)" LF
+"local t = {}" LF
+"for i = 20, 1, -1 do t[#t + 1] = test.lightuserdata(i) end" LF
+"infra.sort(t)" LF
+"for i = 1, 20 do test.assert_eq(addr(t[i]), i) end" LF
+"debug.setmetatable(a, nil)" LF
+);
+
+INFRA_TEST(compare_meta_change,
+"local a, b = test.lightuserdata(1), test.lightuserdata(2)" LF
+"local id = { [a] = 1, [b] = 2 }" LF
+"local mt = {" LF
+"    __lt = function(x, y) return id[x] < id[y] end," LF
+"    __le = function(x, y) return id[x] <= id[y] end," LF
+"}" LF
+"debug.setmetatable(a, mt)" LF
+"test.assert_eq(infra.compare(a, b), -1)" LF
+"mt.__lt = function(x, y) return id[x] > id[y] end" LF
+"mt.__le = function(x, y) return id[x] >= id[y] end" LF
+"test.assert_eq(infra.compare(a, b), 1)" LF
+"mt.__cmp = function(x, y) return 0 end" LF
+"test.assert_eq(infra.compare(a, b), 0)" LF
+"mt.__cmp = nil" LF
+"mt.__lt, mt.__le = nil, nil" LF
+"test.assert_eq(pcall(infra.compare, a, b), false)" LF
+"debug.setmetatable(a, nil)" LF
+);
+
+INFRA_TEST(compare_integer,
+"if math.type == nil then return end" LF
+"local big = 9007199254740993" LF
+"test.assert_eq(infra.compare(big, big - 1), 1)" LF
+"test.assert_eq(infra.compare(big - 1, big), -1)" LF
+"test.assert_eq(infra.compare(big, 2.0^53), 1)" LF
+"test.assert_eq(infra.compare(2.0^53, big), -1)" LF
+"test.assert_eq(infra.compare(big - 1, 2.0^53), 0)" LF
+"test.assert_eq(infra.compare(1, 1.5), -1)" LF
+"test.assert_eq(infra.compare(-1, -1.5), 1)" LF
+"test.assert_eq(infra.compare(math.maxinteger, 2.0^63), -1)" LF
+"test.assert_eq(infra.compare(math.mininteger, -2.0^63), 0)" LF
+"test.assert_eq(infra.compare(math.mininteger, -2.0^64), 1)" LF
+"test.assert_eq(infra.compare(1, 1.0), 0)" LF
+"for _, m in ipairs({ infra.make_map(), infra.make_map(nil, { cmp = \"number\" }), infra.make_hashmap() }) do" LF
+"    m:replace(big, \"a\")" LF
+"    m:replace(big - 1, \"b\")" LF
+"    m:replace(2.0^53, \"c\")" LF
+"    m:replace(1, \"d\")" LF
+"    m:replace(1.0, \"e\")" LF
+"    test.assert_eq(m:size(), 3)" LF
+"    test.assert_eq(select(2, m:find(big)), \"a\")" LF
+"    test.assert_eq(select(2, m:find(big - 1)), \"c\")" LF
+"    test.assert_eq(select(2, m:find(1)), \"e\")" LF
+"end" LF
+"local t = infra.sort({ big, 2.0^53 + 0.0, big - 2, 1.5, 1 })" LF
+"test.assert_eq(t[1], 1)" LF
+"test.assert_eq(t[2], 1.5)" LF
+"test.assert_eq(t[3], big - 2)" LF
+"test.assert_eq(t[5], big)" LF
+);
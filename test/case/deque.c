@@ -0,0 +1,59 @@
+#include "test.h"
+
+INFRA_TEST(deque,
+"local dq = infra.make_deque()" LF
+"test.assert_eq(dq:size(), 0)" LF
+"test.assert_eq(dq:pop_front(), nil)" LF
+"test.assert_eq(dq:pop_back(), nil)" LF
+"test.assert_eq(dq:front(), nil)" LF
+"local ref = {}" LF
+"for i = 1, 100 do" LF
+"    if i % 3 == 0 then" LF
+"        dq:push_front(i)" LF
+"        table.insert(ref, 1, i)" LF
+"    else" LF
+"        dq:push_back(i)" LF
+"        ref[#ref + 1] = i" LF
+"    end" LF
+"end" LF
+"test.assert_eq(dq:size(), #ref)" LF
+"test.assert_eq(#dq, #ref)" LF
+"for i = 1, #ref do" LF
+"    test.assert_eq(dq[i], ref[i])" LF
+"    test.assert_eq(dq:get(-i), ref[#ref - i + 1])" LF
+"end" LF
+"test.assert_eq(dq[0], nil)" LF
+"test.assert_eq(dq[#ref + 1], nil)" LF
+"test.assert_eq(dq:front(), ref[1])" LF
+"test.assert_eq(dq:back(), ref[#ref])" LF
+"for i = 1, 40 do" LF
+"    test.assert_eq(dq:pop_front(), table.remove(ref, 1))" LF
+"    test.assert_eq(dq:pop_back(), table.remove(ref))" LF
+"end" LF
+"dq[1] = \"a\"" LF
+"dq:set(-1, \"z\")" LF
+"ref[1] = \"a\"" LF
+"ref[#ref] = \"z\"" LF
+"local cnt = 0" LF
+"for i, v in dq:pairs() do" LF
+"    cnt = cnt + 1" LF
+"    test.assert_eq(i, cnt)" LF
+"    test.assert_eq(v, ref[i])" LF
+"end" LF
+"test.assert_eq(cnt, #ref)" LF
+"test.assert_eq(pcall(dq.set, dq, #ref + 1, 0), false)" LF
+"dq:clear()" LF
+"test.assert_eq(dq:size(), 0)" LF
+"test.assert_eq(dq:pop_back(), nil)" LF
+);
+
+INFRA_TEST(deque_iterable,
+"local dq = infra.make_deque({ \"b\", \"c\" })" LF
+"dq:push_front(\"a\")" LF
+"dq:push_back(\"d\")" LF
+"test.assert_eq(infra.merge_line(dq, \",\"), \"a,b,c,d\")" LF
+"local cp = infra.make_deque(dq)" LF
+"test.assert_eq(cp:size(), 4)" LF
+"test.assert_eq(cp:pop_back(), \"d\")" LF
+"test.assert_eq(dq:size(), 4)" LF
+);
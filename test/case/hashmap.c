@@ -0,0 +1,83 @@
+#include "test.h"
+
+INFRA_TEST(hashmap_empty,
+"do" LF
+"    local size = infra.make_hashmap():size()" LF
+"    test.assert_eq(size, 0)" LF
+"end" LF
+);
+
+INFRA_TEST(hashmap_insert,
+"do" LF
+"    local map = infra.make_hashmap()" LF
+"    for v = 1,1000 do" LF
+"        local ret = map:insert(v, v * 2)" LF
+"        test.assert_eq(ret, true, \"v=%d\", v)" LF
+"    end" LF
+"    test.assert_eq(map:size(), 1000)" LF
+"    test.assert_eq(map:insert(1, 0), false)" LF
+"    for v = 1,1000 do" LF
+"        test.assert_eq(select(2, map:find(v)), v * 2)" LF
+"    end" LF
+"    test.assert_eq(map:find(1001), false)" LF
+"end" LF
+);
+
+INFRA_TEST(hashmap_key_type,
+"do" LF
+"    local map = infra.make_hashmap()" LF
+"    local t = {}" LF
+"    map:insert(\"hello\", 1)" LF
+"    map:insert(true, 2)" LF
+"    map:insert(t, 3)" LF
+"    map:insert(1.5, 4)" LF
+"    test.assert_eq(select(2, map:find(\"hel\" .. \"lo\")), 1)" LF
+"    test.assert_eq(select(2, map:find(true)), 2)" LF
+"    test.assert_eq(select(2, map:find(t)), 3)" LF
+"    test.assert_eq(map:find({}), false)" LF
+"    test.assert_eq(select(2, map:find(1.5)), 4)" LF
+"    test.assert_eq(map:find(false), false)" LF
+"end" LF
+);
+
+INFRA_TEST(hashmap_erase,
+"do" LF
+"    local map = infra.make_hashmap()" LF
+"    for v = 1,100 do" LF
+"        map:insert(tostring(v), v)" LF
+"    end" LF
+"    for v = 1,100,2 do" LF
+"        test.assert_eq(map:erase(tostring(v)), true)" LF
+"    end" LF
+"    test.assert_eq(map:erase(\"1\"), false)" LF
+"    test.assert_eq(map:size(), 50)" LF
+"    for v = 1,100 do" LF
+"        test.assert_eq(map:find(tostring(v)), v % 2 == 0)" LF
+"    end" LF
+"end" LF
+);
+
+INFRA_TEST(hashmap_pairs,
+"do" LF
+"    local map = infra.make_hashmap({ a = 1, b = 2, c = 3 })" LF
+"    map:replace(\"c\", 4)" LF
+"    local sum, cnt = 0, 0" LF
+"    for k,v in map:pairs() do" LF
+"        sum = sum + v" LF
+"        cnt = cnt + 1" LF
+"        map:erase(k)" LF
+"    end" LF
+"    test.assert_eq(cnt, 3)" LF
+"    test.assert_eq(sum, 7)" LF
+"    test.assert_eq(map:size(), 0)" LF
+"end" LF
+"do" LF
+"    local map = infra.make_hashmap(infra.make_map({ a = 1, b = 2 }))" LF
+"    test.assert_eq(map:size(), 2)" LF
+"    test.assert_eq(select(2, map:find(\"a\")), 1)" LF
+"    test.assert_eq(select(2, map:find(\"b\")), 2)" LF
+"    map = infra.make_hashmap(infra.make_deque({ \"x\", \"y\" }))" LF
+"    test.assert_eq(map:size(), 2)" LF
+"    test.assert_eq(select(2, map:find(2)), \"y\")" LF
+"end" LF
+);
@@ -0,0 +1,63 @@
+#include "test.h"
+
+INFRA_TEST(heap,
+"local function check(opt, gen)" LF
+"    local heap = infra.make_heap(opt)" LF
+"    local ref = {}" LF
+"    for i = 1, 500 do" LF
+"        local p = gen(i)" LF
+"        heap:push(p, i)" LF
+"        ref[#ref + 1] = p" LF
+"    end" LF
+"    test.assert_eq(heap:size(), 500)" LF
+"    table.sort(ref, function(a, b) return infra.compare(a, b) < 0 end)" LF
+"    if opt and (opt.cmp == \"reverse\" or opt.cmp == \"number_reverse\") then" LF
+"        for i = 1, math.floor(#ref / 2) do" LF
+"            ref[i], ref[#ref - i + 1] = ref[#ref - i + 1], ref[i]" LF
+"        end" LF
+"    end" LF
+"    test.assert_eq(heap:peek(), ref[1])" LF
+"    for i = 1, #ref do" LF
+"        local p, v = heap:pop()" LF
+"        test.assert_eq(p, ref[i])" LF
+"        test.assert_eq(gen(v), p)" LF
+"    end" LF
+"    test.assert_eq(heap:size(), 0)" LF
+"    test.assert_eq(heap:pop(), nil)" LF
+"end" LF
+"local function num(i) return (i * 7919) % 1000 end" LF
+"local function str(i) return \"k\" .. num(i) end" LF
+"check(nil, num)" LF
+"check(nil, str)" LF
+"check({ cmp = \"reverse\" }, str)" LF
+"check({ cmp = \"number\" }, num)" LF
+"check({ cmp = \"number_reverse\" }, num)" LF
+"check({ cmp = function(a, b) return a - b end }, num)" LF
+);
+
+INFRA_TEST(heap_handle,
+"local heap = infra.make_heap({ cmp = \"number\" })" LF
+"local a = heap:push(5, \"a\")" LF
+"local b = heap:push(3, \"b\")" LF
+"local c = heap:push(4, \"c\")" LF
+"test.assert_eq(select(2, heap:peek()), \"b\")" LF
+"test.assert_eq(heap:update(a, 1), true)" LF
+"test.assert_eq(select(2, heap:peek()), \"a\")" LF
+"test.assert_eq(heap:update(a, 10), true)" LF
+"test.assert_eq(select(2, heap:get(a)), \"a\")" LF
+"test.assert_eq(heap:remove(b), true)" LF
+"test.assert_eq(heap:remove(b), false)" LF
+"test.assert_eq(heap:update(b, 0), false)" LF
+"test.assert_eq(heap:get(b), nil)" LF
+"local d = heap:push(2, \"d\")" LF
+"test.assert_ne(d, b)" LF
+"test.assert_eq(heap:remove(b), false)" LF
+"test.assert_eq(heap:size(), 3)" LF
+"test.assert_eq(select(2, heap:pop()), \"d\")" LF
+"test.assert_eq(select(2, heap:pop()), \"c\")" LF
+"test.assert_eq(select(2, heap:pop()), \"a\")" LF
+"test.assert_eq(heap:update(a, 1), false)" LF
+"test.assert_eq(pcall(heap.push, heap, \"x\", 1), false)" LF
+"test.assert_eq(pcall(heap.push, heap, nil, 1), false)" LF
+"test.assert_eq(pcall(infra.make_heap, { cmp = \"foo\" }), false)" LF
+);
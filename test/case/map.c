@@ -60,3 +60,571 @@ INFRA_TEST(map_make,
 "local map = infra.make_map(src)" LF
 "test.assert_eq(map:size(), 2)" LF
 );
+
+INFRA_TEST(map_mixed_key,
+"do" LF
+"    local map = infra.make_map()" LF
+"    local keys = { \"b\", 2, true, \"a\", 1.5, false, \"ab\", {}, 10 }" LF
+"    for _,k in ipairs(keys) do" LF
+"        test.assert_eq(map:insert(k, k), true)" LF
+"    end" LF
+"    test.assert_eq(map:size(), #keys)" LF
+"    local last = nil" LF
+"    for k,v in map:pairs() do" LF
+"        test.assert_eq(k, v)" LF
+"        if last ~= nil then" LF
+"            test.assert_eq(infra.compare(last, k), -1)" LF
+"        end" LF
+"        last = k" LF
+"    end" LF
+"    test.assert_eq(select(2, map:find(\"ab\")), \"ab\")" LF
+"    test.assert_eq(map:erase(1.5), true)" LF
+"    test.assert_eq(map:find(1.5), false)" LF
+"end" LF
+);
+
+INFRA_TEST(map_pairs_modify,
+"do" LF
+"    local map = infra.make_map()" LF
+"    for v = 1,100 do" LF
+"        map:insert(v, v)" LF
+"    end" LF
+"    local cnt = 0" LF
+"    for k,v in map:pairs() do" LF
+"        test.assert_eq(k, v)" LF
+"        cnt = cnt + 1" LF
+"        map:erase(k)" LF
+"        if k % 2 == 0 then" LF
+"            map:insert(k + 0.5, k + 0.5)" LF
+"            map:erase(k + 0.5)" LF
+"        end" LF
+"    end" LF
+"    test.assert_eq(cnt, 100)" LF
+"    test.assert_eq(map:size(), 0)" LF
+"end" LF
+);
+
+INFRA_TEST(map_pairs_control,
+"for _, opt in ipairs({ {}, { engine = \"btree\" }, { engine = \"btree\", cmp = \"integer\" } }) do" LF
+"    local a = infra.make_map({ 1, 2, 3, 4, 5, 6 }, opt)" LF
+"    local b = infra.make_map({ 10, 20, 30 }, opt)" LF
+"    local f, s = a:pairs()" LF
+"    test.assert_eq(f(s, nil), 1)" LF
+"    test.assert_eq(select(2, f(s, 4)), 5)" LF
+"    test.assert_eq(f(s, 2), 3)" LF
+"    test.assert_eq(f(s, 6), nil)" LF
+"    test.assert_eq(f(s, nil), 1)" LF
+"    test.assert_eq(select(2, f(b, 1)), 20)" LF
+"    test.assert_eq(select(2, f(b, 2)), 30)" LF
+"    test.assert_eq(f(s, 3), 4)" LF
+"end" LF
+);
+
+INFRA_TEST(map_memstat,
+"do" LF
+"    local map = infra.make_map()" LF
+"    local stat = map:memstat()" LF
+"    test.assert_eq(stat.nodes, 0)" LF
+"    for v = 1,1000 do" LF
+"        map:insert(v, v)" LF
+"    end" LF
+"    stat = map:memstat()" LF
+"    test.assert_eq(stat.nodes, 1000)" LF
+"    test.assert_ne(stat.chunks, 0)" LF
+"    test.assert_ne(stat.bytes, 0)" LF
+"    for v = 1,500 do" LF
+"        map:erase(v)" LF
+"    end" LF
+"    for v = 1,500 do" LF
+"        map:insert(-v, v)" LF
+"    end" LF
+"    test.assert_eq(map:memstat().nodes, 1000)" LF
+"    test.assert_eq(map:memstat().chunks, stat.chunks)" LF
+"end" LF
+);
+
+INFRA_TEST(map_replace_gc,
+"do" LF
+"    local map = infra.make_map()" LF
+"    local weak = setmetatable({}, { __mode = \"v\" })" LF
+"    for v = 1,10 do" LF
+"        map:insert(v, {})" LF
+"    end" LF
+"    for v = 1,10 do" LF
+"        local val = {}" LF
+"        weak[v] = val" LF
+"        map:replace(v, val)" LF
+"    end" LF
+"    test.assert_eq(map:size(), 10)" LF
+"    local cnt = 0" LF
+"    for k,v in map:pairs() do" LF
+"        cnt = cnt + 1" LF
+"        test.assert_eq(v, weak[k])" LF
+"    end" LF
+"    test.assert_eq(cnt, 10)" LF
+"    map = nil" LF
+"    collectgarbage()" LF
+"    collectgarbage()" LF
+"    test.assert_eq(next(weak), nil)" LF
+"end" LF
+);
+
+INFRA_TEST(map_bound,
+"do" LF
+"    local map = infra.make_map()" LF
+"    test.assert_eq(map:first(), nil)" LF
+"    test.assert_eq(map:last(), nil)" LF
+"    for v = 10,100,10 do" LF
+"        map:insert(v, v * 2)" LF
+"    end" LF
+"    local k, v = map:first()" LF
+"    test.assert_eq(k, 10)" LF
+"    test.assert_eq(v, 20)" LF
+"    test.assert_eq(map:last(), 100)" LF
+"    test.assert_eq(map:lower_bound(20), 20)" LF
+"    test.assert_eq(map:lower_bound(21), 30)" LF
+"    test.assert_eq(map:upper_bound(20), 30)" LF
+"    test.assert_eq(map:upper_bound(100), nil)" LF
+"    test.assert_eq(map:lower_bound(\"a\"), nil)" LF
+"end" LF
+);
+
+INFRA_TEST(map_range,
+"do" LF
+"    local map = infra.make_map()" LF
+"    for v = 1,100 do" LF
+"        map:insert(v, v)" LF
+"    end" LF
+"    local ret = {}" LF
+"    for k in map:range(10.5, 15) do" LF
+"        table.insert(ret, k)" LF
+"    end" LF
+"    test.assert_eq(table.concat(ret, \",\"), \"11,12,13,14,15\")" LF
+"    ret = {}" LF
+"    for k in map:range(10, 14.5, true) do" LF
+"        table.insert(ret, k)" LF
+"    end" LF
+"    test.assert_eq(table.concat(ret, \",\"), \"14,13,12,11,10\")" LF
+"    ret = {}" LF
+"    for k in map:range(nil, 3) do" LF
+"        table.insert(ret, k)" LF
+"    end" LF
+"    test.assert_eq(table.concat(ret, \",\"), \"1,2,3\")" LF
+"    ret = {}" LF
+"    for k in map:range(98, nil, true) do" LF
+"        table.insert(ret, k)" LF
+"    end" LF
+"    test.assert_eq(table.concat(ret, \",\"), \"100,99,98\")" LF
+"    ret = {}" LF
+"    for k in map:range(50, 40) do" LF
+"        table.insert(ret, k)" LF
+"    end" LF
+"    test.assert_eq(#ret, 0)" LF
+"    ret = {}" LF
+"    for k in map:range(20, 30, true) do" LF
+"        table.insert(ret, k)" LF
+"        map:erase(k)" LF
+"        map:erase(k - 1)" LF
+"    end" LF
+"    test.assert_eq(table.concat(ret, \",\"), \"30,28,26,24,22,20\")" LF
+"end" LF
+);
+
+INFRA_TEST(map_bulk_load,
+"do" LF
+"    local t = {}" LF
+"    for v = 1,1000 do" LF
+"        t[v] = v * 2" LF
+"        t[tostring(v)] = v" LF
+"    end" LF
+"    local map = infra.make_map(t)" LF
+"    test.assert_eq(map:size(), 2000)" LF
+"    local last = nil" LF
+"    for k,v in map:pairs() do" LF
+"        if last ~= nil then" LF
+"            test.assert_eq(infra.compare(last, k), -1)" LF
+"        end" LF
+"        last = k" LF
+"    end" LF
+"    for v = 1,1000 do" LF
+"        test.assert_eq(map:erase(v), true)" LF
+"        map:insert(-v, v)" LF
+"    end" LF
+"    test.assert_eq(map:size(), 2000)" LF
+"    test.assert_eq(map:first(), -1000)" LF
+"    local copy = infra.make_map(map)" LF
+"    test.assert_eq(copy:size(), 2000)" LF
+"    test.assert_eq(copy:last(), \"999\")" LF
+"end" LF
+);
+
+INFRA_TEST(map_bulk_load_sorted,
+"do" LF
+"    local t = {}" LF
+"    for v = 1,100 do" LF
+"        t[v] = v" LF
+"    end" LF
+"    local map = infra.make_map(t, { sorted = true })" LF
+"    test.assert_eq(map:size(), 100)" LF
+"    test.assert_eq(map:first(), 1)" LF
+"    test.assert_eq(map:last(), 100)" LF
+"    map = infra.make_map({ c = 3, a = 1, b = 2 }, { sorted = true })" LF
+"    test.assert_eq(map:first(), \"a\")" LF
+"    test.assert_eq(map:last(), \"c\")" LF
+"    test.assert_eq(map:lower_bound(\"b\"), \"b\")" LF
+"end" LF
+);
+
+INFRA_TEST(map_rank,
+"local function check(map)" LF
+"    for v = 1,200 do" LF
+"        map:insert(v * 2, v)" LF
+"    end" LF
+"    for v = 1,200,3 do" LF
+"        map:erase(v * 2)" LF
+"    end" LF
+"    local pos = 0" LF
+"    for k,v in map:pairs() do" LF
+"        pos = pos + 1" LF
+"        test.assert_eq(map:at(pos), k)" LF
+"        test.assert_eq(map:rank(k), pos)" LF
+"        test.assert_eq(map:rank(k - 0.5), pos)" LF
+"    end" LF
+"    test.assert_eq(pos, map:size())" LF
+"    test.assert_eq(map:at(0), nil)" LF
+"    test.assert_eq(map:at(pos + 1), nil)" LF
+"    test.assert_eq(map:at(-1), map:last())" LF
+"    test.assert_eq(map:rank(1000), pos + 1)" LF
+"    test.assert_eq(map:count(), pos)" LF
+"    test.assert_eq(map:count(10, 20), 4)" LF
+"    test.assert_eq(map:count(9.5, 20.5), 4)" LF
+"    test.assert_eq(map:count(nil, 4), 1)" LF
+"    test.assert_eq(map:count(396), 2)" LF
+"    test.assert_eq(map:count(20, 10), 0)" LF
+"end" LF
+"check(infra.make_map())" LF
+"check(infra.make_map(nil, { rank = true }))" LF
+"local t = {}" LF
+"for v = 1,100 do" LF
+"    t[v] = v" LF
+"end" LF
+"local map = infra.make_map(t, { rank = true })" LF
+"test.assert_eq(map:at(50), 50)" LF
+"test.assert_eq(map:rank(50), 50)" LF
+"map:erase(10)" LF
+"test.assert_eq(map:at(50), 51)" LF
+);
+
+INFRA_TEST(map_many,
+"do" LF
+"    local map = infra.make_map()" LF
+"    test.assert_eq(map:insert_many({ a = 1, b = 2, c = 3 }), 3)" LF
+"    test.assert_eq(map:insert_many({ c = 30, d = 4 }), 1)" LF
+"    test.assert_eq(map:size(), 4)" LF
+"    local ret = map:find_many({ \"a\", \"x\", \"c\", \"d\" })" LF
+"    test.assert_eq(ret[1], 1)" LF
+"    test.assert_eq(ret[2], nil)" LF
+"    test.assert_eq(ret[3], 3)" LF
+"    test.assert_eq(ret[4], 4)" LF
+"    test.assert_eq(map:erase_many({ \"a\", \"x\", \"d\", \"a\" }), 2)" LF
+"    test.assert_eq(map:size(), 2)" LF
+"    test.assert_eq(map:first(), \"b\")" LF
+"    test.assert_eq(map:last(), \"c\")" LF
+"end" LF
+);
+
+INFRA_TEST(map_cmp_native,
+"do" LF
+"    local map = infra.make_map(nil, { cmp = \"string_ci\" })" LF
+"    test.assert_eq(map:insert(\"Content-Type\", 1), true)" LF
+"    test.assert_eq(map:insert(\"content-type\", 2), false)" LF
+"    test.assert_eq(select(2, map:find(\"CONTENT-TYPE\")), 1)" LF
+"    test.assert_eq(pcall(map.insert, map, 1, 1), false)" LF
+"    map = infra.make_map({ 3, 1, 2 }, { cmp = \"integer_reverse\" })" LF
+"    test.assert_eq(map:first(), 3)" LF
+"    test.assert_eq(map:last(), 1)" LF
+"    test.assert_eq(pcall(map.insert, map, 1.5, 1), false)" LF
+"    map = infra.make_map({ b = 1, a = 2, c = 3 }, { cmp = \"string_reverse\" })" LF
+"    test.assert_eq(map:first(), \"c\")" LF
+"    map = infra.make_map({ 1, a = 2 }, { cmp = \"reverse\" })" LF
+"    test.assert_eq(map:first(), \"a\")" LF
+"    test.assert_eq(pcall(infra.make_map, nil, { cmp = \"unknown\" }), false)" LF
+"end" LF
+);
+
+INFRA_TEST(map_cmp_function,
+"do" LF
+"    local map = infra.make_map(nil, { cmp = function(a, b) return #a - #b end })" LF
+"    test.assert_eq(map:insert(\"aaa\", 1), true)" LF
+"    test.assert_eq(map:insert(\"b\", 2), true)" LF
+"    test.assert_eq(map:insert(\"ccc\", 3), false)" LF
+"    test.assert_eq(map:first(), \"b\")" LF
+"    test.assert_eq(select(2, map:find(\"xyz\")), 1)" LF
+"end" LF
+);
+
+INFRA_TEST(map_btree,
+"local function dump(map)" LF
+"    local t = {}" LF
+"    for k, v in pairs(map) do" LF
+"        t[#t + 1] = k .. \"=\" .. v" LF
+"    end" LF
+"    return table.concat(t, \",\")" LF
+"end" LF
+"local function check(opt)" LF
+"    local ref = infra.make_map(nil, { cmp = opt.cmp })" LF
+"    local map = infra.make_map(nil, opt)" LF
+"    math.randomseed(1)" LF
+"    for i = 1, 3000 do" LF
+"        local k = math.random(1, 500)" LF
+"        if math.random(1, 3) == 1 then" LF
+"            test.assert_eq(map:erase(k), ref:erase(k))" LF
+"        else" LF
+"            test.assert_eq(map:insert(k, i), ref:insert(k, i))" LF
+"        end" LF
+"    end" LF
+"    test.assert_eq(map:size(), ref:size())" LF
+"    test.assert_eq(dump(map), dump(ref))" LF
+"    test.assert_eq(map:first(), ref:first())" LF
+"    test.assert_eq(map:last(), ref:last())" LF
+"    for k = 0, 501, 7 do" LF
+"        test.assert_eq(select(2, map:find(k)), select(2, ref:find(k)))" LF
+"        test.assert_eq(map:lower_bound(k), ref:lower_bound(k))" LF
+"        test.assert_eq(map:upper_bound(k), ref:upper_bound(k))" LF
+"        test.assert_eq(map:rank(k), ref:rank(k))" LF
+"        test.assert_eq(map:at(k), ref:at(k))" LF
+"        test.assert_eq(map:count(k, k + 50), ref:count(k, k + 50))" LF
+"    end" LF
+"    local t = {}" LF
+"    for k in map:range(100, 200, true) do" LF
+"        t[#t + 1] = k" LF
+"    end" LF
+"    local r = {}" LF
+"    for k in ref:range(100, 200, true) do" LF
+"        r[#r + 1] = k" LF
+"    end" LF
+"    test.assert_eq(table.concat(t, \",\"), table.concat(r, \",\"))" LF
+"    for k in pairs(map) do" LF
+"        map:erase(k)" LF
+"    end" LF
+"    test.assert_eq(map:size(), 0)" LF
+"    test.assert_eq(map:memstat().nodes, 0)" LF
+"end" LF
+"check({ engine = \"btree\" })" LF
+"check({ engine = \"btree\", cmp = \"integer\" })" LF
+"check({ engine = \"btree\", cmp = \"integer_reverse\" })" LF
+"check({ engine = \"btree\", cmp = \"reverse\" })" LF
+"test.assert_eq(pcall(infra.make_map, nil, { engine = \"avl\" }), false)" LF
+);
+
+INFRA_TEST(map_btree_integer,
+"local keys = { -1, 0, 1 }" LF
+"if math.type ~= nil then" LF
+"    keys[#keys + 1] = math.mininteger" LF
+"    keys[#keys + 1] = math.mininteger + 1" LF
+"    keys[#keys + 1] = math.maxinteger" LF
+"    keys[#keys + 1] = math.maxinteger - 1" LF
+"end" LF
+"math.randomseed(2)" LF
+"for i = 1, 5000 do" LF
+"    keys[#keys + 1] = math.random(-1000000, 1000000) * math.random(1, 1000000)" LF
+"end" LF
+"for _, cmp in ipairs({ \"integer\", \"integer_reverse\" }) do" LF
+"    local ref = infra.make_map(nil, { cmp = cmp })" LF
+"    local map = infra.make_map(nil, { cmp = cmp, engine = \"btree\" })" LF
+"    for i, k in ipairs(keys) do" LF
+"        test.assert_eq(map:insert(k, i), ref:insert(k, i))" LF
+"    end" LF
+"    for i = 1, #keys, 3 do" LF
+"        test.assert_eq(map:erase(keys[i]), ref:erase(keys[i]))" LF
+"    end" LF
+"    for i = 2, #keys, 5 do" LF
+"        map:replace(keys[i], -i)" LF
+"        ref:replace(keys[i], -i)" LF
+"    end" LF
+"    test.assert_eq(map:size(), ref:size())" LF
+"    local a, b = {}, {}" LF
+"    for k, v in map:pairs() do a[#a + 1] = tostring(k) .. \"=\" .. v end" LF
+"    for k, v in ref:pairs() do b[#b + 1] = tostring(k) .. \"=\" .. v end" LF
+"    test.assert_eq(table.concat(a, \",\"), table.concat(b, \",\"))" LF
+"    for i = 1, #keys, 7 do" LF
+"        local k = keys[i]" LF
+"        test.assert_eq(select(2, map:find(k)), select(2, ref:find(k)))" LF
+"        test.assert_eq(map:lower_bound(k), ref:lower_bound(k))" LF
+"        test.assert_eq(map:upper_bound(k), ref:upper_bound(k))" LF
+"    end" LF
+"end" LF
+);
+
+INFRA_TEST(map_btree_replace,
+"local map = infra.make_map({ a = 1, b = 2, c = 3 }, { engine = \"btree\", cmp = \"string_ci\" })" LF
+"for i = 1, 100 do" LF
+"    map:insert(\"k\" .. i, i)" LF
+"end" LF
+"map:replace(\"B\", 20)" LF
+"test.assert_eq(map:lower_bound(\"b\"), \"B\")" LF
+"test.assert_eq(select(2, map:find(\"b\")), 20)" LF
+"map:replace(\"K50\", 500)" LF
+"test.assert_eq(map:lower_bound(\"k50\"), \"K50\")" LF
+"test.assert_eq(map:size(), 103)" LF
+"collectgarbage()" LF
+"test.assert_eq(map:erase(\"k50\"), true)" LF
+"test.assert_eq(map:find(\"K50\"), false)" LF
+);
+
+INFRA_TEST(map_snapshot,
+"local function dump(iter, s, ctl)" LF
+"    local t = {}" LF
+"    for k, v in iter, s, ctl do" LF
+"        t[#t + 1] = k .. \"=\" .. v" LF
+"    end" LF
+"    return table.concat(t, \",\")" LF
+"end" LF
+"local function check(opt)" LF
+"    local map = infra.make_map(nil, opt)" LF
+"    local snaps = {}" LF
+"    math.randomseed(2)" LF
+"    for i = 1, 2000 do" LF
+"        local k = math.random(1, 200)" LF
+"        local op = math.random(1, 3)" LF
+"        if op == 1 then" LF
+"            map:erase(k)" LF
+"        elseif op == 2 then" LF
+"            map:replace(k, i)" LF
+"        else" LF
+"            map:insert(k, i)" LF
+"        end" LF
+"        if i % 400 == 0 then" LF
+"            snaps[#snaps + 1] = { map:snapshot(), infra.make_map(map, opt) }" LF
+"        end" LF
+"        if i == 1000 then" LF
+"            table.remove(snaps, 1)" LF
+"            collectgarbage()" LF
+"        end" LF
+"    end" LF
+"    for _, v in ipairs(snaps) do" LF
+"        local snap, ref = v[1], v[2]" LF
+"        test.assert_eq(snap:size(), ref:size())" LF
+"        test.assert_eq(dump(snap:pairs()), dump(ref:pairs()))" LF
+"        test.assert_eq(dump(snap:range(50, 150, true)), dump(ref:range(50, 150, true)))" LF
+"        test.assert_eq(dump(snap:range(nil, 20)), dump(ref:range(nil, 20)))" LF
+"        test.assert_eq(snap:first(), ref:first())" LF
+"        test.assert_eq(snap:last(), ref:last())" LF
+"        for k = 0, 201, 3 do" LF
+"            test.assert_eq(select(2, snap:find(k)), select(2, ref:find(k)))" LF
+"            test.assert_eq(snap:lower_bound(k), ref:lower_bound(k))" LF
+"            test.assert_eq(snap:upper_bound(k), ref:upper_bound(k))" LF
+"        end" LF
+"    end" LF
+"end" LF
+"check()" LF
+"check({ engine = \"btree\", cmp = \"integer_reverse\" })" LF
+"local map = infra.make_map({ a = 1 })" LF
+"local snap = map:snapshot()" LF
+"test.assert_eq(snap.insert, nil)" LF
+"map:insert(\"b\", 2)" LF
+"test.assert_eq(snap:size(), 1)" LF
+"test.assert_eq(snap:find(\"b\"), false)" LF
+"snap = nil" LF
+"collectgarbage()" LF
+"map:erase(\"a\")" LF
+"test.assert_eq(map:size(), 1)" LF
+);
+
+INFRA_TEST(map_snapshot_chain,
+"local function dump(iter, s, ctl)" LF
+"    local t = {}" LF
+"    for k, v in iter, s, ctl do" LF
+"        t[#t + 1] = k .. \"=\" .. v" LF
+"    end" LF
+"    return table.concat(t, \",\")" LF
+"end" LF
+"local map = infra.make_map()" LF
+"for i = 1, 1000 do" LF
+"    map:insert(i, i)" LF
+"end" LF
+"local snaps = {}" LF
+"for i = 1, 20 do" LF
+"    snaps[i] = { map:snapshot(), infra.make_map(map) }" LF
+"    for k = i, 1000, 20 do" LF
+"        map:replace(k, -k)" LF
+"    end" LF
+"    map:erase(i * 10)" LF
+"    map:insert(1000 + i, i)" LF
+"end" LF
+"for i = 1, 20000 do" LF
+"    map:insert(-i, i)" LF
+"end" LF
+"for _, v in ipairs(snaps) do" LF
+"    local snap, ref = v[1], v[2]" LF
+"    test.assert_eq(snap:size(), ref:size())" LF
+"    test.assert_eq(dump(snap:pairs()), dump(ref:pairs()))" LF
+"    test.assert_eq(dump(snap:range(100, 200, true)), dump(ref:range(100, 200, true)))" LF
+"    for k = -5, 1030, 7 do" LF
+"        test.assert_eq(select(2, snap:find(k)), select(2, ref:find(k)))" LF
+"    end" LF
+"end" LF
+"local small = infra.make_map({ 10, 20, 30 })" LF
+"local snap = small:snapshot()" LF
+"for i = 4, 20000 do" LF
+"    small:insert(i, i)" LF
+"end" LF
+"small:erase(2)" LF
+"test.assert_eq(dump(snap:pairs()), \"1=10,2=20,3=30\")" LF
+"small = nil" LF
+"collectgarbage()" LF
+"test.assert_eq(dump(snap:pairs()), \"1=10,2=20,3=30\")" LF
+);
+
+INFRA_TEST(map_setop,
+"local function dump(map)" LF
+"    local t = {}" LF
+"    for k, v in map:pairs() do" LF
+"        t[#t + 1] = tostring(k) .. \"=\" .. tostring(v)" LF
+"    end" LF
+"    return table.concat(t, \",\")" LF
+"end" LF
+"local function check(opt)" LF
+"    local m1 = infra.make_map(nil, opt)" LF
+"    local m2 = infra.make_map(nil, opt)" LF
+"    for i = 1, 300 do" LF
+"        if i % 2 == 0 then m1:insert(i, \"a\" .. i) end" LF
+"        if i % 3 == 0 then m2:insert(i, \"b\" .. i) end" LF
+"    end" LF
+"    local u, n, d = {}, {}, {}" LF
+"    for i = 1, 300 do" LF
+"        if i % 2 == 0 or i % 3 == 0 then u[i] = i % 2 == 0 and \"a\" .. i or \"b\" .. i end" LF
+"        if i % 6 == 0 then n[i] = \"a\" .. i end" LF
+"        if i % 2 == 0 and i % 3 ~= 0 then d[i] = \"a\" .. i end" LF
+"    end" LF
+"    test.assert_eq(dump(m1:union(m2)), dump(infra.make_map(u, opt)))" LF
+"    test.assert_eq(dump(m1:intersect(m2)), dump(infra.make_map(n, opt)))" LF
+"    test.assert_eq(dump(m1:diff(m2)), dump(infra.make_map(d, opt)))" LF
+"    test.assert_eq(m1:union(m1):size(), m1:size())" LF
+"    test.assert_eq(m1:diff(m1):size(), 0)" LF
+"    test.assert_eq(m1:intersect(infra.make_map(nil, opt)):size(), 0)" LF
+"    local sum = 0" LF
+"    local cnt = m1:merge_join(m2, function(k, v1, v2)" LF
+"        test.assert_eq(v1, \"a\" .. k)" LF
+"        test.assert_eq(v2, \"b\" .. k)" LF
+"        sum = sum + k" LF
+"    end)" LF
+"    test.assert_eq(cnt, 50)" LF
+"    test.assert_eq(sum, 7650)" LF
+"end" LF
+"check()" LF
+"check({ rank = true })" LF
+"check({ engine = \"btree\" })" LF
+"check({ cmp = \"integer_reverse\" })" LF
+"check({ cmp = function(a, b) return a - b end })" LF
+"local m1 = infra.make_map({ a = 1, b = 2, [true] = 3 })" LF
+"local m2 = infra.make_map({ b = 4, c = 5, [true] = 6 })" LF
+"test.assert_eq(dump(m1:union(m2)), \"true=3,a=1,b=2,c=5\")" LF
+"local u = m1:union(m2)" LF
+"u:insert(\"z\", 0)" LF
+"test.assert_eq(m1:find(\"z\"), false)" LF
+"local ok = pcall(m1.union, m1, infra.make_map(nil, { cmp = \"reverse\" }))" LF
+"test.assert_eq(ok, false)" LF
+"ok = pcall(m1.merge_join, m1, m2, function() m1:insert(\"d\", 0) end)" LF
+"test.assert_eq(ok, false)" LF
+);
@@ -0,0 +1,104 @@
+#include "test.h"
+
+INFRA_TEST(map_mmap,
+"do" LF
+"    local tmpfile = \"map_mmap.tmp\"" LF
+"    local map = infra.make_map()" LF
+"    for i = 1, 200 do" LF
+"        map:insert(i * 2, \"v\" .. i)" LF
+"        map:insert(\"k\" .. i, i + 0.5)" LF
+"    end" LF
+"    map:insert(true, false)" LF
+"    map:insert(false, true)" LF
+"    map:save(tmpfile)" LF
+LF
+"    local m = infra.make_map_mmap(tmpfile)" LF
+"    test.assert_eq(m:size(), map:size())" LF
+"    local t1, t2 = {}, {}" LF
+"    for k, v in map:pairs() do" LF
+"        t1[#t1 + 1] = tostring(k) .. \"=\" .. tostring(v)" LF
+"    end" LF
+"    for k, v in pairs(m) do" LF
+"        t2[#t2 + 1] = tostring(k) .. \"=\" .. tostring(v)" LF
+"    end" LF
+"    test.assert_eq(table.concat(t1, \",\"), table.concat(t2, \",\"))" LF
+LF
+"    local ok, v = m:find(10)" LF
+"    test.assert_eq(ok, true)" LF
+"    test.assert_eq(v, \"v5\")" LF
+"    test.assert_eq(select(2, m:find(\"k7\")), 7.5)" LF
+"    test.assert_eq(select(2, m:find(true)), false)" LF
+"    test.assert_eq(m:find(11), false)" LF
+"    test.assert_eq(m:find(\"x\"), false)" LF
+"    test.assert_eq(m:first(), map:first())" LF
+"    test.assert_eq(m:last(), map:last())" LF
+"    test.assert_eq(select(2, m:lower_bound(11)), \"v6\")" LF
+"    test.assert_eq(m:upper_bound(12), 14)" LF
+LF
+"    for _, rev in ipairs({false, true}) do" LF
+"        t1, t2 = {}, {}" LF
+"        for k, v in map:range(9, 21, rev) do" LF
+"            t1[#t1 + 1] = k .. \"=\" .. v" LF
+"        end" LF
+"        for k, v in m:range(9, 21, rev) do" LF
+"            t2[#t2 + 1] = k .. \"=\" .. v" LF
+"        end" LF
+"        test.assert_eq(table.concat(t2, \",\"), table.concat(t1, \",\"))" LF
+"    end" LF
+LF
+"    m:close()" LF
+"    test.assert_eq(pcall(m.size, m), false)" LF
+"    os.remove(tmpfile)" LF
+"end" LF
+);
+
+INFRA_TEST(map_mmap_cmp,
+"do" LF
+"    local tmpfile = \"map_mmap.tmp\"" LF
+"    local map = infra.make_map(nil, { cmp = \"string_ci_reverse\" })" LF
+"    map:insert(\"b\", 2)" LF
+"    map:insert(\"A\", 1)" LF
+"    map:insert(\"C\", 3)" LF
+"    map:save(tmpfile)" LF
+LF
+"    local m = infra.make_map_mmap(tmpfile)" LF
+"    local t = {}" LF
+"    for k in m:pairs() do" LF
+"        t[#t + 1] = k" LF
+"    end" LF
+"    test.assert_eq(table.concat(t), \"CbA\")" LF
+"    test.assert_eq(select(2, m:find(\"c\")), 3)" LF
+"    test.assert_eq(pcall(m.find, m, 1), false)" LF
+"    m = nil" LF
+"    collectgarbage()" LF
+LF
+"    map = infra.make_map(nil, { cmp = \"integer\" })" LF
+"    for i = 10, 1, -1 do" LF
+"        map:insert(i, i * i)" LF
+"    end" LF
+"    map:save(tmpfile)" LF
+"    m = infra.make_map_mmap(tmpfile)" LF
+"    test.assert_eq(select(2, m:find(4)), 16)" LF
+"    test.assert_eq(m:lower_bound(11), nil)" LF
+"    m = nil" LF
+"    collectgarbage()" LF
+"    os.remove(tmpfile)" LF
+"end" LF
+);
+
+INFRA_TEST(map_mmap_error,
+"do" LF
+"    local tmpfile = \"map_mmap.tmp\"" LF
+"    local map = infra.make_map({ a = {} })" LF
+"    test.assert_eq(pcall(map.save, map, tmpfile), false)" LF
+"    test.assert_eq(io.open(tmpfile), nil)" LF
+LF
+"    map = infra.make_map(nil, { cmp = function(a, b) return a < b end })" LF
+"    test.assert_eq(pcall(map.save, map, tmpfile), false)" LF
+LF
+"    infra.writefile(tmpfile, \"hello world\")" LF
+"    test.assert_eq(pcall(infra.make_map_mmap, tmpfile), false)" LF
+"    os.remove(tmpfile)" LF
+"    test.assert_eq(pcall(infra.make_map_mmap, tmpfile), false)" LF
+"end" LF
+);
@@ -0,0 +1,68 @@
+#include "test.h"
+
+INFRA_TEST(set,
+"local set = infra.make_set()" LF
+"test.assert_eq(set:size(), 0)" LF
+"test.assert_eq(set:first(), nil)" LF
+"for i = 100, 1, -1 do" LF
+"    test.assert_eq(set:add(i), true)" LF
+"end" LF
+"test.assert_eq(set:add(50), false)" LF
+"test.assert_eq(set:size(), 100)" LF
+"test.assert_eq(set:contains(50), true)" LF
+"test.assert_eq(set:contains(101), false)" LF
+"test.assert_eq(set:first(), 1)" LF
+"test.assert_eq(set:last(), 100)" LF
+"test.assert_eq(set:remove(50), true)" LF
+"test.assert_eq(set:remove(50), false)" LF
+"test.assert_eq(set:contains(50), false)" LF
+"local cnt, prev = 0, 0" LF
+"for k, v in set:pairs() do" LF
+"    test.assert_eq(v, true)" LF
+"    test.assert_eq(k > prev, true)" LF
+"    prev = k" LF
+"    cnt = cnt + 1" LF
+"    set:remove(k)" LF
+"end" LF
+"test.assert_eq(cnt, 99)" LF
+"test.assert_eq(set:size(), 0)" LF
+"test.assert_eq(pcall(set.add, set, nil), false)" LF
+);
+
+INFRA_TEST(set_many,
+"local t = {}" LF
+"local set = infra.make_set({ \"c\", \"a\", \"b\", \"a\", true, 1 })" LF
+"test.assert_eq(set:size(), 5)" LF
+"for k in set:pairs() do" LF
+"    t[#t + 1] = tostring(k)" LF
+"end" LF
+"test.assert_eq(table.concat(t, \",\"), \"true,1,a,b,c\")" LF
+"test.assert_eq(set:add_many({ \"a\", \"d\", \"e\" }), 2)" LF
+"test.assert_eq(set:remove_many({ \"a\", \"x\", true }), 2)" LF
+"test.assert_eq(set:size(), 5)" LF
+"local copy = infra.make_set(set)" LF
+"test.assert_eq(copy:size(), 5)" LF
+"test.assert_eq(copy:contains(\"e\"), true)" LF
+"copy = infra.make_set(infra.make_map({ x = 1, y = 2 }))" LF
+"test.assert_eq(copy:first(), \"x\")" LF
+"test.assert_eq(copy:last(), \"y\")" LF
+"local k1, k2 = {}, {}" LF
+"set = infra.make_set({ k1, k2, k1 })" LF
+"test.assert_eq(set:size(), 2)" LF
+"test.assert_eq(set:contains(k2), true)" LF
+"test.assert_eq(set:contains({}), false)" LF
+);
+
+INFRA_TEST(set_pairs_control,
+"local a = infra.make_set({ 1, 2, 3, 4, 5, 6 })" LF
+"local b = infra.make_set({ 10, 20, 30, 40, 50, 60 })" LF
+"local f, s = a:pairs()" LF
+"test.assert_eq(f(s, nil), 1)" LF
+"test.assert_eq(f(s, 4), 5)" LF
+"test.assert_eq(f(s, 2), 3)" LF
+"test.assert_eq(f(s, 6), nil)" LF
+"test.assert_eq(f(s, nil), 1)" LF
+"test.assert_eq(f(b, 10), 20)" LF
+"test.assert_eq(f(b, 20), 30)" LF
+"test.assert_eq(f(s, 3), 4)" LF
+);
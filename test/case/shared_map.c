@@ -0,0 +1,224 @@
+#include <infra.lua.h>
+#include <stdio.h>
+#include "test.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#define TEST_SHARED_MAP_THREADS 8
+
+INFRA_TEST(shared_map,
+"local a = infra.make_shared_map(\"test.shared_map\")" LF
+"local b = infra.make_shared_map(\"test.shared_map\")" LF
+"test.assert_eq(a:name(), \"test.shared_map\")" LF
+"test.assert_eq(a:size(), 0)" LF
+"for i = 100, 1, -1 do" LF
+"    a:set(i, i * 2)" LF
+"    a:set(\"k\" .. i, { v = i, s = \"x\", t = { true, false } })" LF
+"end" LF
+"test.assert_eq(b:size(), 200)" LF
+"test.assert_eq(b:get(7), 14)" LF
+"test.assert_eq(b:get(7.0), 14)" LF
+"test.assert_eq(b:get(\"k7\").v, 7)" LF
+"test.assert_eq(b:get(\"k7\").t[1], true)" LF
+"test.assert_eq(b:get(\"k7\").t[2], false)" LF
+"test.assert_eq(b:get(\"missing\"), nil)" LF
+"test.assert_eq(b:first(), 1)" LF
+"test.assert_eq(select(2, b:first()), 2)" LF
+"test.assert_eq(b:last(), \"k99\")" LF
+"local prev, cnt = nil, 0" LF
+"for k, v in b:pairs() do" LF
+"    if prev ~= nil then" LF
+"        test.assert_eq(infra.compare(prev, k), -1)" LF
+"    end" LF
+"    prev, cnt = k, cnt + 1" LF
+"end" LF
+"test.assert_eq(cnt, 200)" LF
+"a:set(1, \"one\")" LF
+"test.assert_eq(b:get(1), \"one\")" LF
+"test.assert_eq(b:size(), 200)" LF
+"test.assert_eq(b:remove(1), true)" LF
+"test.assert_eq(b:remove(1), false)" LF
+"a:set(2, nil)" LF
+"test.assert_eq(a:get(2), nil)" LF
+"test.assert_eq(a:size(), 198)" LF
+"for k in a:pairs() do" LF
+"    a:remove(k)" LF
+"end" LF
+"test.assert_eq(b:size(), 0)" LF
+);
+
+INFRA_TEST(shared_map_error,
+"local m = infra.make_shared_map(\"test.shared_map_error\")" LF
+"test.assert_eq(pcall(m.set, m, {}, 1), false)" LF
+"test.assert_eq(pcall(m.set, m, 0/0, 1), false)" LF
+"test.assert_eq(pcall(m.set, m, 1, print), false)" LF
+"local t = {}" LF
+"t.self = t" LF
+"test.assert_eq(pcall(m.set, m, 1, t), false)" LF
+"test.assert_eq(m:size(), 0)" LF
+"m:set(1, \"a\")" LF
+"m = nil" LF
+"collectgarbage()" LF
+"collectgarbage()" LF
+"m = infra.make_shared_map(\"test.shared_map_error\")" LF
+"test.assert_eq(m:size(), 0)" LF
+);
+
+INFRA_TEST(shared_map_number_key,
+"if math.type == nil then return end" LF
+"local m = infra.make_shared_map(\"test.shared_map_number_key\")" LF
+"m:set(math.maxinteger, \"max\")" LF
+"m:set(math.maxinteger - 1, \"max-1\")" LF
+"m:set(2.0^63, \"2^63\")" LF
+"m:set(-2.0^63, \"-2^63\")" LF
+"local p53 = math.tointeger(2^53)" LF
+"m:set(p53, \"2^53\")" LF
+"m:set(p53 + 1, \"2^53+1\")" LF
+"m:set(2.0^53, \"2.0^53\")" LF
+"m:set(0.5, \"0.5\")" LF
+"test.assert_eq(m:size(), 7)" LF
+"test.assert_eq(m:get(math.maxinteger), \"max\")" LF
+"test.assert_eq(m:get(math.maxinteger - 1), \"max-1\")" LF
+"test.assert_eq(m:get(2.0^63), \"2^63\")" LF
+"test.assert_eq(m:get(math.mininteger), \"-2^63\")" LF
+"test.assert_eq(m:get(p53), \"2.0^53\")" LF
+"test.assert_eq(m:get(p53 + 1), \"2^53+1\")" LF
+"test.assert_eq(m:first(), math.mininteger)" LF
+"test.assert_eq(m:last(), 2.0^63)" LF
+"local keys = {}" LF
+"for k in m:pairs() do" LF
+"    keys[#keys + 1] = k" LF
+"    m:remove(k)" LF
+"end" LF
+"test.assert_eq(#keys, 7)" LF
+"test.assert_eq(keys[2], 0.5)" LF
+"test.assert_eq(keys[6], math.maxinteger)" LF
+);
+
+typedef struct test_shared_map_thread
+{
+    int         id;         /**< Thread id, starts from 1. */
+    int         ret;        /**< Script result. */
+    char        err[1024];  /**< Error message. */
+} test_shared_map_thread_t;
+
+static const char* s_test_shared_map_thread_script =
+"local id = ..." LF
+"local m = infra.make_shared_map(\"test.shared_map_thread\")" LF
+"for i = 1, 2000 do" LF
+"    local k = id * 10000 + i" LF
+"    m:set(k, { id = id, i = i })" LF
+"    local v = m:get(k)" LF
+"    assert(v.id == id and v.i == i)" LF
+"    m:set(\"shared\" .. i % 16, { id = id, i = i })" LF
+"    v = m:get(\"shared\" .. (i + 1) % 16)" LF
+"    assert(v == nil or v.i % 16 == (i + 1) % 16)" LF
+"    if i % 2 == 0 then" LF
+"        assert(m:remove(k - 1))" LF
+"    end" LF
+"    if i % 500 == 0 then" LF
+"        for k, v in m:pairs() do end" LF
+"    end" LF
+"end" LF
+"for i = 1, 2000 do" LF
+"    local v = m:get(id * 10000 + i)" LF
+"    if i % 2 == 0 then" LF
+"        assert(v.i == i)" LF
+"    else" LF
+"        assert(v == nil)" LF
+"    end" LF
+"end" LF;
+
+/**
+ * @brief Run \p script with \p id as argument.
+ * @return 0 if success, otherwise the error message is written into \p err.
+ */
+static int _test_shared_map_run(lua_State* L, const char* script, int id, char* err, size_t err_sz)
+{
+    int ret = luaL_loadstring(L, script);
+    if (ret == 0)
+    {
+        lua_pushinteger(L, id);
+        ret = lua_pcall(L, 1, 0, 0);
+    }
+    if (ret != 0)
+    {
+        snprintf(err, err_sz, "%s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+    return ret;
+}
+
+static lua_State* _test_shared_map_new_state(void)
+{
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    lua_pushcfunction(L, luaopen_infra);
+    lua_call(L, 0, 1);
+    lua_setglobal(L, "infra");
+    return L;
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI _test_shared_map_thread(LPVOID arg)
+#else
+static void* _test_shared_map_thread(void* arg)
+#endif
+{
+    test_shared_map_thread_t* thr = arg;
+
+    lua_State* L = _test_shared_map_new_state();
+    thr->ret = _test_shared_map_run(L, s_test_shared_map_thread_script, thr->id, thr->err, sizeof(thr->err));
+    lua_close(L);
+
+    return 0;
+}
+
+TEST(infra, shared_map_thread)
+{
+    int i;
+    char err[1024];
+    test_shared_map_thread_t thr[TEST_SHARED_MAP_THREADS];
+
+    /* Keep the map open after threads exit. */
+    lua_State* L = _test_shared_map_new_state();
+    ASSERT_EQ_INT(_test_shared_map_run(L,
+        "m = infra.make_shared_map(\"test.shared_map_thread\")", 0, err, sizeof(err)), 0, "%s", err);
+
+#if defined(_WIN32)
+    HANDLE tid[TEST_SHARED_MAP_THREADS];
+#else
+    pthread_t tid[TEST_SHARED_MAP_THREADS];
+#endif
+    for (i = 0; i < TEST_SHARED_MAP_THREADS; i++)
+    {
+        thr[i].id = i + 1;
+        thr[i].ret = -1;
+        thr[i].err[0] = '\0';
+#if defined(_WIN32)
+        tid[i] = CreateThread(NULL, 0, _test_shared_map_thread, &thr[i], 0, NULL);
+        ASSERT_NE_PTR(tid[i], NULL);
+#else
+        ASSERT_EQ_INT(pthread_create(&tid[i], NULL, _test_shared_map_thread, &thr[i]), 0);
+#endif
+    }
+    for (i = 0; i < TEST_SHARED_MAP_THREADS; i++)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(tid[i], INFINITE);
+        CloseHandle(tid[i]);
+#else
+        pthread_join(tid[i], NULL);
+#endif
+    }
+    for (i = 0; i < TEST_SHARED_MAP_THREADS; i++)
+    {
+        ASSERT_EQ_INT(thr[i].ret, 0, "%s", thr[i].err);
+    }
+
+    ASSERT_EQ_INT(_test_shared_map_run(L,
+        "assert(m:size() == " STRINGIFY(TEST_SHARED_MAP_THREADS) " * 1000 + 16)", 0, err, sizeof(err)), 0, "%s", err);
+    lua_close(L);
+}
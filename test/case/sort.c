@@ -0,0 +1,65 @@
+#include "test.h"
+
+INFRA_TEST(sort,
+"local function check(t, cmp)" LF
+"    for i = 2, #t do" LF
+"        test.assert_ne(cmp(t[i - 1], t[i]), 1)" LF
+"    end" LF
+"end" LF
+"local function gen(n, fn)" LF
+"    local t = {}" LF
+"    for i = 1, n do t[i] = fn(i) end" LF
+"    return t" LF
+"end" LF
+"local function num(i) return (i * 7919) % 1000 end" LF
+"local function str(i) return \"k\" .. num(i) end" LF
+"local function mix(i) return i % 2 == 0 and num(i) or str(i) end" LF
+"for _, fn in ipairs({ num, str, mix }) do" LF
+"    for _, n in ipairs({ 0, 1, 10, 1000 }) do" LF
+"        local t = gen(n, fn)" LF
+"        test.assert_eq(infra.sort(t), t)" LF
+"        test.assert_eq(#t, n)" LF
+"        check(t, infra.compare)" LF
+"        infra.sort(t, { cmp = \"reverse\" })" LF
+"        check(t, function(a, b) return infra.compare(b, a) end)" LF
+"    end" LF
+"end" LF
+"local t = gen(500, function(i) return i % 10 end)" LF
+"infra.sort(t)" LF
+"check(t, infra.compare)" LF
+"t = gen(100, num)" LF
+"infra.sort(t, function(a, b) return b - a end)" LF
+"check(t, function(a, b) return infra.compare(b, a) end)" LF
+"t = gen(100, num)" LF
+"infra.sort(t, function() return 1 end)" LF
+"test.assert_eq(#t, 100)" LF
+"test.assert_eq(pcall(infra.sort, t, { cmp = \"unknown\" }), false)" LF
+);
+
+INFRA_TEST(sort_variant,
+"local t = {}" LF
+"for i = 1, 300 do t[i] = { k = (i * 37) % 10, i = i } end" LF
+"infra.sort(t, { stable = true, cmp = function(a, b) return a.k - b.k end })" LF
+"for i = 2, #t do" LF
+"    test.assert_eq(t[i - 1].k <= t[i].k, true)" LF
+"    if t[i - 1].k == t[i].k then" LF
+"        test.assert_eq(t[i - 1].i < t[i].i, true)" LF
+"    end" LF
+"end" LF
+"local function gen()" LF
+"    local r = {}" LF
+"    for i = 1, 1000 do r[i] = (i * 7919) % 1000 end" LF
+"    return r" LF
+"end" LF
+"t = infra.sort(gen(), { partial_sort = 10 })" LF
+"for i = 1, 10 do test.assert_eq(t[i], i - 1) end" LF
+"test.assert_eq(#t, 1000)" LF
+"for _, n in ipairs({ 1, 2, 17, 500, 999, 1000 }) do" LF
+"    t = infra.sort(gen(), { nth_element = n })" LF
+"    test.assert_eq(t[n], n - 1)" LF
+"    for i = 1, n - 1 do test.assert_eq(t[i] <= t[n], true) end" LF
+"    for i = n + 1, #t do test.assert_eq(t[i] >= t[n], true) end" LF
+"end" LF
+"test.assert_eq(pcall(infra.sort, gen(), { nth_element = 0 }), false)" LF
+"test.assert_eq(pcall(infra.sort, gen(), { nth_element = 1001 }), false)" LF
+);
@@ -192,12 +192,23 @@ static int _assert_ne(lua_State* L)
     return lua_error(L);
 }
 
+/**
+ * @brief Create a light userdata from integer, so tests can reach code that
+ *   only light userdata goes through.
+ */
+static int _lightuserdata(lua_State* L)
+{
+    lua_pushlightuserdata(L, (void*)(intptr_t)luaL_checkinteger(L, 1));
+    return 1;
+}
+
 static int _luaopen_test(lua_State* L)
 {
     static const luaL_Reg s_api[] = {
         { "is_eq",      _is_eq },
         { "assert_eq",  _assert_eq },
         { "assert_ne",  _assert_ne },
+        { "lightuserdata", _lightuserdata },
         { NULL,         NULL },
     };
 #if defined(luaL_newlib)